@@ -64,6 +64,10 @@
 #define MAX_DEVICES 32
 #define MAX_ARGS 32
 
+#define MAX_STACK_DEPTH		16	/* max depth of stacked devices (dm, md) */
+#define REQUESTS_PER_CHECK	32	/* queue/nr_requests per fsck instance */
+#define MAX_DISK_CHECKS		8	/* max checks on one non-rotational disk */
+
 static const char *ignored_types[] = {
 	"ignore",
 	"iso9660",
@@ -84,6 +88,18 @@ static const char *really_wanted[] = {
 	NULL
 };
 
+/*
+ * Physical (bottom-most) disk, used by the disk scheduler to limit number of
+ * checks running on the disk at the same time.
+ */
+struct fsck_disk
+{
+	dev_t		devno;
+	int		budget;		/* max number of checks */
+	int		running;	/* number of running checks */
+	struct fsck_disk *next;
+};
+
 /*
  * Internal structure for mount tabel entries.
  */
@@ -91,9 +107,13 @@ struct fsck_fs_data
 {
 	const char	*device;
 	dev_t		disk;
+	struct fsck_disk **pdisks;	/* physical disks below the device */
+	size_t		npdisks;
 	unsigned int	stacked:1,
 			done:1,
-			eval_device:1;
+			running:1,
+			eval_device:1,
+			eval_pdisks:1;
 };
 
 /*
@@ -136,11 +156,15 @@ static int parallel_root;
 static int progress;
 static int progress_fd;
 static int force_all_parallel;
+static int schedule_by_disk;
 static int report_stats;
 
 static int num_running;
 static int max_running;
 
+static struct fsck_disk *disk_list;
+static int exclusive_running;	/* check on unknown device is running */
+
 static volatile int cancel_requested;
 static int kill_sent;
 static char *fstype;
@@ -283,25 +307,24 @@ static void fs_set_done(struct libmnt_fs *fs)
 		data->done = 1;
 }
 
-static int is_irrotational_disk(dev_t disk)
+static int read_disk_attr(dev_t disk, const char *attr, int *res)
 {
 	char path[PATH_MAX];
 	FILE *f;
-	int rc, x;
-
+	int rc;
 
 	rc = snprintf(path, sizeof(path),
-			"/sys/dev/block/%d:%d/queue/rotational",
-			major(disk), minor(disk));
+			"/sys/dev/block/%d:%d/%s",
+			major(disk), minor(disk), attr);
 
 	if (rc < 0 || (unsigned int) (rc + 1) > sizeof(path))
-		return 0;
+		return -1;
 
 	f = fopen(path, "r");
 	if (!f)
-		return 0;
+		return -1;
 
-	rc = fscanf(f, "%d", &x);
+	rc = fscanf(f, "%d", res);
 	if (rc != 1) {
 		if (ferror(f))
 			warn(_("failed to read: %s"), path);
@@ -310,7 +333,14 @@ static int is_irrotational_disk(dev_t disk)
 	}
 	fclose(f);
 
-	return rc == 1 ? !x : 0;
+	return rc == 1 ? 0 : -1;
+}
+
+static int is_irrotational_disk(dev_t disk)
+{
+	int x;
+
+	return read_disk_attr(disk, "queue/rotational", &x) == 0 ? !x : 0;
 }
 
 static void lock_disk(struct fsck_instance *inst)
@@ -1153,6 +1183,296 @@ static int disk_already_active(struct libmnt_fs *fs)
 	return 0;
 }
 
+/*
+ * Returns the physical disk, the number of checks allowed on the disk at the
+ * same time is one for rotational disks and depends on the queue size for
+ * non-rotational disks.
+ */
+static struct fsck_disk *get_disk(dev_t devno)
+{
+	struct fsck_disk *d;
+	int nr;
+
+	for (d = disk_list; d; d = d->next)
+		if (d->devno == devno)
+			return d;
+
+	d = xcalloc(1, sizeof(*d));
+	d->devno = devno;
+	d->budget = 1;
+
+	if (is_irrotational_disk(devno) &&
+	    read_disk_attr(devno, "queue/nr_requests", &nr) == 0)
+		d->budget = min(max(nr / REQUESTS_PER_CHECK, 1), MAX_DISK_CHECKS);
+
+	if (verbose > 1) {
+		char *name = blkid_devno_to_devname(devno);
+
+		printf(_("%s: max %d check(s) at the same time\n"),
+			name ? name : "?", d->budget);
+		free(name);
+	}
+
+	d->next = disk_list;
+	disk_list = d;
+	return d;
+}
+
+static void add_physical_disk(struct fsck_fs_data *data, struct fsck_disk *d)
+{
+	size_t i;
+
+	for (i = 0; i < data->npdisks; i++)
+		if (data->pdisks[i] == d)
+			return;
+
+	data->pdisks = xrealloc(data->pdisks,
+			(data->npdisks + 1) * sizeof(struct fsck_disk *));
+	data->pdisks[data->npdisks++] = d;
+}
+
+/*
+ * Follows /sys/dev/block/<devno>/slaves/ down to the physical disks.
+ */
+static void add_physical_disks(struct fsck_fs_data *data, dev_t devno, int depth)
+{
+	char dirname[PATH_MAX], path[PATH_MAX];
+	struct dirent *dp;
+	DIR *dir = NULL;
+	dev_t disk = 0;
+	int nslaves = 0;
+
+	if (blkid_devno_to_wholedisk(devno, NULL, 0, &disk) || !disk)
+		disk = devno;
+
+	snprintf(dirname, sizeof(dirname),
+			"/sys/dev/block/%u:%u/slaves",
+			major(disk), minor(disk));
+
+	if (depth < MAX_STACK_DEPTH)
+		dir = opendir(dirname);
+
+	while (dir && (dp = readdir(dir)) != 0) {
+		unsigned int maj, mi;
+		FILE *f;
+		int rc;
+
+		if (dp->d_name[0] == '.')
+			continue;
+
+		rc = snprintf(path, sizeof(path), "%s/%s/dev", dirname, dp->d_name);
+		if (rc < 0 || (unsigned int) (rc + 1) > sizeof(path))
+			continue;
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		rc = fscanf(f, "%u:%u", &maj, &mi);
+		fclose(f);
+		if (rc != 2)
+			continue;
+
+		add_physical_disks(data, makedev(maj, mi), depth + 1);
+		nslaves++;
+	}
+	if (dir)
+		closedir(dir);
+
+	if (!nslaves)
+		add_physical_disk(data, get_disk(disk));
+}
+
+/*
+ * Returns number of physical disks used by the filesystem; zero means that
+ * the device is unknown.
+ */
+static size_t fs_get_physical_disks(struct libmnt_fs *fs,
+				    struct fsck_disk ***disks)
+{
+	struct fsck_fs_data *data = fs_create_data(fs);
+
+	if (!data->eval_pdisks) {
+		const char *device;
+		struct stat st;
+
+		data->eval_pdisks = 1;
+
+		if (!mnt_fs_is_netfs(fs) && !mnt_fs_is_pseudofs(fs) &&
+		    (device = fs_get_device(fs)) &&
+		    stat(device, &st) == 0 && S_ISBLK(st.st_mode))
+			add_physical_disks(data, st.st_rdev, 0);
+	}
+
+	*disks = data->pdisks;
+	return data->npdisks;
+}
+
+static void fs_set_running(struct libmnt_fs *fs, int running)
+{
+	struct fsck_fs_data *data = fs_create_data(fs);
+	struct fsck_disk **disks;
+	size_t i, ndisks;
+
+	if (data->running == (running ? 1 : 0))
+		return;
+
+	data->running = running ? 1 : 0;
+	ndisks = fs_get_physical_disks(fs, &disks);
+
+	for (i = 0; i < ndisks; i++)
+		disks[i]->running += running ? 1 : -1;
+	if (!ndisks)
+		exclusive_running = running;
+}
+
+static int fs_is_finished(struct libmnt_fs *fs)
+{
+	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
+	return data ? data->done && !data->running : 0;
+}
+
+/*
+ * Returns TRUE if @fs has to be checked after @other, it means that @other
+ * has lower pass number and shares a physical disk with @fs. The filesystems
+ * on unknown devices are ordered with all other filesystems.
+ */
+static int fs_depends_on(struct libmnt_fs *fs, struct libmnt_fs *other)
+{
+	struct fsck_disk **a, **b;
+	size_t na, nb, i, j;
+
+	if (mnt_fs_get_passno(other) >= mnt_fs_get_passno(fs))
+		return 0;
+
+	na = fs_get_physical_disks(fs, &a);
+	nb = fs_get_physical_disks(other, &b);
+	if (!na || !nb)
+		return 1;
+
+	for (i = 0; i < na; i++)
+		for (j = 0; j < nb; j++)
+			if (a[i] == b[j])
+				return 1;
+	return 0;
+}
+
+/*
+ * Returns TRUE if all filesystems which @fs depends on are already checked
+ * and all physical disks used by @fs are able to accept another check.
+ */
+static int fs_is_ready(struct libmnt_fs *fs, struct libmnt_fs **fss, size_t nfss)
+{
+	struct fsck_disk **disks;
+	size_t i, ndisks;
+
+	for (i = 0; i < nfss; i++) {
+		if (fss[i] != fs && !fs_is_finished(fss[i]) &&
+		    fs_depends_on(fs, fss[i]))
+			return 0;
+	}
+
+	if (force_all_parallel)
+		return 1;
+	if (exclusive_running)
+		return 0;
+
+	ndisks = fs_get_physical_disks(fs, &disks);
+
+	/* don't check unknown device with any other device */
+	if (!ndisks)
+		return num_running == 0;
+
+	for (i = 0; i < ndisks; i++)
+		if (disks[i]->running >= disks[i]->budget)
+			return 0;
+	return 1;
+}
+
+/*
+ * Wait for at least one check and release its disks.
+ */
+static int wait_scheduled(void)
+{
+	struct fsck_instance *inst;
+	int	global_status = 0;
+	int	wait_flags = 0;
+
+	while ((inst = wait_one(wait_flags))) {
+		global_status |= inst->exit_status;
+		fs_set_running(inst->fs, 0);
+		free_instance(inst);
+		/* -N: finish the checks one by one in the order they started */
+		if (noexecute)
+			break;
+		wait_flags = WNOHANG;
+	}
+	return global_status;
+}
+
+/*
+ * The disk scheduler. The pass numbers define order of the filesystems on
+ * the same physical disk only, and a check is started as soon as all the
+ * filesystems it depends on are checked and its disks have a free slot.
+ */
+static int check_scheduled(struct libmnt_iter *itr)
+{
+	struct libmnt_fs *fs, **fss = NULL;
+	size_t i, nfss = 0, npending;
+	int status = FSCK_EX_OK;
+
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
+
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		if (fs_is_done(fs))
+			continue;
+		fss = xrealloc(fss, (nfss + 1) * sizeof(struct libmnt_fs *));
+		fss[nfss++] = fs;
+	}
+
+	npending = nfss;
+
+	while (npending && !cancel_requested) {
+		int rc;
+
+		/* the ready filesystem with the lowest pass number */
+		fs = NULL;
+		if (!(serialize && num_running) &&
+		    !(max_running && num_running >= max_running)) {
+			for (i = 0; i < nfss; i++) {
+				if (fs_is_done(fss[i]) ||
+				    (fs && mnt_fs_get_passno(fss[i]) >=
+					   mnt_fs_get_passno(fs)) ||
+				    !fs_is_ready(fss[i], fss, nfss))
+					continue;
+				fs = fss[i];
+			}
+		}
+
+		if (fs) {
+			npending--;
+			if (!(ignore_mounted && is_mounted(fs))) {
+				rc = fsck_device(fs, serialize);
+				if (!rc)
+					fs_set_running(fs, 1);
+				status |= rc;
+			}
+			fs_set_done(fs);
+			continue;
+		}
+
+		if (!num_running)
+			break;
+		if (verbose > 1)
+			printf(_("--waiting-- (%d running)\n"), num_running);
+
+		status |= wait_scheduled();
+	}
+
+	if (!cancel_requested)
+		status |= wait_many(FLAG_WAIT_ALL);
+	free(fss);
+	return status;
+}
+
 /* Check all file systems, using the /etc/fstab table. */
 static int check_all(void)
 {
@@ -1217,6 +1537,11 @@ static int check_all(void)
 		}
 	}
 
+	if (schedule_by_disk) {
+		status |= check_scheduled(itr);
+		not_done_yet = 0;
+	}
+
 	while (not_done_yet) {
 		not_done_yet = 0;
 		pass_done = 1;
@@ -1478,6 +1803,8 @@ static void parse_argv(int argc, char *argv[])
 	}
 	if (getenv("FSCK_FORCE_ALL_PARALLEL"))
 		force_all_parallel++;
+	if (getenv("FSCK_SCHEDULE_BY_DISK"))
+		schedule_by_disk++;
 	if ((tmp = getenv("FSCK_MAX_INST")))
 	    max_running = atoi(tmp);
 }
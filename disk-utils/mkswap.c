@@ -42,6 +42,10 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <getopt.h>
+#include <sys/time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #ifdef HAVE_LIBSELINUX
 #include <selinux/selinux.h>
 #include <selinux/context.h>
@@ -306,30 +310,201 @@ page_bad(int page)
 	badpages++;
 }
 
+/*
+ * The bad pages check reads the device by large extents (O_DIRECT if
+ * possible) with more requests in progress. Only the failed extents are
+ * read again page by page to find the bad pages.
+ */
+#define CHECK_EXTENT_SIZE	(1024 * 1024)
+#define CHECK_NREQUESTS		4
+
+struct check_control {
+	int			fd;
+	unsigned long long	extent;		/* pages per extent */
+	unsigned long long	next;		/* first page of the next extent */
+	unsigned long long	checked;	/* successfully read pages */
+
+	unsigned long long	*failed;	/* first pages of failed extents */
+	size_t			nfailed;
+
+	struct timeval		start;
+	struct timeval		last;		/* last progress line */
+	int			istty;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_t		lock;
+#endif
+};
+
+static inline void check_lock(struct check_control *ctl __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&ctl->lock);
+#endif
+}
+
+static inline void check_unlock(struct check_control *ctl __attribute__((__unused__)))
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&ctl->lock);
+#endif
+}
+
+static int
+read_pages(int fd, void *buf, unsigned long long page, unsigned long long n)
+{
+	size_t sz = n * pagesize;
+
+	return pread(fd, buf, sz, (off_t) page * pagesize) == (ssize_t) sz ? 0 : -1;
+}
+
+static void
+print_progress(struct check_control *ctl, int last)
+{
+	struct timeval now;
+	unsigned long long msec, bytes;
+	char *done, *bw;
+
+	/* the progress is for humans only */
+	if (!ctl->istty)
+		return;
+
+	gettimeofday(&now, NULL);
+	if (!last && now.tv_sec == ctl->last.tv_sec)
+		return;
+	ctl->last = now;
+
+	msec = (now.tv_sec - ctl->start.tv_sec) * 1000ULL
+		+ (now.tv_usec - ctl->start.tv_usec) / 1000;
+	bytes = ctl->checked * pagesize;
+
+	done = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
+				    bytes);
+	bw = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
+				    msec ? bytes / msec * 1000 : bytes);
+
+	printf(_("\rchecked %s (%3d%%), %s/s%s"), done,
+		(int) (ctl->checked * 100 / PAGES), bw,
+		last ? "\n" : "");
+	fflush(stdout);
+
+	free(done);
+	free(bw);
+}
+
+static void *
+check_thread(void *arg)
+{
+	struct check_control *ctl = (struct check_control *) arg;
+	void *buf;
+
+	if (posix_memalign(&buf, pagesize, ctl->extent * pagesize))
+		err(EXIT_FAILURE, _("cannot allocate check buffer"));
+
+	for (;;) {
+		unsigned long long page, n;
+		int rc;
+
+		check_lock(ctl);
+		page = ctl->next;
+		ctl->next += ctl->extent;
+		check_unlock(ctl);
+
+		if (page >= PAGES)
+			break;
+
+		n = min(ctl->extent, PAGES - page);
+		rc = read_pages(ctl->fd, buf, page, n);
+
+		check_lock(ctl);
+		if (rc) {
+			ctl->failed = xrealloc(ctl->failed,
+				(ctl->nfailed + 1) * sizeof(*ctl->failed));
+			ctl->failed[ctl->nfailed++] = page;
+		} else
+			ctl->checked += n;
+		print_progress(ctl, 0);
+		check_unlock(ctl);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static int
+cmp_pages(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a,
+			   y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
 static void
 check_blocks(void)
 {
-	unsigned int current_page;
-	int do_seek = 1;
+	struct check_control ctl;
+	unsigned long long page;
+	int secsize = 0;
+	size_t i;
 	char *buffer;
 
-	buffer = xmalloc(pagesize);
-	current_page = 0;
-	while (current_page < PAGES) {
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.extent = max(CHECK_EXTENT_SIZE / pagesize, 1U);
+	ctl.istty = isatty(STDOUT_FILENO);
+	gettimeofday(&ctl.start, NULL);
 
-		ssize_t rc;
+	/* O_DIRECT requires reads aligned to the sector size */
+	ctl.fd = -1;
+	if (blkdev_get_sector_size(DEV, &secsize) == 0 && secsize > 0
+	    && pagesize % secsize == 0)
+		ctl.fd = open(device_name, O_RDONLY | O_DIRECT);
+	if (ctl.fd < 0)
+		ctl.fd = DEV;
 
-		if (do_seek && lseek(DEV,current_page*pagesize,SEEK_SET) !=
-		    current_page*pagesize)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
+#ifdef HAVE_LIBPTHREAD
+	{
+		pthread_t threads[CHECK_NREQUESTS];
+		size_t n;
 
-		rc = read(DEV, buffer, pagesize);
-		do_seek = (rc < 0 || (size_t) rc != pagesize);
-		if (do_seek)
-			page_bad(current_page);
-		current_page++;
+		pthread_mutex_init(&ctl.lock, NULL);
+		for (n = 0; n < CHECK_NREQUESTS; n++) {
+			if (pthread_create(&threads[n], NULL, check_thread, &ctl))
+				break;
+		}
+		if (n == 0)
+			check_thread(&ctl);	/* no thread created, do it yourself */
+		while (n > 0)
+			pthread_join(threads[--n], NULL);
+		pthread_mutex_destroy(&ctl.lock);
 	}
+#else
+	check_thread(&ctl);
+#endif
+
+	/* find the bad pages in the failed extents */
+	qsort(ctl.failed, ctl.nfailed, sizeof(*ctl.failed), cmp_pages);
+
+	if (posix_memalign((void **) &buffer, pagesize, pagesize))
+		err(EXIT_FAILURE, _("cannot allocate check buffer"));
+
+	for (i = 0; i < ctl.nfailed; i++) {
+		unsigned long long end = min(ctl.failed[i] + ctl.extent, PAGES);
+
+		for (page = ctl.failed[i]; page < end; page++) {
+			if (read_pages(ctl.fd, buffer, page, 1))
+				page_bad(page);
+			else
+				ctl.checked++;
+			print_progress(&ctl, 0);
+		}
+	}
+	print_progress(&ctl, 1);
+
 	printf(P_("%lu bad page\n", "%lu bad pages\n", badpages), badpages);
+
+	if (ctl.fd != DEV)
+		close(ctl.fd);
+	free(ctl.failed);
 	free(buffer);
 }
 
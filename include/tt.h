@@ -27,9 +27,19 @@ enum {
 	TT_FL_TREE        = (1 << 6),	/* use tree "ascii art" */
 	TT_FL_RIGHT	  = (1 << 7),	/* align to the right */
 	TT_FL_STRICTWIDTH = (1 << 8),	/* don't reduce width if column is empty */
-	TT_FL_NOEXTREMES  = (1 << 9)    /* ignore extreme fields when count column width*/
+	TT_FL_NOEXTREMES  = (1 << 9),   /* ignore extreme fields when count column width*/
+
+	/*
+	 * Global flags
+	 */
+	TT_FL_STREAM      = (1 << 10)	/* print lines when added, see tt_add_line() */
 };
 
+/* default number of lines used to count column widths in stream mode */
+#define TT_STREAM_SAMPLE	64
+
+struct tt_arena;
+
 struct tt {
 	size_t	ncols;		/* number of columns */
 	size_t	termwidth;	/* terminal width */
@@ -37,9 +47,14 @@ struct tt {
 	int	flags;
 	int	first_run;
 
+	size_t	nlines;		/* number of lines in tb_lines */
+	size_t	stream_sample;	/* lines to count widths in stream mode */
+
 	struct list_head	tb_columns;
 	struct list_head	tb_lines;
 
+	struct tt_arena		*arena;	/* data for tt_line_set_data_dup() */
+
 	const struct tt_symbols	*symbols;
 };
 
@@ -56,14 +71,25 @@ struct tt_column {
 	int	flags;
 	int	is_extreme;
 
+	size_t	*width_hist;	/* number of cells with width N (N > 0) */
+	size_t	width_histsz;
+	size_t	width_sum;	/* sum of all cells widths */
+
 	struct list_head	cl_columns;
 };
 
+struct tt_cell {
+	char	*safe;		/* safe encoded data (or NULL if the same) */
+	size_t	width;		/* number of cells of the safe encoded data */
+};
+
 struct tt_line {
 	struct tt	*table;
 	char const	**data;
+	struct tt_cell	*cells;			/* cached widths (ln->data[] order) */
 	void		*userdata;
-	size_t		data_sz;		/* strlen of all data */
+	size_t		data_sz;		/* strlen of all safe encoded data */
+	size_t		depth;			/* number of parents */
 
 	struct list_head	ln_lines;	/* table lines */
 
@@ -77,6 +103,7 @@ extern struct tt *tt_new_table(int flags);
 extern void tt_free_table(struct tt *tb);
 extern void tt_remove_lines(struct tt *tb);
 extern int tt_print_table(struct tt *tb);
+extern int tt_set_stream_sample(struct tt *tb, size_t nlines);
 
 extern struct tt_column *tt_define_column(struct tt *tb, const char *name,
 						double whint, int flags);
@@ -86,6 +113,7 @@ extern struct tt_column *tt_get_column(struct tt *tb, size_t colnum);
 extern struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent);
 
 extern int tt_line_set_data(struct tt_line *ln, int colnum, const char *data);
+extern int tt_line_set_data_dup(struct tt_line *ln, int colnum, const char *data);
 extern int tt_line_set_userdata(struct tt_line *ln, void *data);
 
 extern void tt_fputs_quoted(const char *data, FILE *out);
@@ -11,10 +11,16 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 #include <sys/syscall.h>
+#ifdef HAVE_PTHREAD_ATFORK
+#include <pthread.h>
+#endif
 
+#include "c.h"
 #include "randutils.h"
 
 #ifdef HAVE_TLS
@@ -108,6 +114,238 @@ void random_get_bytes(void *buf, size_t nbytes)
 	return;
 }
 
+/*
+ * Reads @nbytes from the kernel random source (getrandom(2) or /dev/urandom).
+ *
+ * Returns 0 on success or -1 on error.
+ */
+static int random_get_entropy(void *buf, size_t nbytes)
+{
+	unsigned char *cp = (unsigned char *) buf;
+	size_t n = nbytes;
+	int fd, lose_counter = 0;
+
+#if defined(__linux__) && defined(SYS_getrandom)
+	while (n > 0) {
+		long x = syscall(SYS_getrandom, cp, n, 0);
+		if (x <= 0) {
+			if (x < 0 && errno == EINTR)
+				continue;
+			break;		/* ENOSYS, ... */
+		}
+		n -= x;
+		cp += x;
+	}
+	if (n == 0)
+		return 0;
+#endif
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	while (n > 0) {
+		ssize_t x = read(fd, cp, n);
+		if (x <= 0) {
+			if (lose_counter++ > 16)
+				break;
+			continue;
+		}
+		n -= x;
+		cp += x;
+		lose_counter = 0;
+	}
+	close(fd);
+	return n ? -1 : 0;
+}
+
+#ifdef HAVE_TLS
+/*
+ * Buffered ChaCha20 based generator for random_get_bytes_fast(). The generator
+ * is seeded from the kernel random source, it's reseeded after RANDOM_RESEED
+ * bytes and in the child after fork(). The state is per-thread, so no locking
+ * is necessary.
+ *
+ * Every buffer refill overwrites the key by the keystream, so the previous
+ * output cannot be reconstructed from the current state.
+ */
+#define CHACHA_KEYSZ	32
+#define CHACHA_IVSZ	8
+#define RANDOM_BUFSZ	(16 * 64)
+#define RANDOM_RESEED	(1600000)
+
+struct random_state {
+	uint32_t	input[16];
+	unsigned char	buf[RANDOM_BUFSZ];
+	size_t		have;		/* number of unused bytes at the end of buf */
+	size_t		count;		/* bytes to reseed */
+	unsigned int	gen;		/* fork generation when seeded */
+	int		ready;
+};
+
+THREAD_LOCAL struct random_state ul_rstate;
+
+#ifdef HAVE_PTHREAD_ATFORK
+static volatile unsigned int ul_fork_gen = 1;
+static volatile int ul_atfork_done;
+
+static void random_atfork_child(void)
+{
+	ul_fork_gen++;
+}
+
+static inline unsigned int random_fork_gen(void)
+{
+	if (!ul_atfork_done) {
+		ul_atfork_done = 1;
+		pthread_atfork(NULL, NULL, random_atfork_child);
+	}
+	return ul_fork_gen;
+}
+#else
+# define random_fork_gen()	((unsigned int) getpid())
+#endif
+
+#define ROTL32(v, n)	(((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(x, a, b, c, d) do { \
+	x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 16); \
+	x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 12); \
+	x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 8); \
+	x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 7); \
+} while (0)
+
+static inline uint32_t le32_get(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+	       ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void le32_put(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* ChaCha20 block function, writes 64 bytes of the keystream to @out */
+static void chacha_block(uint32_t *input, unsigned char *out)
+{
+	uint32_t x[16];
+	int i;
+
+	memcpy(x, input, sizeof(x));
+
+	for (i = 0; i < 10; i++) {
+		QUARTERROUND(x, 0, 4,  8, 12);
+		QUARTERROUND(x, 1, 5,  9, 13);
+		QUARTERROUND(x, 2, 6, 10, 14);
+		QUARTERROUND(x, 3, 7, 11, 15);
+		QUARTERROUND(x, 0, 5, 10, 15);
+		QUARTERROUND(x, 1, 6, 11, 12);
+		QUARTERROUND(x, 2, 7,  8, 13);
+		QUARTERROUND(x, 3, 4,  9, 14);
+	}
+	for (i = 0; i < 16; i++)
+		le32_put(out + i * 4, x[i] + input[i]);
+
+	/* 64-bit block counter */
+	if (++input[12] == 0)
+		input[13]++;
+}
+
+/* (re)initialize the state by @key (CHACHA_KEYSZ + CHACHA_IVSZ bytes) */
+static void chacha_keysetup(struct random_state *rs, const unsigned char *key)
+{
+	int i;
+
+	rs->input[0] = 0x61707865;	/* "expand 32-byte k" */
+	rs->input[1] = 0x3320646e;
+	rs->input[2] = 0x79622d32;
+	rs->input[3] = 0x6b206574;
+	for (i = 0; i < 8; i++)
+		rs->input[4 + i] = le32_get(key + i * 4);
+	rs->input[12] = 0;
+	rs->input[13] = 0;
+	rs->input[14] = le32_get(key + CHACHA_KEYSZ);
+	rs->input[15] = le32_get(key + CHACHA_KEYSZ + 4);
+}
+
+static void random_refill(struct random_state *rs)
+{
+	size_t i;
+
+	for (i = 0; i < RANDOM_BUFSZ; i += 64)
+		chacha_block(rs->input, rs->buf + i);
+
+	/* use the begin of the buffer as the next key */
+	chacha_keysetup(rs, rs->buf);
+	memset(rs->buf, 0, CHACHA_KEYSZ + CHACHA_IVSZ);
+	rs->have = RANDOM_BUFSZ - CHACHA_KEYSZ - CHACHA_IVSZ;
+}
+
+static int random_seed(struct random_state *rs)
+{
+	unsigned char key[CHACHA_KEYSZ + CHACHA_IVSZ];
+
+	if (random_get_entropy(key, sizeof(key)) != 0)
+		return -1;
+
+	chacha_keysetup(rs, key);
+	memset(key, 0, sizeof(key));
+	memset(rs->buf, 0, sizeof(rs->buf));
+
+	rs->have = 0;
+	rs->count = RANDOM_RESEED;
+	rs->gen = random_fork_gen();
+	rs->ready = 1;
+	return 0;
+}
+
+/*
+ * Generate a stream of random @nbytes into @buf by the buffered per-thread
+ * ChaCha20 generator. It falls back to random_get_bytes() if the kernel
+ * random source is not available.
+ */
+void random_get_bytes_fast(void *buf, size_t nbytes)
+{
+	struct random_state *rs = &ul_rstate;
+	unsigned char *cp = (unsigned char *) buf;
+
+	while (nbytes > 0) {
+		unsigned char *p;
+		size_t n;
+
+		if (!rs->ready || !rs->count || rs->gen != random_fork_gen()) {
+			if (random_seed(rs) != 0) {
+				rs->ready = 0;
+				random_get_bytes(cp, nbytes);
+				return;
+			}
+		}
+		if (!rs->have)
+			random_refill(rs);
+
+		n = nbytes < rs->have ? nbytes : rs->have;
+		if (n > rs->count)
+			n = rs->count;
+		p = rs->buf + RANDOM_BUFSZ - rs->have;
+
+		memcpy(cp, p, n);
+		memset(p, 0, n);	/* don't keep the output in memory */
+
+		cp += n;
+		nbytes -= n;
+		rs->have -= n;
+		rs->count -= n;
+	}
+}
+#else /* !HAVE_TLS */
+void random_get_bytes_fast(void *buf, size_t nbytes)
+{
+	if (random_get_entropy(buf, nbytes) != 0)
+		random_get_bytes(buf, nbytes);
+}
+#endif
+
 #ifdef TEST_PROGRAM
 int main(int argc __attribute__ ((__unused__)),
          char *argv[] __attribute__ ((__unused__)))
@@ -4,6 +4,7 @@
  * - allows to truncate or wrap data in columns
  * - prints tree if parent->child relation is defined
  * - draws the tree by ASCII or UTF8 lines (depends on terminal setting)
+ * - stream mode, prints lines when added (TT_FL_STREAM)
  *
  * Copyright (C) 2010 Karel Zak <kzak@redhat.com>
  *
@@ -49,26 +50,107 @@ static const struct tt_symbols utf8_tt_symbols = {
 };
 #endif /* !HAVE_WIDECHAR */
 
+/* max size of the tree symbols in bytes, the width is always 2 cells */
+#define TT_SYMBOL_MAXSZ	6
+
 #define is_last_column(_tb, _cl) \
 		list_entry_is_last(&(_cl)->cl_columns, &(_tb)->tb_columns)
 
+/* the tree needs all lines, stream mode is ignored */
+#define is_stream(_tb) \
+		(((_tb)->flags & (TT_FL_STREAM | TT_FL_TREE)) == TT_FL_STREAM)
+
+#define is_parsable(_tb) \
+		((_tb)->flags & (TT_FL_RAW | TT_FL_EXPORT))
+
+/*
+ * Line data allocator, the strings are never freed individually, all the
+ * arena is reset when the lines are removed from the table.
+ */
+#define TT_ARENA_CHUNKSZ	(16 * 1024)
+
+struct tt_arena {
+	struct tt_arena	*next;		/* older chunk */
+	size_t		size;
+	size_t		used;
+	char		data[];
+};
+
+static char *arena_strdup(struct tt *tb, const char *str)
+{
+	struct tt_arena *ar = tb->arena;
+	size_t sz = strlen(str) + 1;
+	char *p;
+
+	if (!ar || ar->size - ar->used < sz) {
+		size_t chunksz = max((size_t) TT_ARENA_CHUNKSZ, sz);
+
+		ar = malloc(sizeof(*ar) + chunksz);
+		if (!ar)
+			return NULL;
+		ar->size = chunksz;
+		ar->used = 0;
+		ar->next = tb->arena;
+		tb->arena = ar;
+	}
+
+	p = ar->data + ar->used;
+	memcpy(p, str, sz);
+	ar->used += sz;
+	return p;
+}
+
+/* keeps the newest chunk if @keep is non-zero */
+static void arena_reset(struct tt *tb, int keep)
+{
+	struct tt_arena *ar = tb->arena;
+
+	if (ar && keep) {
+		ar->used = 0;
+		ar = ar->next;
+		tb->arena->next = NULL;
+	} else
+		tb->arena = NULL;
+
+	while (ar) {
+		struct tt_arena *next = ar->next;
+		free(ar);
+		ar = next;
+	}
+}
+
 /*
  * Counts number of cells in multibyte string. For all control and
  * non-printable chars is the result width enlarged to store \x?? hex
- * sequence. See mbs_safe_encode().
+ * sequence. See mbs_safe_encode(). The @hex (if not NULL) is set to 1 if the
+ * string has to be encoded.
  */
-static size_t mbs_safe_width(const char *s)
+static size_t mbs_safe_width(const char *s, int *hex)
 {
 	mbstate_t st;
 	const char *p = s;
 	size_t width = 0;
 
+	if (hex)
+		*hex = 0;
+	if (!p)
+		return 0;
+
+	/* printable ASCII */
+	while ((unsigned char) *p >= 0x20 && (unsigned char) *p < 0x7f)
+		p++;
+	if (!*p)
+		return p - s;
+	width = p - s;
+
 	memset(&st, 0, sizeof(st));
 
 	while (p && *p) {
 		if (iscntrl((unsigned char) *p)) {
 			width += 4;			/* *p encoded to \x?? */
 			p++;
+			if (hex)
+				*hex = 1;
 		}
 #ifdef HAVE_WIDECHAR
 		else {
@@ -80,11 +162,18 @@ static size_t mbs_safe_width(const char *s)
 
 			if (len == (size_t) -1 || len == (size_t) -2) {
 				len = 1;
-				width += (isprint((unsigned char) *p) ? 1 : 4);
-
-			} if (!iswprint(wc))
+				if (isprint((unsigned char) *p))
+					width += 1;
+				else {
+					width += 4;
+					if (hex)
+						*hex = 1;
+				}
+			} else if (!iswprint(wc)) {
 				width += len * 4;	/* hex encode whole sequence */
-			else
+				if (hex)
+					*hex = 1;
+			} else
 				width += wcwidth(wc);	/* number of cells */
 			p += len;
 		}
@@ -92,6 +181,8 @@ static size_t mbs_safe_width(const char *s)
 		else if (!isprint((unsigned char) *p)) {
 			width += 4;			/* *p encoded to \x?? */
 			p++;
+			if (hex)
+				*hex = 1;
 		} else {
 			width++;
 			p++;
@@ -152,7 +243,7 @@ static char *mbs_safe_encode(const char *s, size_t *width)
 					r += 4;
 					*width += 4;
 				} else {
-					width++;
+					(*width)++;
 					*r++ = *p;
 				}
 			} else if (!iswprint(wc)) {
@@ -177,7 +268,7 @@ static char *mbs_safe_encode(const char *s, size_t *width)
 			*width += 4;
 		} else {
 			*r++ = *p++;
-			*width++;
+			(*width)++;
 		}
 #endif
 	}
@@ -187,6 +278,61 @@ static char *mbs_safe_encode(const char *s, size_t *width)
 	return res;
 }
 
+/*
+ * The column widths are tracked incrementally by tt_line_set_data() in the
+ * histogram of the cells widths, so the widths are not recounted from all the
+ * lines for each pass in recount_widths().
+ */
+static int column_add_width(struct tt_column *cl, size_t width)
+{
+	if (!width)
+		return 0;
+
+	if (width >= cl->width_histsz) {
+		size_t sz = cl->width_histsz ? cl->width_histsz : 64;
+		size_t *hist;
+
+		while (sz <= width)
+			sz *= 2;
+		hist = realloc(cl->width_hist, sz * sizeof(size_t));
+		if (!hist)
+			return -1;
+		memset(hist + cl->width_histsz, 0,
+		       (sz - cl->width_histsz) * sizeof(size_t));
+		cl->width_hist = hist;
+		cl->width_histsz = sz;
+	}
+
+	cl->width_hist[width]++;
+	cl->width_sum += width;
+	return 0;
+}
+
+static void column_del_width(struct tt_column *cl, size_t width)
+{
+	if (!width || width >= cl->width_histsz || !cl->width_hist[width])
+		return;
+
+	cl->width_hist[width]--;
+	cl->width_sum -= width;
+}
+
+/* returns the largest cell width not greater than @limit */
+static size_t column_max_width(struct tt_column *cl, size_t limit)
+{
+	size_t w;
+
+	if (!cl->width_histsz)
+		return 0;
+
+	w = min(limit, cl->width_histsz - 1);
+	for (; w > 0; w--) {
+		if (cl->width_hist[w])
+			return w;
+	}
+	return 0;
+}
+
 /*
  * @flags: TT_FL_* flags (usually TT_FL_{ASCII,RAW})
  *
@@ -201,6 +347,7 @@ struct tt *tt_new_table(int flags)
 		return NULL;
 
 	tb->flags = flags;
+	tb->stream_sample = TT_STREAM_SAMPLE;
 	INIT_LIST_HEAD(&tb->tb_lines);
 	INIT_LIST_HEAD(&tb->tb_columns);
 
@@ -217,6 +364,8 @@ struct tt *tt_new_table(int flags)
 
 void tt_remove_lines(struct tt *tb)
 {
+	struct list_head *p;
+
 	if (!tb)
 		return;
 
@@ -225,8 +374,19 @@ void tt_remove_lines(struct tt *tb)
 						struct tt_line, ln_lines);
 		list_del(&ln->ln_lines);
 		free(ln->data);
+		free(ln->cells);
 		free(ln);
 	}
+	list_for_each(p, &tb->tb_columns) {
+		struct tt_column *cl =
+				list_entry(p, struct tt_column, cl_columns);
+		if (cl->width_hist)
+			memset(cl->width_hist, 0,
+			       cl->width_histsz * sizeof(size_t));
+		cl->width_sum = 0;
+	}
+	tb->nlines = 0;
+	arena_reset(tb, 1);
 }
 
 void tt_free_table(struct tt *tb)
@@ -240,11 +400,31 @@ void tt_free_table(struct tt *tb)
 		struct tt_column *cl = list_entry(tb->tb_columns.next,
 						struct tt_column, cl_columns);
 		list_del(&cl->cl_columns);
+		free(cl->width_hist);
 		free(cl);
 	}
+	arena_reset(tb, 0);
 	free(tb);
 }
 
+/*
+ * @tb: table
+ * @nlines: number of lines
+ *
+ * Sets number of lines used to count columns widths in the stream mode
+ * (TT_FL_STREAM), the default is TT_STREAM_SAMPLE. The widths are counted from
+ * the column headers and hints only if @nlines is zero.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int tt_set_stream_sample(struct tt *tb, size_t nlines)
+{
+	if (!tb)
+		return -1;
+	tb->stream_sample = nlines;
+	return 0;
+}
+
 
 /*
  * @tb: table
@@ -303,6 +483,12 @@ struct tt_column *tt_define_column(struct tt *tb, const char *name,
  * @tb: table
  * @parent: parental line or NULL
  *
+ * In the stream mode (TT_FL_STREAM without tree) the previously added lines
+ * are printed and deallocated by this function, the caller is expected to set
+ * all line data before the next line is added. The column widths are counted
+ * from the first @tb->stream_sample lines, lines with wider data are not
+ * aligned. The @parent is ignored in this mode.
+ *
  * Returns: newly allocate line
  */
 struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent)
@@ -311,25 +497,39 @@ struct tt_line *tt_add_line(struct tt *tb, struct tt_line *parent)
 
 	if (!tb || !tb->ncols)
 		goto err;
+
+	if (is_stream(tb)) {
+		parent = NULL;
+		if (tb->nlines && (!tb->first_run || is_parsable(tb) ||
+				   tb->nlines >= tb->stream_sample))
+			tt_print_table(tb);
+	}
 	ln = calloc(1, sizeof(*ln));
 	if (!ln)
 		goto err;
 	ln->data = calloc(tb->ncols, sizeof(char *));
 	if (!ln->data)
 		goto err;
+	ln->cells = calloc(tb->ncols, sizeof(struct tt_cell));
+	if (!ln->cells)
+		goto err;
 
 	ln->table = tb;
 	ln->parent = parent;
+	ln->depth = parent ? parent->depth + 1 : 0;
 	INIT_LIST_HEAD(&ln->ln_lines);
 	INIT_LIST_HEAD(&ln->ln_children);
 	INIT_LIST_HEAD(&ln->ln_branch);
 
 	list_add_tail(&ln->ln_lines, &tb->tb_lines);
+	tb->nlines++;
 
 	if (parent)
 		list_add_tail(&ln->ln_children, &parent->ln_branch);
 	return ln;
 err:
+	if (ln)
+		free(ln->data);
 	free(ln);
 	return NULL;
 }
@@ -358,29 +558,80 @@ struct tt_column *tt_get_column(struct tt *tb, size_t colnum)
  * @colnum: number of column (0..N)
  * @data: printable data
  *
- * Stores data that will be printed to the table cell.
+ * Stores data that will be printed to the table cell. The cell width (and the
+ * safe encoded data if necessary) is counted here, so the @data should not be
+ * modified later.
  */
 int tt_line_set_data(struct tt_line *ln, int colnum, const char *data)
 {
 	struct tt_column *cl;
+	struct tt_cell *ce;
+	char *safe = NULL;
+	size_t width = 0;
 
 	if (!ln)
 		return -1;
 	cl = tt_get_column(ln->table, colnum);
 	if (!cl)
 		return -1;
+	ce = &ln->cells[cl->seqnum];
+
+	if (data) {
+		int hex;
+
+		width = mbs_safe_width(data, &hex);
+		if (hex) {
+			size_t len = 0;
+			char *enc = mbs_safe_encode(data, &len);
+
+			if (enc)
+				safe = arena_strdup(ln->table, enc);
+			free(enc);
+			if (!safe)
+				return -1;
+		}
+		if (cl->flags & TT_FL_TREE)
+			width += 2 * ln->depth;		/* ascii art */
+		if (column_add_width(cl, width))
+			return -1;
+	}
 
 	if (ln->data[cl->seqnum]) {
-		size_t sz = strlen(ln->data[cl->seqnum]);;
+		size_t sz = strlen(ce->safe ? ce->safe : ln->data[cl->seqnum]);
 		ln->data_sz = ln->data_sz > sz ? ln->data_sz - sz : 0;
+		column_del_width(cl, ce->width);
 	}
 
 	ln->data[cl->seqnum] = data;
+	ce->safe = safe;
+	ce->width = data ? width : 0;
 	if (data)
-		ln->data_sz += strlen(data);
+		ln->data_sz += strlen(safe ? safe : data);
 	return 0;
 }
 
+/*
+ * @ln: line
+ * @colnum: number of column (0..N)
+ * @data: printable data
+ *
+ * The same as tt_line_set_data(), but @data are copied to memory allocated
+ * by the table. The memory is deallocated together with the table lines.
+ */
+int tt_line_set_data_dup(struct tt_line *ln, int colnum, const char *data)
+{
+	char *p = NULL;
+
+	if (!ln)
+		return -1;
+	if (data) {
+		p = arena_strdup(ln->table, data);
+		if (!p)
+			return -1;
+	}
+	return tt_line_set_data(ln, colnum, p);
+}
+
 int tt_line_set_userdata(struct tt_line *ln, void *data)
 {
 	if (!ln)
@@ -415,26 +666,12 @@ static char *line_get_ascii_art(struct tt_line *ln, char *buf, size_t *bufsz)
 	return buf + len;
 }
 
-static char *line_get_data(struct tt_line *ln, struct tt_column *cl,
+static char *line_get_tree_data(struct tt_line *ln, const char *data,
 				char *buf, size_t bufsz)
 {
-	const char *data = ln->data[cl->seqnum];
 	const struct tt_symbols *sym;
 	char *p = buf;
 
-	memset(buf, 0, bufsz);
-
-	if (!data)
-		return NULL;
-	if (!(cl->flags & TT_FL_TREE)) {
-		strncpy(buf, data, bufsz);
-		buf[bufsz - 1] = '\0';
-		return buf;
-	}
-
-	/*
-	 * Tree stuff
-	 */
 	if (ln->parent) {
 		p = line_get_ascii_art(ln->parent, buf, &bufsz);
 		if (!p)
@@ -453,6 +690,44 @@ static char *line_get_data(struct tt_line *ln, struct tt_column *cl,
 	return buf;
 }
 
+/* returns data as stored by tt_line_set_data() */
+static char *line_get_data(struct tt_line *ln, struct tt_column *cl,
+				char *buf, size_t bufsz)
+{
+	const char *data = ln->data[cl->seqnum];
+
+	memset(buf, 0, bufsz);
+
+	if (!data)
+		return NULL;
+	if (!(cl->flags & TT_FL_TREE)) {
+		strncpy(buf, data, bufsz);
+		buf[bufsz - 1] = '\0';
+		return buf;
+	}
+	return line_get_tree_data(ln, data, buf, bufsz);
+}
+
+/* returns safe encoded data and number of cells */
+static const char *line_get_safe_data(struct tt_line *ln, struct tt_column *cl,
+				char *buf, size_t bufsz, size_t *width)
+{
+	struct tt_cell *ce = &ln->cells[cl->seqnum];
+	const char *data = ln->data[cl->seqnum];
+
+	*width = ce->width;
+
+	if (!data)
+		return NULL;
+	if (ce->safe)
+		data = ce->safe;
+	if (!(cl->flags & TT_FL_TREE))
+		return data;
+
+	*buf = '\0';
+	return line_get_tree_data(ln, data, buf, bufsz);
+}
+
 /*
  * This function counts column width.
  *
@@ -462,34 +737,28 @@ static char *line_get_data(struct tt_line *ln, struct tt_column *cl,
  * is marked as "extreme". In the second pass all extreme fields are ignored
  * and column width is counted from non-extreme fields only.
  */
-static void count_column_width(struct tt *tb, struct tt_column *cl,
-				 char *buf, size_t bufsz)
+static void count_column_width(struct tt *tb, struct tt_column *cl)
 {
-	struct list_head *lp;
-	int count = 0;
-	size_t sum = 0;
+	size_t count = 0, sum = 0, w, limit = (size_t) -1;
 
-	cl->width = 0;
+	if (cl->is_extreme)
+		limit = cl->width_avg * 2;
 
-	list_for_each(lp, &tb->tb_lines) {
-		struct tt_line *ln = list_entry(lp, struct tt_line, ln_lines);
-		char *data = line_get_data(ln, cl, buf, bufsz);
-		size_t len = data ? mbs_safe_width(data) : 0;
+	w = column_max_width(cl, (size_t) -1);
+	if (w > cl->width_max)
+		cl->width_max = w;
 
-		if (len == (size_t) -1)		/* ignore broken multibyte strings */
-			len = 0;
+	cl->width = column_max_width(cl, limit);
 
-		if (len > cl->width_max)
-			cl->width_max = len;
+	if (cl->flags & TT_FL_NOEXTREMES) {
+		count = tb->nlines;
+		sum = cl->width_sum;
 
-		if (cl->is_extreme && len > cl->width_avg * 2)
-			continue;
-		else if (cl->flags & TT_FL_NOEXTREMES) {
-			sum += len;
-			count++;
+		/* ignore extreme fields */
+		for (w = limit + 1; cl->is_extreme && w < cl->width_histsz; w++) {
+			count -= cl->width_hist[w];
+			sum -= w * cl->width_hist[w];
 		}
-		if (len > cl->width)
-			cl->width = len;
 	}
 
 	if (count && cl->width_avg == 0) {
@@ -501,7 +770,7 @@ static void count_column_width(struct tt *tb, struct tt_column *cl,
 
 	/* check and set minimal column width */
 	if (cl->name)
-		cl->width_min = mbs_safe_width(cl->name);
+		cl->width_min = mbs_safe_width(cl->name, NULL);
 
 	/* enlarge to minimal width */
 	if (cl->width < cl->width_min && !(cl->flags & TT_FL_STRICTWIDTH))
@@ -517,7 +786,7 @@ static void count_column_width(struct tt *tb, struct tt_column *cl,
 /*
  * This is core of the tt_* voodo...
  */
-static void recount_widths(struct tt *tb, char *buf, size_t bufsz)
+static void recount_widths(struct tt *tb)
 {
 	struct list_head *p;
 	size_t width = 0;	/* output width */
@@ -530,7 +799,7 @@ static void recount_widths(struct tt *tb, char *buf, size_t bufsz)
 		struct tt_column *cl =
 				list_entry(p, struct tt_column, cl_columns);
 
-		count_column_width(tb, cl, buf, bufsz);
+		count_column_width(tb, cl);
 		width += cl->width + (is_last_column(tb, cl) ? 0 : 1);
 		extremes += cl->is_extreme;
 	}
@@ -549,7 +818,7 @@ static void recount_widths(struct tt *tb, char *buf, size_t bufsz)
 				continue;
 
 			org_width = cl->width;
-			count_column_width(tb, cl, buf, bufsz);
+			count_column_width(tb, cl);
 
 			if (org_width > cl->width)
 				width -= org_width - cl->width;
@@ -700,41 +969,35 @@ void tt_fputs_nonblank(const char *data, FILE *out)
 }
 
 /*
- * Prints data, data maybe be printed in more formats (raw, NAME=xxx pairs) and
- * control and non-printable chars maybe encoded in \x?? hex encoding.
+ * Prints data in raw or NAME=value format.
  */
-static void print_data(struct tt *tb, struct tt_column *cl, char *data)
+static void print_raw_data(struct tt *tb, struct tt_column *cl, const char *data)
 {
-	size_t len = 0, i, width;
-	char *buf;
-
 	if (!data)
 		data = "";
 
-	/* raw mode */
-	if (tb->flags & TT_FL_RAW) {
+	if (tb->flags & TT_FL_RAW)
 		tt_fputs_nonblank(data, stdout);
-		if (!is_last_column(tb, cl))
-			fputc(' ', stdout);
-		return;
-	}
-
-	/* NAME=value mode */
-	if (tb->flags & TT_FL_EXPORT) {
+	else {
 		fprintf(stdout, "%s=", cl->name);
 		tt_fputs_quoted(data, stdout);
-		if (!is_last_column(tb, cl))
-			fputc(' ', stdout);
-		return;
 	}
+	if (!is_last_column(tb, cl))
+		fputc(' ', stdout);
+}
 
-	/* note that 'len' and 'width' are number of cells, not bytes */
-	buf = mbs_safe_encode(data, &len);
-	data = buf;
-	if (!data)
-		data = "";
+/*
+ * Prints safe encoded data, the @len is number of cells of the data (see
+ * mbs_safe_width()).
+ */
+static void print_data(struct tt *tb, struct tt_column *cl,
+		       const char *data, size_t len)
+{
+	size_t i, width;
+	char *buf = NULL;
 
-	if (!len || len == (size_t) -1) {
+	/* note that 'len' and 'width' are number of cells, not bytes */
+	if (!data || !*data || !len) {
 		len = 0;
 		data = NULL;
 	}
@@ -743,17 +1006,20 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 	if (is_last_column(tb, cl) && len < width)
 		width = len;
 
-	/* truncate data */
-	if (len > width && (cl->flags & TT_FL_TRUNC)) {
-		if (data)
-			len = mbs_truncate(data, &width);
+	/* truncate data, in stream mode only to fit the terminal */
+	if (len > width && (cl->flags & TT_FL_TRUNC) &&
+	    (!is_stream(tb) || tb->is_term)) {
+		buf = strdup(data);
+		if (buf)
+			len = mbs_truncate(buf, &width);
+		data = buf;
 		if (!data || len == (size_t) -1) {
 			len = 0;
 			data = NULL;
 		}
 	}
 	if (data) {
-		if (!(tb->flags & TT_FL_RAW) && (cl->flags & TT_FL_RIGHT)) {
+		if (cl->flags & TT_FL_RIGHT) {
 			size_t xw = cl->width;
 			fprintf(stdout, "%*s", (int) xw, data);
 			if (len < xw)
@@ -766,7 +1032,8 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 		fputc(' ', stdout);		/* padding */
 
 	if (!is_last_column(tb, cl)) {
-		if (len > width && !(cl->flags & TT_FL_TRUNC)) {
+		if (len > width && !(cl->flags & TT_FL_TRUNC) &&
+		    !is_stream(tb)) {
 			fputc('\n', stdout);
 			for (i = 0; i <= (size_t) cl->seqnum; i++) {
 				struct tt_column *x = tt_get_column(tb, i);
@@ -781,20 +1048,28 @@ static void print_data(struct tt *tb, struct tt_column *cl, char *data)
 
 static void print_line(struct tt_line *ln, char *buf, size_t bufsz)
 {
+	struct tt *tb = ln->table;
 	struct list_head *p;
 
 	/* set width according to the size of data
 	 */
-	list_for_each(p, &ln->table->tb_columns) {
+	list_for_each(p, &tb->tb_columns) {
 		struct tt_column *cl =
 				list_entry(p, struct tt_column, cl_columns);
 
-		print_data(ln->table, cl, line_get_data(ln, cl, buf, bufsz));
+		if (is_parsable(tb))
+			print_raw_data(tb, cl, line_get_data(ln, cl, buf, bufsz));
+		else {
+			size_t len;
+			const char *data = line_get_safe_data(ln, cl,
+						buf, bufsz, &len);
+			print_data(tb, cl, data, len);
+		}
 	}
 	fputc('\n', stdout);
 }
 
-static void print_header(struct tt *tb, char *buf, size_t bufsz)
+static void print_header(struct tt *tb)
 {
 	struct list_head *p;
 
@@ -810,9 +1085,15 @@ static void print_header(struct tt *tb, char *buf, size_t bufsz)
 		struct tt_column *cl =
 				list_entry(p, struct tt_column, cl_columns);
 
-		strncpy(buf, cl->name, bufsz);
-		buf[bufsz - 1] = '\0';
-		print_data(tb, cl, buf);
+		if (tb->flags & TT_FL_RAW)
+			print_raw_data(tb, cl, cl->name);
+		else {
+			size_t len = 0;
+			char *name = mbs_safe_encode(cl->name, &len);
+
+			print_data(tb, cl, name, len);
+			free(name);
+		}
 	}
 	fputc('\n', stdout);
 }
@@ -821,7 +1102,7 @@ static void print_table(struct tt *tb, char *buf, size_t bufsz)
 {
 	struct list_head *p;
 
-	print_header(tb, buf, bufsz);
+	print_header(tb);
 
 	list_for_each(p, &tb->tb_lines) {
 		struct tt_line *ln = list_entry(p, struct tt_line, ln_lines);
@@ -851,7 +1132,7 @@ static void print_tree(struct tt *tb, char *buf, size_t bufsz)
 {
 	struct list_head *p;
 
-	print_header(tb, buf, bufsz);
+	print_header(tb);
 
 	list_for_each(p, &tb->tb_lines) {
 		struct tt_line *ln = list_entry(p, struct tt_line, ln_lines);
@@ -866,7 +1147,8 @@ static void print_tree(struct tt *tb, char *buf, size_t bufsz)
 /*
  * @tb: table
  *
- * Prints the table to stdout
+ * Prints the table to stdout. In the stream mode only the lines not printed
+ * yet by tt_add_line() are printed, and all the lines are removed.
  */
 int tt_print_table(struct tt *tb)
 {
@@ -890,8 +1172,10 @@ int tt_print_table(struct tt *tb)
 
 	list_for_each(p, &tb->tb_lines) {
 		struct tt_line *ln = list_entry(p, struct tt_line, ln_lines);
-		if (ln->data_sz > line_sz)
-			line_sz = ln->data_sz;
+		size_t sz = ln->data_sz + ln->depth * TT_SYMBOL_MAXSZ;
+
+		if (sz > line_sz)
+			line_sz = sz;
 	}
 
 	line_sz++;			/* make a space for \0 */
@@ -901,7 +1185,7 @@ int tt_print_table(struct tt *tb)
 
 	if (tb->first_run &&
 	    !((tb->flags & TT_FL_RAW) || (tb->flags & TT_FL_EXPORT)))
-		recount_widths(tb, line, line_sz);
+		recount_widths(tb);
 
 	if (tb->flags & TT_FL_TREE)
 		print_tree(tb, line, line_sz);
@@ -911,14 +1195,75 @@ int tt_print_table(struct tt *tb)
 	free(line);
 
 	tb->first_run = FALSE;
+
+	if (is_stream(tb))
+		tt_remove_lines(tb);
 	return 0;
 }
 
 #ifdef TEST_PROGRAM
 #include <errno.h>
+#include <sys/time.h>
 
 enum { MYCOL_NAME, MYCOL_FOO, MYCOL_BAR, MYCOL_PATH };
 
+static double time_diff(struct timeval *a, struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1E6;
+}
+
+/*
+ * Builds and prints table with @nlines lines, the times are reported to
+ * stderr. Use "test_tt --bench 100000 > /dev/null".
+ */
+static int bench(size_t nlines, int flags)
+{
+	struct tt *tb;
+	struct tt_line *ln, *pr = NULL;
+	struct timeval start, built, printed;
+	char buf[64];
+	size_t i;
+
+	gettimeofday(&start, NULL);
+
+	tb = tt_new_table(flags);
+	if (!tb)
+		err(EXIT_FAILURE, "table initialization failed");
+
+	tt_define_column(tb, "NAME", 0.3, (flags & TT_FL_TREE) ? TT_FL_TREE : 0);
+	tt_define_column(tb, "SIZE", 6, TT_FL_RIGHT);
+	tt_define_column(tb, "LABEL", 0.1, TT_FL_TRUNC | TT_FL_NOEXTREMES);
+	tt_define_column(tb, "PATH", 0.3, 0);
+
+	for (i = 0; i < nlines; i++) {
+		ln = tt_add_line(tb, (flags & TT_FL_TREE) && i % 8 ? pr : NULL);
+		if (!ln)
+			err(EXIT_FAILURE, "failed to add line");
+		if (i % 8 == 0)
+			pr = ln;
+
+		snprintf(buf, sizeof(buf), "dev%zu", i);
+		tt_line_set_data_dup(ln, MYCOL_NAME, buf);
+		snprintf(buf, sizeof(buf), "%zuM", (i * 7919) % 100000);
+		tt_line_set_data_dup(ln, MYCOL_FOO, buf);
+		tt_line_set_data(ln, MYCOL_BAR, i % 100 ? "label" :
+				"very-long-label-of-the-device-to-test-extremes");
+		snprintf(buf, sizeof(buf), "/mnt/%zu/%zu", i % 1000, i);
+		tt_line_set_data_dup(ln, MYCOL_PATH, buf);
+	}
+
+	gettimeofday(&built, NULL);
+	tt_print_table(tb);
+	fflush(stdout);
+	gettimeofday(&printed, NULL);
+
+	tt_free_table(tb);
+
+	fprintf(stderr, "%zu lines: build %.3f s, print %.3f s\n", nlines,
+			time_diff(&start, &built), time_diff(&built, &printed));
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	struct tt *tb;
@@ -926,19 +1271,34 @@ int main(int argc, char *argv[])
 	int flags = 0, notree = 0, i;
 
 	if (argc == 2 && !strcmp(argv[1], "--help")) {
-		printf("%s [--ascii | --raw | --list]\n",
+		printf("%s [--ascii | --raw | --export | --list | --stream] [--stream]\n"
+		       "%s --bench <lines> [--tree | --stream]\n",
+				program_invocation_short_name,
 				program_invocation_short_name);
 		return EXIT_SUCCESS;
-	} else if (argc == 2 && !strcmp(argv[1], "--ascii")) {
+	} else if (argc >= 3 && !strcmp(argv[1], "--bench")) {
+		setlocale(LC_ALL, "");
+		if (argc == 4 && !strcmp(argv[3], "--tree"))
+			flags |= TT_FL_TREE;
+		else if (argc == 4 && !strcmp(argv[3], "--stream"))
+			flags |= TT_FL_STREAM;
+		return bench(strtoul(argv[2], NULL, 10), flags);
+	} else if (argc >= 2 && !strcmp(argv[1], "--ascii")) {
 		flags |= TT_FL_ASCII;
-	} else if (argc == 2 && !strcmp(argv[1], "--raw")) {
+	} else if (argc >= 2 && !strcmp(argv[1], "--raw")) {
 		flags |= TT_FL_RAW;
 		notree = 1;
-	} else if (argc == 2 && !strcmp(argv[1], "--export")) {
+	} else if (argc >= 2 && !strcmp(argv[1], "--export")) {
 		flags |= TT_FL_EXPORT;
 		notree = 1;
-	} else if (argc == 2 && !strcmp(argv[1], "--list"))
+	} else if (argc >= 2 && !strcmp(argv[1], "--list"))
+		notree = 1;
+	else if (argc >= 2 && !strcmp(argv[1], "--stream")) {
+		flags |= TT_FL_STREAM;
 		notree = 1;
+	}
+	if (argc == 3 && !strcmp(argv[2], "--stream"))
+		flags |= TT_FL_STREAM;
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -953,6 +1313,9 @@ int main(int argc, char *argv[])
 	tt_define_column(tb, "BAR", 0.3, 0);
 	tt_define_column(tb, "PATH", 0.3, 0);
 
+	/* count widths from the first 4 lines, print the rest when added */
+	tt_set_stream_sample(tb, 4);
+
 	for (i = 0; i < 2; i++) {
 		root = ln = tt_add_line(tb, NULL);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA");
@@ -988,7 +1351,7 @@ int main(int argc, char *argv[])
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.A.CCC");
 		tt_line_set_data(ln, MYCOL_FOO, "a.a.c-foo-foo");
 		tt_line_set_data(ln, MYCOL_BAR, "barBar-A.A.CCC");
-		tt_line_set_data(ln, MYCOL_PATH, "/mnt/AAA/A/CCC");
+		tt_line_set_data_dup(ln, MYCOL_PATH, "/mnt/AAA/A/CCC");
 
 		ln = tt_add_line(tb, root);
 		tt_line_set_data(ln, MYCOL_NAME, "AAA.C");
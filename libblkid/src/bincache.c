@@ -0,0 +1,598 @@
+/*
+ * bincache.c - binary blkid cache with tags index
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/*
+ * The binary cache is an optional companion of the text cache file (see
+ * BINARY_CACHE= in blkid.conf). It's stored to <cachefile>.bin and it
+ * contains the same information as the text file, but the file is possible
+ * to mmap() and use without parsing. The TYPE, LABEL, UUID and PARTUUID tags
+ * are indexed by hash table, so the tag lookup does not have to read all
+ * devices from the cache.
+ *
+ * The binary file is used only if it has been written together with the
+ * current text cache file (inode, mtime and size of the text file are stored
+ * in the header), otherwise the library silently falls back to the text file.
+ *
+ * File format (host byte order):
+ *
+ *	struct bincache_hdr
+ *	struct bincache_dev	devs[ndevs]
+ *	struct bincache_tag	tags[ntags]
+ *	uint32_t		buckets[nbuckets]
+ *	char			strings[]	(NUL terminated strings)
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "blkidP.h"
+#include "all-io.h"
+
+#define BINCACHE_MAGIC		"BLKIDBIN"
+#define BINCACHE_VERSION	1
+#define BINCACHE_SUFFIX		".bin"
+#define BINCACHE_NONE		((uint32_t) -1)
+
+struct bincache_hdr {
+	char		magic[8];	/* BINCACHE_MAGIC */
+	uint32_t	version;	/* BINCACHE_VERSION */
+	uint32_t	size;		/* size of the whole file */
+
+	uint64_t	txt_ino;	/* text cache file inode */
+	int64_t		txt_mtime;	/* text cache file mtime */
+	uint64_t	txt_size;	/* text cache file size */
+
+	uint32_t	ndevs;
+	uint32_t	ntags;
+	uint32_t	nbuckets;
+	uint32_t	strsz;		/* size of the strings area */
+
+	uint32_t	devs_off;
+	uint32_t	tags_off;
+	uint32_t	buckets_off;
+	uint32_t	strs_off;
+};
+
+struct bincache_dev {
+	uint64_t	devno;
+	int64_t		time;
+	int64_t		utime;
+	int32_t		pri;
+	uint32_t	name;		/* offset in strings */
+	uint32_t	tags;		/* index of the first tag */
+	uint32_t	ntags;		/* number of tags */
+};
+
+struct bincache_tag {
+	uint32_t	name;		/* offset in strings */
+	uint32_t	value;		/* offset in strings */
+	uint32_t	dev;		/* index of the device */
+	uint32_t	next;		/* next tag in the hash bucket */
+};
+
+/* indexed tags */
+static const char *bincache_idxtags[] = { "TYPE", "LABEL", "UUID", "PARTUUID" };
+
+static int is_indexed_tag(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(bincache_idxtags); i++)
+		if (strcmp(name, bincache_idxtags[i]) == 0)
+			return 1;
+	return 0;
+}
+
+static char *bincache_filename(const char *filename)
+{
+	char *bin = malloc(strlen(filename) + sizeof(BINCACHE_SUFFIX));
+
+	if (bin)
+		sprintf(bin, "%s" BINCACHE_SUFFIX, filename);
+	return bin;
+}
+
+static inline const struct bincache_hdr *bincache_get_hdr(blkid_cache cache)
+{
+	return (const struct bincache_hdr *) cache->bic_map;
+}
+
+static inline const char *bincache_get_str(blkid_cache cache, uint32_t off)
+{
+	const struct bincache_hdr *hdr = bincache_get_hdr(cache);
+
+	if (off >= hdr->strsz)
+		return NULL;
+	return (const char *) cache->bic_map + hdr->strs_off + off;
+}
+
+static int bincache_check(const struct bincache_hdr *hdr, size_t size,
+			  const struct stat *txt)
+{
+	const char *end = (const char *) hdr + size - 1;
+	uint64_t x;
+
+	if (size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, BINCACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != BINCACHE_VERSION ||
+	    hdr->size != size)
+		return -1;
+
+	/* written together with the current text cache file? */
+	if (hdr->txt_ino != (uint64_t) txt->st_ino ||
+	    hdr->txt_mtime != (int64_t) txt->st_mtime ||
+	    hdr->txt_size != (uint64_t) txt->st_size)
+		return -1;
+
+	x = (uint64_t) hdr->devs_off + (uint64_t) hdr->ndevs * sizeof(struct bincache_dev);
+	if (hdr->devs_off < sizeof(*hdr) || x > hdr->tags_off)
+		return -1;
+	x = (uint64_t) hdr->tags_off + (uint64_t) hdr->ntags * sizeof(struct bincache_tag);
+	if (x > hdr->buckets_off)
+		return -1;
+	x = (uint64_t) hdr->buckets_off + (uint64_t) hdr->nbuckets * sizeof(uint32_t);
+	if (x > hdr->strs_off || !hdr->nbuckets)
+		return -1;
+	x = (uint64_t) hdr->strs_off + hdr->strsz;
+	if (x != size || !hdr->strsz || *end != '\0')
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Maps binary cache file for the text cache file described by @txt. Returns 0
+ * on success, 1 if there is no usable binary cache.
+ */
+int blkid_bincache_open(blkid_cache cache, const struct stat *txt)
+{
+	char *filename;
+	struct stat st;
+	char *map;
+	int fd;
+
+	if (cache->bic_map)
+		blkid_bincache_close(cache);
+
+	filename = bincache_filename(cache->bic_filename);
+	if (!filename)
+		return 1;
+
+	fd = open(filename, O_RDONLY|O_CLOEXEC);
+	free(filename);
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_size < (off_t) sizeof(struct bincache_hdr)) {
+		close(fd);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+
+	if (bincache_check((struct bincache_hdr *) map, st.st_size, txt)) {
+		DBG(DEBUG_READ, printf("binary cache for %s is obsolete\n",
+					cache->bic_filename));
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	DBG(DEBUG_READ, printf("binary cache for %s mapped\n",
+				cache->bic_filename));
+	cache->bic_map = map;
+	cache->bic_mapsz = st.st_size;
+	return 0;
+}
+
+void blkid_bincache_close(blkid_cache cache)
+{
+	if (cache->bic_map)
+		munmap(cache->bic_map, cache->bic_mapsz);
+	cache->bic_map = NULL;
+	cache->bic_mapsz = 0;
+	cache->bic_flags &= ~BLKID_BIC_FL_BINARY;
+}
+
+/*
+ * Adds device @idx from the binary cache to @cache. The devices already
+ * stored in the cache are not modified if @check is true.
+ */
+static blkid_dev bincache_add_dev(blkid_cache cache, uint32_t idx, int check)
+{
+	const struct bincache_hdr *hdr = bincache_get_hdr(cache);
+	const struct bincache_dev *bd;
+	const struct bincache_tag *tags;
+	const char *name;
+	blkid_dev dev;
+	uint32_t i;
+
+	if (idx >= hdr->ndevs)
+		return NULL;
+
+	bd = (const struct bincache_dev *) (cache->bic_map + hdr->devs_off) + idx;
+	tags = (const struct bincache_tag *) (cache->bic_map + hdr->tags_off);
+
+	name = bincache_get_str(cache, bd->name);
+	if (!name || *name != '/')
+		return NULL;
+
+	if (check) {
+		struct list_head *p;
+
+		list_for_each(p, &cache->bic_devs) {
+			dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+			if (strcmp(dev->bid_name, name) == 0)
+				return dev;
+		}
+	}
+
+	dev = blkid_new_dev();
+	if (!dev)
+		return NULL;
+	dev->bid_name = strdup(name);
+	if (!dev->bid_name) {
+		blkid_free_dev(dev);
+		return NULL;
+	}
+	dev->bid_cache = cache;
+	dev->bid_devno = bd->devno;
+	dev->bid_time = bd->time;
+	dev->bid_utime = bd->utime;
+	dev->bid_pri = bd->pri;
+	list_add_tail(&dev->bid_devs, &cache->bic_devs);
+
+	for (i = 0; i < bd->ntags; i++) {
+		const struct bincache_tag *t;
+		const char *tname, *tval;
+
+		if (bd->tags + i >= hdr->ntags)
+			break;
+		t = &tags[bd->tags + i];
+		tname = bincache_get_str(cache, t->name);
+		tval = bincache_get_str(cache, t->value);
+		if (tname && tval)
+			blkid_set_tag(dev, tname, tval, strlen(tval));
+	}
+
+	if (!dev->bid_type) {
+		blkid_free_dev(dev);
+		return NULL;
+	}
+	return dev;
+}
+
+/*
+ * Adds all devices from the mapped binary cache to @cache and unmaps the
+ * binary cache.
+ */
+void blkid_bincache_load(blkid_cache cache)
+{
+	const struct bincache_hdr *hdr;
+	uint32_t i;
+	int check;
+
+	if (!cache->bic_map)
+		return;
+
+	hdr = bincache_get_hdr(cache);
+	check = !list_empty(&cache->bic_devs);
+
+	DBG(DEBUG_READ, printf("loading %u devices from binary cache\n",
+				hdr->ndevs));
+
+	for (i = 0; i < hdr->ndevs; i++)
+		bincache_add_dev(cache, i, check);
+
+	blkid_bincache_close(cache);
+	cache->bic_flags &= ~BLKID_BIC_FL_CHANGED;
+}
+
+/*
+ * Returns device with the highest priority and with @type=@value tag from
+ * the mapped binary cache. The device is added to @cache. Returns NULL if
+ * the tag is not indexed or not found.
+ */
+blkid_dev blkid_bincache_find_dev(blkid_cache cache,
+				  const char *type, const char *value)
+{
+	const struct bincache_hdr *hdr;
+	const struct bincache_tag *tags;
+	const struct bincache_dev *devs;
+	const uint32_t *buckets;
+	uint32_t idx, found = BINCACHE_NONE, n = 0;
+	int pri = -1;
+
+	if (!cache->bic_map || !is_indexed_tag(type))
+		return NULL;
+
+	hdr = bincache_get_hdr(cache);
+	devs = (const struct bincache_dev *) (cache->bic_map + hdr->devs_off);
+	tags = (const struct bincache_tag *) (cache->bic_map + hdr->tags_off);
+	buckets = (const uint32_t *) (cache->bic_map + hdr->buckets_off);
+
+	idx = buckets[blkid_tag_hash(type, value) % hdr->nbuckets];
+
+	/* n protects against loops in a corrupted file */
+	for ( ; idx < hdr->ntags && n < hdr->ntags; idx = tags[idx].next, n++) {
+		const struct bincache_tag *t = &tags[idx];
+		const char *tname, *tval, *devname;
+
+		tname = bincache_get_str(cache, t->name);
+		tval = bincache_get_str(cache, t->value);
+		if (!tname || !tval || t->dev >= hdr->ndevs ||
+		    strcmp(tname, type) || strcmp(tval, value))
+			continue;
+
+		devname = bincache_get_str(cache, devs[t->dev].name);
+		if (devs[t->dev].pri > pri && devname &&
+		    !access(devname, F_OK)) {
+			found = t->dev;
+			pri = devs[t->dev].pri;
+		}
+	}
+
+	DBG(DEBUG_READ, printf("binary cache index: %s=%s %s\n",
+			type, value, found != BINCACHE_NONE ? "found" : "not found"));
+
+	if (found == BINCACHE_NONE)
+		return NULL;
+
+	return bincache_add_dev(cache, found, 1);
+}
+
+/*
+ * In-memory binary cache image
+ */
+struct bincache_buf {
+	char		*data;
+	size_t		size;
+	size_t		alloc;
+};
+
+static int buf_append(struct bincache_buf *b, const void *data, size_t sz)
+{
+	if (b->size + sz > b->alloc) {
+		size_t alloc = b->alloc ? b->alloc : 4096;
+		char *x;
+
+		while (alloc < b->size + sz)
+			alloc *= 2;
+		x = realloc(b->data, alloc);
+		if (!x)
+			return -BLKID_ERR_MEM;
+		b->data = x;
+		b->alloc = alloc;
+	}
+	memcpy(b->data + b->size, data, sz);
+	b->size += sz;
+	return 0;
+}
+
+static uint32_t buf_append_str(struct bincache_buf *b, const char *str)
+{
+	uint32_t off = b->size;
+
+	if (buf_append(b, str, strlen(str) + 1))
+		return BINCACHE_NONE;
+	return off;
+}
+
+/* the same devices as written to the text cache file */
+static inline int is_saved_dev(blkid_dev dev)
+{
+	return dev->bid_name[0] == '/' && dev->bid_type &&
+	       !(dev->bid_flags & BLKID_BID_FL_REMOVABLE);
+}
+
+static int bincache_build(blkid_cache cache, const struct stat *txt,
+			  struct bincache_buf *img)
+{
+	struct bincache_buf devs = { 0 }, tags = { 0 }, strs = { 0 };
+	struct bincache_hdr hdr;
+	uint32_t *buckets = NULL, nindexed = 0, i;
+	struct list_head *p, *t;
+	int rc = -BLKID_ERR_MEM;
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (!is_saved_dev(dev))
+			continue;
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag, bit_tags);
+			if (is_indexed_tag(tag->bit_name))
+				nindexed++;
+		}
+	}
+
+	hdr.nbuckets = nindexed ? nindexed * 2 : 1;
+	buckets = malloc(hdr.nbuckets * sizeof(uint32_t));
+	if (!buckets)
+		goto done;
+	for (i = 0; i < hdr.nbuckets; i++)
+		buckets[i] = BINCACHE_NONE;
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		struct bincache_dev bd;
+
+		if (!is_saved_dev(dev))
+			continue;
+
+		memset(&bd, 0, sizeof(bd));
+		bd.devno = dev->bid_devno;
+		bd.time = dev->bid_time;
+		bd.utime = dev->bid_utime;
+		bd.pri = dev->bid_pri;
+		bd.tags = hdr.ntags;
+		bd.name = buf_append_str(&strs, dev->bid_name);
+		if (bd.name == BINCACHE_NONE)
+			goto done;
+
+		list_for_each(t, &dev->bid_tags) {
+			blkid_tag tag = list_entry(t, struct blkid_struct_tag, bit_tags);
+			struct bincache_tag bt;
+
+			bt.dev = hdr.ndevs;
+			bt.next = BINCACHE_NONE;
+			bt.name = buf_append_str(&strs, tag->bit_name);
+			bt.value = buf_append_str(&strs, tag->bit_val);
+			if (bt.name == BINCACHE_NONE || bt.value == BINCACHE_NONE)
+				goto done;
+
+			if (is_indexed_tag(tag->bit_name)) {
+				uint32_t *b = &buckets[blkid_tag_hash(tag->bit_name,
+						tag->bit_val) % hdr.nbuckets];
+				bt.next = *b;
+				*b = hdr.ntags;
+			}
+			if (buf_append(&tags, &bt, sizeof(bt)))
+				goto done;
+			hdr.ntags++;
+			bd.ntags++;
+		}
+
+		if (buf_append(&devs, &bd, sizeof(bd)))
+			goto done;
+		hdr.ndevs++;
+	}
+
+	if (!strs.size && buf_append_str(&strs, "") == BINCACHE_NONE)
+		goto done;
+
+	memcpy(hdr.magic, BINCACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINCACHE_VERSION;
+	hdr.txt_ino = txt->st_ino;
+	hdr.txt_mtime = txt->st_mtime;
+	hdr.txt_size = txt->st_size;
+	hdr.strsz = strs.size;
+	hdr.devs_off = sizeof(hdr);
+	hdr.tags_off = hdr.devs_off + devs.size;
+	hdr.buckets_off = hdr.tags_off + tags.size;
+	hdr.strs_off = hdr.buckets_off + hdr.nbuckets * sizeof(uint32_t);
+	hdr.size = hdr.strs_off + strs.size;
+
+	if (buf_append(img, &hdr, sizeof(hdr)) ||
+	    buf_append(img, devs.data, devs.size) ||
+	    buf_append(img, tags.data, tags.size) ||
+	    buf_append(img, buckets, hdr.nbuckets * sizeof(uint32_t)) ||
+	    buf_append(img, strs.data, strs.size))
+		goto done;
+	rc = 0;
+done:
+	free(devs.data);
+	free(tags.data);
+	free(strs.data);
+	free(buckets);
+	return rc;
+}
+
+/*
+ * Writes binary cache for the text cache file @filename. The file is
+ * written to a temporary file and atomically renamed.
+ */
+int blkid_bincache_save(blkid_cache cache, const char *filename)
+{
+	struct bincache_buf img = { 0 };
+	char *binname = NULL, *tmp = NULL;
+	struct stat txt;
+	int fd = -1, rc;
+
+	if (stat(filename, &txt) || !S_ISREG(txt.st_mode))
+		return 0;
+
+	rc = bincache_build(cache, &txt, &img);
+	if (rc)
+		goto done;
+
+	rc = -BLKID_ERR_MEM;
+	binname = bincache_filename(filename);
+	if (!binname)
+		goto done;
+	tmp = malloc(strlen(binname) + 8);
+	if (!tmp)
+		goto done;
+	sprintf(tmp, "%s-XXXXXX", binname);
+
+	rc = -BLKID_ERR_IO;
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto done;
+	if (fchmod(fd, 0644) != 0 ||
+	    write_all(fd, img.data, img.size) != 0) {
+		close(fd);
+		unlink(tmp);
+		goto done;
+	}
+	close(fd);
+
+	if (rename(tmp, binname)) {
+		DBG(DEBUG_SAVE, printf("can't rename %s to %s\n", tmp, binname));
+		unlink(tmp);
+		goto done;
+	}
+
+	DBG(DEBUG_SAVE, printf("binary cache %s written\n", binname));
+	rc = 0;
+done:
+	free(img.data);
+	free(binname);
+	free(tmp);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+int main(int argc, char **argv)
+{
+	blkid_cache cache = NULL;
+	blkid_dev dev;
+	char *type = NULL, *value = NULL;
+
+	blkid_init_debug(DEBUG_ALL);
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <cachefile> <NAME=value>\n"
+			"Find device by binary cache index\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (blkid_parse_tag_string(argv[2], &type, &value)) {
+		fprintf(stderr, "%s: cannot parse '%s'\n", argv[0], argv[2]);
+		return EXIT_FAILURE;
+	}
+	if (blkid_get_cache(&cache, argv[1]) < 0) {
+		fprintf(stderr, "%s: cannot read cache %s\n", argv[0], argv[1]);
+		return EXIT_FAILURE;
+	}
+	if (!(cache->bic_flags & BLKID_BIC_FL_BINARY)) {
+		fprintf(stderr, "%s: no binary cache for %s\n", argv[0], argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	dev = blkid_bincache_find_dev(cache, type, value);
+	printf("%s=%s: %s\n", type, value, dev ? dev->bid_name : "<none>");
+
+	free(type);
+	free(value);
+	blkid_put_cache(cache);
+	return dev ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
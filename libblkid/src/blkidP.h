@@ -73,6 +73,8 @@ struct blkid_struct_tag
 	char			*bit_name;	/* NAME of tag (shared) */
 	char			*bit_val;	/* value of tag */
 	blkid_dev		bit_dev;	/* pointer to device */
+	struct blkid_struct_tag	*bit_idxnext;	/* next tag in the cache index bucket */
+	unsigned int		bit_seqno;	/* creation order within the cache */
 };
 typedef struct blkid_struct_tag *blkid_tag;
 
@@ -184,6 +186,13 @@ struct blkid_bufinfo {
 	struct list_head	bufs;	/* list of buffers */
 };
 
+/*
+ * Magic string areas closer than BLKID_PREFETCH_GAP are read by one read()
+ * call, see blkid_probe_prefetch_idmags().
+ */
+#define BLKID_PREFETCH_GAP	(64 * 1024)
+#define BLKID_PREFETCH_MAX	(256 * 1024)	/* max size of the merged buffer */
+
 /*
  * Low-level probing control struct
  */
@@ -215,6 +224,8 @@ struct blkid_struct_probe
 
 	struct blkid_struct_probe *parent;	/* for clones */
 	struct blkid_struct_probe *disk_probe;	/* whole-disk probing */
+
+	struct blkid_negcache	*negcache;	/* used areas, see negcache.c */
 };
 
 /* private flags library flags */
@@ -225,6 +236,7 @@ struct blkid_struct_probe
 /* private per-probing flags */
 #define BLKID_PROBE_FL_IGNORE_PT (1 << 1)	/* ignore partition table */
 #define BLKID_PROBE_FL_IGNORE_BACKUP (1 << 2)	/* ignore backup superblocks or PT */
+#define BLKID_PROBE_FL_NEGCACHE	(1 << 3)	/* record areas for negative cache */
 
 extern int blkid_probe_ignore_backup(blkid_probe pr);
 
@@ -249,6 +261,8 @@ struct blkid_config {
 	int nevals;			/* number of elems in eval array */
 	int uevent;			/* SEND_UEVENT=<yes|not> option */
 	char *cachefile;		/* CACHE_FILE=<path> option */
+	int bincache;			/* BINARY_CACHE=<yes|not> option */
+	int negcache;			/* NEGATIVE_CACHE=<yes|not> option */
 };
 
 extern struct blkid_config *blkid_read_config(const char *filename)
@@ -269,6 +283,13 @@ extern void blkid_free_config(struct blkid_config *conf);
  */
 #define BLKID_PROBE_INTERVAL	200
 
+/*
+ * Minimum number of seconds between full scans of all devices triggered by
+ * failed tag lookups, see blkid_find_dev_with_tag(). The time of the last
+ * full scan is kept in memory only, it's shared by all caches in the process.
+ */
+#define BLKID_RESCAN_MIN	30
+
 /* This describes an entire blkid cache file and probed devices.
  * We can traverse all of the found devices via bic_list.
  * We can traverse all of the tag types by bic_tags, which hold empty tags
@@ -284,10 +305,36 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+
+	char			*bic_map;	/* mapped binary cache or NULL */
+	size_t			bic_mapsz;	/* size of the mapping */
+
+	struct blkid_tagidx	*bic_tagidx;	/* NAME=value index, see tag.c */
+	unsigned int		bic_tagseq;	/* last bit_seqno */
+
+	unsigned int		bic_nthreads;	/* number of probing threads */
+	struct blkid_devprobe	*bic_devprobes;	/* devices probed in advance */
+	size_t			bic_ndevprobes;	/* number of bic_devprobes */
+};
+
+/*
+ * Result of the device probing done in advance by probing threads, the result
+ * is used by blkid_verify() rather than probe the device again. See
+ * probe_all() in devname.c.
+ */
+struct blkid_devprobe {
+	char			*name;		/* device name */
+	dev_t			devno;		/* device major/minor number */
+	int			rc;		/* blkid_do_safeprobe() return code */
+	time_t			time;		/* probing time */
+	suseconds_t		utime;		/* probing time (microseconds) */
+	struct blkid_prval	*vals;		/* probing result */
+	int			nvals;		/* number of vals */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
 #define BLKID_BIC_FL_CHANGED	0x0004	/* Cache has changed from disk */
+#define BLKID_BIC_FL_BINARY	0x0008	/* Binary cache mapped, devices not read yet */
 
 /* config file */
 #define BLKID_CONFIG_FILE	"/etc/blkid.conf"
@@ -339,7 +386,6 @@ struct blkid_struct_cache
 
 #ifdef CONFIG_BLKID_DEBUG
 extern int blkid_debug_mask;
-extern void blkid_init_debug(int mask);
 extern void blkid_debug_dump_dev(blkid_dev dev);
 extern void blkid_debug_dump_tag(blkid_tag tag);
 
@@ -347,7 +393,6 @@ extern void blkid_debug_dump_tag(blkid_tag tag);
 
 #else /* !CONFIG_BLKID_DEBUG */
 #define DBG(m,x)
-#define blkid_init_debug(x)
 #endif /* CONFIG_BLKID_DEBUG */
 
 /* devno.c */
@@ -366,6 +411,41 @@ extern blkid_loff_t blkid_llseek(int fd, blkid_loff_t offset, int whence);
 /* read.c */
 extern void blkid_read_cache(blkid_cache cache)
 			__attribute__((nonnull));
+extern void blkid_read_cache_deferred(blkid_cache cache)
+			__attribute__((nonnull));
+
+/* bincache.c */
+extern int blkid_bincache_open(blkid_cache cache, const struct stat *txt)
+			__attribute__((nonnull));
+extern void blkid_bincache_close(blkid_cache cache)
+			__attribute__((nonnull));
+extern void blkid_bincache_load(blkid_cache cache)
+			__attribute__((nonnull));
+extern blkid_dev blkid_bincache_find_dev(blkid_cache cache,
+			const char *type, const char *value)
+			__attribute__((nonnull));
+extern int blkid_bincache_save(blkid_cache cache, const char *filename)
+			__attribute__((nonnull));
+
+/* negcache.c */
+extern int blkid_negcache_lookup(blkid_probe pr, int safe)
+			__attribute__((nonnull));
+extern void blkid_negcache_record(blkid_probe pr, blkid_loff_t off,
+			blkid_loff_t len, int failed)
+			__attribute__((nonnull));
+extern void blkid_negcache_end(blkid_probe pr, int safe, int store)
+			__attribute__((nonnull));
+extern void blkid_negcache_invalidate(blkid_probe pr)
+			__attribute__((nonnull));
+extern void blkid_negcache_free(blkid_probe pr)
+			__attribute__((nonnull));
+
+/* reads devices from the mapped binary cache (if not read yet) */
+static inline void blkid_load_cache(blkid_cache cache)
+{
+	if (cache->bic_flags & BLKID_BIC_FL_BINARY)
+		blkid_bincache_load(cache);
+}
 
 /* save.c */
 extern int blkid_flush_cache(blkid_cache cache)
@@ -389,6 +469,10 @@ extern blkid_tag blkid_find_tag_dev(blkid_dev dev, const char *type)
 extern int blkid_set_tag(blkid_dev dev, const char *name,
 			 const char *value, const int vlength)
 			__attribute__((nonnull(1,2)));
+extern uint32_t blkid_tag_hash(const char *name, const char *value)
+			__attribute__((nonnull));
+extern void blkid_free_tagidx(blkid_cache cache)
+			__attribute__((nonnull));
 
 /*
  * Functions to create and find a specific tag type: dev.c
@@ -397,6 +481,15 @@ extern blkid_dev blkid_new_dev(void)
 			__attribute__((warn_unused_result));
 extern void blkid_free_dev(blkid_dev dev);
 
+/* devname.c */
+extern int blkid_full_scan_is_recent(void);
+
+/* verify.c */
+extern void blkid_probe_devprobe(blkid_probe pr, struct blkid_devprobe *dp)
+			__attribute__((nonnull));
+extern void blkid_sort_devprobes(blkid_cache cache);
+extern void blkid_free_devprobes(blkid_cache cache);
+
 /* probe.c */
 extern int blkid_probe_is_tiny(blkid_probe pr)
 			__attribute__((nonnull))
@@ -410,6 +503,9 @@ extern unsigned char *blkid_probe_get_buffer(blkid_probe pr,
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
 
+extern int blkid_probe_prefetch_idmags(blkid_probe pr, struct blkid_chain *chn)
+			__attribute__((nonnull));
+
 extern unsigned char *blkid_probe_get_sector(blkid_probe pr, unsigned int sector)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
@@ -71,9 +71,20 @@ static blkid_debug_dump_cache(int mask, blkid_cache cache)
 }
 #endif
 
-#ifdef CONFIG_BLKID_DEBUG
+/**
+ * blkid_init_debug:
+ * @mask: debug mask (0xffff to enable full debugging)
+ *
+ * If the @mask is not specified then this function reads
+ * LIBBLKID_DEBUG environment variable to get the mask.
+ *
+ * Already initialized debugging stuff cannot be changed. It does not
+ * have effect to call this function twice. Multithreaded applications
+ * should call this function before they start the threads.
+ */
 void blkid_init_debug(int mask)
 {
+#ifdef CONFIG_BLKID_DEBUG
 	if (blkid_debug_mask & DEBUG_INIT)
 		return;
 
@@ -92,8 +103,8 @@ void blkid_init_debug(int mask)
 		printf("libblkid: debug mask set to 0x%04x.\n", blkid_debug_mask);
 
 	blkid_debug_mask |= DEBUG_INIT;
-}
 #endif
+}
 
 static const char *get_default_cache_filename(void)
 {
@@ -162,7 +173,7 @@ int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 	else
 		cache->bic_filename = blkid_get_cache_filename(NULL);
 
-	blkid_read_cache(cache);
+	blkid_read_cache_deferred(cache);
 	*ret_cache = cache;
 	return 0;
 }
@@ -184,6 +195,8 @@ void blkid_put_cache(blkid_cache cache)
 
 	/* DBG(DEBUG_CACHE, blkid_debug_dump_cache(cache)); */
 
+	blkid_free_tagidx(cache);
+
 	while (!list_empty(&cache->bic_devs)) {
 		blkid_dev dev = list_entry(cache->bic_devs.next,
 					   struct blkid_struct_dev,
@@ -209,6 +222,7 @@ void blkid_put_cache(blkid_cache cache)
 	}
 
 	blkid_free_probe(cache->probe);
+	blkid_bincache_close(cache);
 
 	free(cache->bic_filename);
 	free(cache);
@@ -228,6 +242,8 @@ void blkid_gc_cache(blkid_cache cache)
 	if (!cache)
 		return;
 
+	blkid_load_cache(cache);
+
 	list_for_each_safe(p, pnext, &cache->bic_devs) {
 		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
 		if (stat(dev->bid_name, &st) < 0) {
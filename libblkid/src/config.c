@@ -93,6 +93,18 @@ static int parse_next(FILE *fd, struct blkid_config *conf)
 			conf->uevent = TRUE;
 		else if (*s)
 			conf->uevent = FALSE;
+	} else if (!strncmp(s, "BINARY_CACHE=", 13)) {
+		s += 13;
+		if (*s && !strcasecmp(s, "yes"))
+			conf->bincache = TRUE;
+		else if (*s)
+			conf->bincache = FALSE;
+	} else if (!strncmp(s, "NEGATIVE_CACHE=", 15)) {
+		s += 15;
+		if (*s && !strcasecmp(s, "yes"))
+			conf->negcache = TRUE;
+		else if (*s)
+			conf->negcache = FALSE;
 	} else if (!strncmp(s, "CACHE_FILE=", 11)) {
 		s += 11;
 		if (*s)
@@ -194,6 +206,8 @@ int main(int argc, char *argv[])
 
 	printf("SEND UEVENT: %s\n", conf->uevent ? "TRUE" : "FALSE");
 	printf("CACHE_FILE:  %s\n", conf->cachefile);
+	printf("BINARY_CACHE: %s\n", conf->bincache ? "TRUE" : "FALSE");
+	printf("NEGATIVE_CACHE: %s\n", conf->negcache ? "TRUE" : "FALSE");
 
 	blkid_free_config(conf);
 	return EXIT_SUCCESS;
@@ -33,6 +33,9 @@
 #include <errno.h>
 #endif
 #include <time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "blkidP.h"
 
@@ -55,6 +58,8 @@ blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 	if (!cache || !devname)
 		return NULL;
 
+	blkid_load_cache(cache);
+
 	list_for_each(p, &cache->bic_devs) {
 		tmp = list_entry(p, struct blkid_struct_dev, bid_devs);
 		if (strcmp(tmp->bid_name, devname))
@@ -414,11 +419,43 @@ ubi_probe_all(blkid_cache cache, int only_if_new)
 }
 
 /*
- * Read the device data for all available block devices in the system.
+ * Operations with devices from /proc/partitions, see read_partitions().
  */
-static int probe_all(blkid_cache cache, int only_if_new)
+enum {
+	PT_OP_PROBE,		/* probe device */
+	PT_OP_FREE		/* remove whole-disk device from the cache */
+};
+
+struct pt_op {
+	int	op;
+	dev_t	devno;
+	char	ptname[128 + 1];
+};
+
+static int add_pt_op(struct pt_op **ops, size_t *nops, int op,
+		     const char *ptname, dev_t devno)
+{
+	struct pt_op *x;
+
+	if ((*nops % 64) == 0) {
+		x = realloc(*ops, (*nops + 64) * sizeof(struct pt_op));
+		if (!x)
+			return -1;
+		*ops = x;
+	}
+	x = &(*ops)[(*nops)++];
+	x->op = op;
+	x->devno = devno;
+	strcpy(x->ptname, ptname);
+	return 0;
+}
+
+/*
+ * Reads /proc/partitions and returns array of the operations in the same
+ * order as they have to be applied to the cache.
+ */
+static int read_partitions(FILE *proc, struct pt_op **ops, size_t *nops)
 {
-	FILE *proc;
 	char line[1024];
 	char ptname0[128 + 1], ptname1[128 + 1], *ptname = 0;
 	char *ptnames[2];
@@ -427,30 +464,12 @@ static int probe_all(blkid_cache cache, int only_if_new)
 	unsigned long long sz;
 	int lens[2] = { 0, 0 };
 	int which = 0, last = 0;
-	struct list_head *p, *pnext;
+	int rc = 0;
 
 	ptnames[0] = ptname0;
 	ptnames[1] = ptname1;
 
-	if (!cache)
-		return -BLKID_ERR_PARAM;
-
-	if (cache->bic_flags & BLKID_BIC_FL_PROBED &&
-	    time(0) - cache->bic_time < BLKID_PROBE_INTERVAL)
-		return 0;
-
-	blkid_read_cache(cache);
-	evms_probe_all(cache, only_if_new);
-#ifdef VG_DIR
-	lvm_probe_all(cache, only_if_new);
-#endif
-	ubi_probe_all(cache, only_if_new);
-
-	proc = fopen(PROC_PARTITIONS, "r");
-	if (!proc)
-		return -BLKID_ERR_PROC;
-
-	while (fgets(line, sizeof(line), proc)) {
+	while (rc == 0 && fgets(line, sizeof(line), proc)) {
 		last = which;
 		which ^= 1;
 		ptname = ptnames[which];
@@ -483,8 +502,8 @@ static int probe_all(blkid_cache cache, int only_if_new)
 				   ptname, (unsigned int) devs[which]));
 
 			if (sz > 1)
-				probe_one(cache, ptname, devs[which], 0,
-					  only_if_new, 0);
+				rc = add_pt_op(ops, nops, PT_OP_PROBE,
+					       ptname, devs[which]);
 			lens[which] = 0;	/* mark as checked */
 		}
 
@@ -494,21 +513,9 @@ static int probe_all(blkid_cache cache, int only_if_new)
 		 * it exists.
 		 */
 		if (lens[last] && !strncmp(ptnames[last], ptname, lens[last])) {
-			list_for_each_safe(p, pnext, &cache->bic_devs) {
-				blkid_dev tmp;
-
-				/* find blkid dev for the whole-disk devno */
-				tmp = list_entry(p, struct blkid_struct_dev,
-						 bid_devs);
-				if (tmp->bid_devno == devs[last]) {
-					DBG(DEBUG_DEVNAME,
-						printf("freeing %s\n",
-						       tmp->bid_name));
-					blkid_free_dev(tmp);
-					cache->bic_flags |= BLKID_BIC_FL_CHANGED;
-					break;
-				}
-			}
+			if (rc == 0)
+				rc = add_pt_op(ops, nops, PT_OP_FREE,
+					       ptnames[last], devs[last]);
 			lens[last] = 0;
 		}
 		/*
@@ -520,17 +527,246 @@ static int probe_all(blkid_cache cache, int only_if_new)
 			DBG(DEBUG_DEVNAME,
 			    printf("whole dev %s, devno 0x%04X\n",
 				   ptnames[last], (unsigned int) devs[last]));
-			probe_one(cache, ptnames[last], devs[last], 0,
-				  only_if_new, 0);
+			if (rc == 0)
+				rc = add_pt_op(ops, nops, PT_OP_PROBE,
+					       ptnames[last], devs[last]);
 			lens[last] = 0;
 		}
 	}
 
 	/* Handle the last device if it wasn't partitioned */
-	if (lens[which])
-		probe_one(cache, ptname, devs[which], 0, only_if_new, 0);
+	if (rc == 0 && lens[which])
+		rc = add_pt_op(ops, nops, PT_OP_PROBE, ptname, devs[which]);
+
+	return rc;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Returns device name for the @devno, this is the same as probe_one() does,
+ * but without cache.
+ */
+static char *ptname_to_devname(const char *ptname, dev_t devno)
+{
+	const char **dir;
+	char *devname = NULL;
+
+	if (!strncmp(ptname, "dm-", 3) && isdigit(ptname[3])) {
+		devname = canonicalize_dm_name(ptname);
+		if (devname)
+			return devname;
+	}
+
+	for (dir = dirlist; *dir; dir++) {
+		struct stat st;
+		char device[256];
+
+		snprintf(device, sizeof(device), "%s/%s", *dir, ptname);
+		if (stat(device, &st) == 0 && S_ISBLK(st.st_mode) &&
+		    st.st_rdev == devno)
+			return strdup(device);
+	}
+
+	blkid__scan_dir("/dev/mapper", devno, 0, &devname);
+	if (!devname)
+		devname = blkid_devno_to_devname(devno);
+	return devname;
+}
+
+struct probe_thread_data {
+	pthread_mutex_t		lock;
+	struct pt_op		*ops;		/* devices to probe */
+	struct blkid_devprobe	*res;		/* results (ops[i] -> res[i]) */
+	size_t			nops;
+	size_t			next;		/* next unprobed device */
+};
+
+static void *probe_thread(void *arg)
+{
+	struct probe_thread_data *td = (struct probe_thread_data *) arg;
+	blkid_probe pr;
+
+	pr = blkid_new_probe();
+	if (!pr)
+		return NULL;
+
+	for (;;) {
+		struct blkid_devprobe *dp;
+		size_t i;
+
+		pthread_mutex_lock(&td->lock);
+		i = td->next++;
+		pthread_mutex_unlock(&td->lock);
+
+		if (i >= td->nops)
+			break;
+
+		dp = &td->res[i];
+		dp->name = ptname_to_devname(td->ops[i].ptname, td->ops[i].devno);
+		if (dp->name)
+			blkid_probe_devprobe(pr, dp);
+	}
+
+	blkid_free_probe(pr);
+	return NULL;
+}
+
+/*
+ * Probes all devices from @ops by cache->bic_nthreads threads. The results
+ * are stored in the cache and used later by blkid_verify() when the devices
+ * are added to the cache in the original order.
+ */
+static void probe_in_advance(blkid_cache cache, struct pt_op *ops,
+			     size_t nops, int only_if_new)
+{
+	struct probe_thread_data td;
+	pthread_t *threads;
+	size_t i, n, nthreads;
+
+	memset(&td, 0, sizeof(td));
+
+	td.ops = calloc(nops, sizeof(struct pt_op));
+	td.res = calloc(nops, sizeof(struct blkid_devprobe));
+	if (!td.ops || !td.res)
+		goto done;
+
+	/* select devices which will be probed by probe_one() */
+	for (i = 0; i < nops; i++) {
+		struct list_head *p;
+		int skip = 0;
+
+		if (ops[i].op != PT_OP_PROBE)
+			continue;
+
+		list_for_each(p, &cache->bic_devs) {
+			blkid_dev tmp = list_entry(p, struct blkid_struct_dev,
+						   bid_devs);
+			if (tmp->bid_devno != ops[i].devno)
+				continue;
+			if ((only_if_new && !access(tmp->bid_name, F_OK)) ||
+			    ((tmp->bid_flags & BLKID_BID_FL_VERIFIED) &&
+			     time(0) - tmp->bid_time < BLKID_PROBE_INTERVAL)) {
+				skip = 1;
+				break;
+			}
+		}
+		if (skip)
+			continue;
+
+		td.res[td.nops].devno = ops[i].devno;
+		td.res[td.nops].rc = -1;
+		td.ops[td.nops++] = ops[i];
+	}
+
+	if (td.nops < 2)
+		goto done;
+
+	nthreads = cache->bic_nthreads;
+	if (nthreads > td.nops)
+		nthreads = td.nops;
+
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (!threads)
+		goto done;
+
+	DBG(DEBUG_DEVNAME, printf("probing %zu devices by %zu threads\n",
+				td.nops, nthreads));
+
+	pthread_mutex_init(&td.lock, NULL);
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, probe_thread, &td))
+			break;
+	}
+	if (n == 0)
+		probe_thread(&td);	/* no thread created, do it yourself */
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&td.lock);
+	free(threads);
+
+	cache->bic_devprobes = td.res;
+	cache->bic_ndevprobes = td.nops;
+	td.res = NULL;
+	blkid_sort_devprobes(cache);
+done:
+	if (td.res) {
+		for (i = 0; i < td.nops; i++) {
+			free(td.res[i].name);
+			free(td.res[i].vals);
+		}
+		free(td.res);
+	}
+	free(td.ops);
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/*
+ * Read the device data for all available block devices in the system.
+ */
+static int probe_all(blkid_cache cache, int only_if_new)
+{
+	FILE *proc;
+	struct pt_op *ops = NULL;
+	size_t i, nops = 0;
+	struct list_head *p, *pnext;
+	int rc;
+
+	if (!cache)
+		return -BLKID_ERR_PARAM;
 
+	if (cache->bic_flags & BLKID_BIC_FL_PROBED &&
+	    time(0) - cache->bic_time < BLKID_PROBE_INTERVAL)
+		return 0;
+
+	blkid_read_cache(cache);
+	evms_probe_all(cache, only_if_new);
+#ifdef VG_DIR
+	lvm_probe_all(cache, only_if_new);
+#endif
+	ubi_probe_all(cache, only_if_new);
+
+	proc = fopen(PROC_PARTITIONS, "r");
+	if (!proc)
+		return -BLKID_ERR_PROC;
+
+	rc = read_partitions(proc, &ops, &nops);
 	fclose(proc);
+	if (rc) {
+		free(ops);
+		return -BLKID_ERR_MEM;
+	}
+
+#ifdef HAVE_LIBPTHREAD
+	if (cache->bic_nthreads > 1)
+		probe_in_advance(cache, ops, nops, only_if_new);
+#endif
+
+	for (i = 0; i < nops; i++) {
+		if (ops[i].op == PT_OP_PROBE) {
+			probe_one(cache, ops[i].ptname, ops[i].devno, 0,
+				  only_if_new, 0);
+			continue;
+		}
+
+		list_for_each_safe(p, pnext, &cache->bic_devs) {
+			blkid_dev tmp;
+
+			/* find blkid dev for the whole-disk devno */
+			tmp = list_entry(p, struct blkid_struct_dev,
+					 bid_devs);
+			if (tmp->bid_devno == ops[i].devno) {
+				DBG(DEBUG_DEVNAME,
+					printf("freeing %s\n",
+					       tmp->bid_name));
+				blkid_free_dev(tmp);
+				cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+				break;
+			}
+		}
+	}
+
+	blkid_free_devprobes(cache);
+	free(ops);
 	blkid_flush_cache(cache);
 	return 0;
 }
@@ -581,6 +817,21 @@ static int probe_all_removable(blkid_cache cache)
 }
 
 
+/* time of the last blkid_probe_all() in this process */
+static time_t full_scan_time;
+
+/*
+ * Returns 1 if all devices were scanned by this process less than
+ * BLKID_RESCAN_MIN seconds ago, see blkid_find_dev_with_tag().
+ */
+int blkid_full_scan_is_recent(void)
+{
+	time_t now = time(0);
+
+	return full_scan_time && now >= full_scan_time &&
+	       now - full_scan_time < BLKID_RESCAN_MIN;
+}
+
 /**
  * blkid_probe_all:
  * @cache: cache handler
@@ -598,6 +849,7 @@ int blkid_probe_all(blkid_cache cache)
 	if (ret == 0) {
 		cache->bic_time = time(0);
 		cache->bic_flags |= BLKID_BIC_FL_PROBED;
+		full_scan_time = cache->bic_time;
 	}
 	DBG(DEBUG_PROBE, printf("End blkid_probe_all() [rc=%d]\n", ret));
 	return ret;
@@ -621,6 +873,28 @@ int blkid_probe_all_new(blkid_cache cache)
 	return ret;
 }
 
+/**
+ * blkid_cache_set_probe_threads:
+ * @cache: cache handler
+ * @nthreads: number of threads
+ *
+ * Sets number of threads used by blkid_probe_all() and blkid_probe_all_new()
+ * to probe devices. The devices are probed in parallel, but they are added to
+ * the @cache in the same order as by the default single-threaded probing. The
+ * default is 1 (no extra threads). The library has to be compiled with
+ * pthreads support, otherwise @nthreads is ignored.
+ *
+ * Returns: 0 on success, or number less than zero in case of error.
+ */
+int blkid_cache_set_probe_threads(blkid_cache cache, unsigned int nthreads)
+{
+	if (!cache)
+		return -BLKID_ERR_PARAM;
+
+	cache->bic_nthreads = nthreads;
+	return 0;
+}
+
 /**
  * blkid_probe_all_removable:
  * @cache: cache handler
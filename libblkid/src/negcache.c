@@ -0,0 +1,566 @@
+/*
+ * negcache.c - cache of negative probing results
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/*
+ * The negative cache is optional (see NEGATIVE_CACHE= in blkid.conf) and it
+ * remembers devices where blkid_do_safeprobe() or blkid_do_fullprobe() found
+ * nothing. The typical use-case is udev "change" event storm on systems with
+ * many empty (or unrecognized) devices.
+ *
+ * All areas requested by probing functions by blkid_probe_get_buffer() are
+ * recorded during the probing. If nothing has been detected, then the list of
+ * the areas and a fingerprint of the data in the areas is stored to the cache
+ * file. The next probing of the same device with the same setup reads only the
+ * recorded areas (merged to a few large read() calls) and if the fingerprint
+ * matches then the probing functions are not called at all. The probing
+ * functions make decisions only according to the data in the areas, so the
+ * same data means the same result.
+ *
+ * The fingerprint is a 64-bit non-cryptographic hash, not a copy of the data.
+ * A change on the device (mkfs, partitioning, BLKRRPART, ...) which is
+ * relevant for libblkid is detected unless the new data have the same hash,
+ * which is very unlikely but not impossible. The entry is also explicitly
+ * invalidated by blkid_do_wipe().
+ *
+ * The devices where the result depends on another device (partitions, see
+ * blkid_probe_get_wholedisk_probe()) and regular files are not cached.
+ *
+ * The cache file is a simple direct-mapped table of fixed size entries, the
+ * entry is selected by hash of the device number, offset and size. The file
+ * is read and written by pread() and pwrite() without locks, the entries are
+ * protected by checksum. Only root (the owner of the file) updates the file.
+ *
+ * File format (host byte order):
+ *
+ *	struct negcache_hdr
+ *	struct negcache_ent	ents[nents]
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "blkidP.h"
+#include "crc32.h"
+#include "all-io.h"
+
+#define NEGCACHE_FILE		BLKID_RUNTIME_DIR "/blkid.negcache"
+#define NEGCACHE_MAGIC		"BLKIDNEG"
+#define NEGCACHE_VERSION	1
+#define NEGCACHE_NENTS		4096
+#define NEGCACHE_MAXAREAS	125	/* sizeof(struct negcache_ent) is 2KiB */
+#define NEGCACHE_READ_GAP	4096	/* merge areas closer than this to one read() */
+
+struct negcache_hdr {
+	char		magic[8];	/* NEGCACHE_MAGIC */
+	uint32_t	version;	/* NEGCACHE_VERSION */
+	uint32_t	nents;		/* number of entries */
+	uint32_t	entsz;		/* sizeof(struct negcache_ent) */
+	uint32_t	reserved[3];
+};
+
+struct negcache_area {
+	uint64_t	off;		/* relative to the probing area */
+	uint64_t	len;
+};
+
+struct negcache_ent {
+	uint32_t	csum;		/* crc32 of the rest of the entry */
+	uint32_t	nareas;		/* number of used areas[], 0 = unused */
+	uint64_t	devno;
+	int64_t		off;		/* probing area (see blkid_probe_set_device()) */
+	int64_t		size;
+	uint64_t	setup;		/* hash of the probing setup */
+	uint64_t	fp;		/* fingerprint of the data in areas[] */
+
+	struct negcache_area areas[NEGCACHE_MAXAREAS];
+};
+
+/* areas used by the current probing, allocated on demand */
+struct blkid_negcache {
+	int		failed;		/* don't store the result */
+	size_t		nareas;
+	struct negcache_area areas[NEGCACHE_MAXAREAS + 1];	/* sorted, not overlapping */
+};
+
+static int negcache_enabled = -1;
+
+/* the defaults are modified by the test program only */
+static const char *negcache_file = NEGCACHE_FILE;
+static uid_t negcache_uid;		/* the only user who writes the file */
+static int negcache_regfiles;		/* cache also regular files */
+static unsigned int negcache_nhits;	/* number of skipped probings */
+
+static int is_enabled(void)
+{
+	if (negcache_enabled < 0) {
+		struct blkid_config *conf = blkid_read_config(NULL);
+
+		negcache_enabled = conf && conf->negcache ? 1 : 0;
+		blkid_free_config(conf);
+	}
+	return negcache_enabled;
+}
+
+/* word-wise FNV-like hash, it's not necessary to be cryptographic */
+static uint64_t hash_mem(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	for ( ; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+		uint64_t w;
+
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * 0x100000001b3ULL;
+		h ^= h >> 29;
+		p += sizeof(w);
+	}
+	while (len--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+	return h;
+}
+
+#define HASH_INIT	0xcbf29ce484222325ULL
+
+static inline uint64_t hash_num(uint64_t h, uint64_t num)
+{
+	return hash_mem(h, &num, sizeof(num));
+}
+
+/*
+ * Returns hash of everything (except the device data) what affects probing
+ * result.
+ */
+static uint64_t probe_setup_hash(blkid_probe pr, int safe)
+{
+	uint64_t h = hash_num(HASH_INIT, safe);
+	size_t i;
+
+	h = hash_num(h, pr->flags & (BLKID_FL_TINY_DEV | BLKID_FL_CDROM_DEV));
+	h = hash_num(h, blkid_probe_get_sectorsize(pr));
+
+	for (i = 0; i < BLKID_NCHAINS; i++) {
+		struct blkid_chain *chn = &pr->chains[i];
+
+		h = hash_num(h, chn->enabled);
+		if (!chn->enabled)
+			continue;
+		h = hash_num(h, chn->flags);
+		if (chn->fltr)
+			h = hash_mem(h, chn->fltr, blkid_bmp_nbytes(chn->driver->nidinfos));
+	}
+	return h;
+}
+
+static uint32_t ent_checksum(const struct negcache_ent *ent)
+{
+	return crc32(~0U, (const unsigned char *) ent + sizeof(ent->csum),
+			sizeof(*ent) - sizeof(ent->csum));
+}
+
+static off_t ent_offset(blkid_probe pr)
+{
+	uint64_t h = hash_num(HASH_INIT, pr->devno);
+
+	h = hash_num(h, pr->off);
+	h = hash_num(h, pr->size);
+
+	return sizeof(struct negcache_hdr) +
+		(off_t) (h % NEGCACHE_NENTS) * sizeof(struct negcache_ent);
+}
+
+static int create_file(void)
+{
+	struct negcache_hdr hdr;
+	struct stat st;
+	int fd;
+
+	if (negcache_file == NEGCACHE_FILE
+	    && stat(BLKID_RUNTIME_DIR, &st)
+	    && errno == ENOENT
+	    && mkdir(BLKID_RUNTIME_DIR, S_IWUSR|
+				S_IRUSR|S_IRGRP|S_IROTH|
+				S_IXUSR|S_IXGRP|S_IXOTH) != 0
+	    && errno != EEXIST)
+		return -1;
+
+	fd = open(negcache_file, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+	if (fd < 0)
+		return errno == EEXIST ?
+			open(negcache_file, O_RDWR|O_CLOEXEC) : -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NEGCACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = NEGCACHE_VERSION;
+	hdr.nents = NEGCACHE_NENTS;
+	hdr.entsz = sizeof(struct negcache_ent);
+
+	/* the file is sparse, the unused entries are zeroized */
+	if (write_all(fd, &hdr, sizeof(hdr)) ||
+	    ftruncate(fd, sizeof(hdr) +
+			  (off_t) NEGCACHE_NENTS * sizeof(struct negcache_ent))) {
+		close(fd);
+		unlink(negcache_file);
+		return -1;
+	}
+
+	DBG(DEBUG_LOWPROBE, printf("negcache: created %s\n", negcache_file));
+	return fd;
+}
+
+/*
+ * Opens the cache file, the file is created if @rdwr is non-zero.
+ */
+static int open_file(int rdwr)
+{
+	struct negcache_hdr hdr;
+	struct stat st;
+	int fd;
+
+	if (rdwr && geteuid() != negcache_uid)
+		return -1;
+
+	fd = open(negcache_file, (rdwr ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (fd < 0 && rdwr && errno == ENOENT)
+		fd = create_file();
+	if (fd < 0)
+		return -1;
+
+	/* don't trust files written by someone else */
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    (st.st_uid != 0 && st.st_uid != geteuid()) ||
+	    (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+	    pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    memcmp(hdr.magic, NEGCACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != NEGCACHE_VERSION ||
+	    hdr.nents != NEGCACHE_NENTS ||
+	    hdr.entsz != sizeof(struct negcache_ent)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Returns 0 if the entry for @pr has been read from the file.
+ */
+static int read_ent(blkid_probe pr, struct negcache_ent *ent)
+{
+	int fd = open_file(0);
+	ssize_t ret;
+
+	if (fd < 0)
+		return -1;
+
+	ret = pread(fd, ent, sizeof(*ent), ent_offset(pr));
+	close(fd);
+
+	if (ret != sizeof(*ent) || ent->nareas == 0 ||
+	    ent->nareas > NEGCACHE_MAXAREAS ||
+	    ent->csum != ent_checksum(ent))
+		return -1;
+
+	if (ent->devno != (uint64_t) pr->devno ||
+	    ent->off != pr->off || ent->size != pr->size)
+		return -1;
+	return 0;
+}
+
+static int write_ent(blkid_probe pr, struct negcache_ent *ent)
+{
+	int fd = open_file(1);
+	ssize_t ret;
+
+	if (fd < 0)
+		return -1;
+
+	ent->csum = ent->nareas ? ent_checksum(ent) : 0;
+	ret = pwrite(fd, ent, sizeof(*ent), ent_offset(pr));
+	close(fd);
+
+	return ret == sizeof(*ent) ? 0 : -1;
+}
+
+/*
+ * Returns fingerprint of the data in the areas or -1 on read error. The
+ * nearby areas are read by one read() call, the buffers are not released
+ * and they are reused by probing functions if the fingerprint does not match.
+ */
+static int areas_fingerprint(blkid_probe pr, const struct negcache_area *areas,
+			     size_t nareas, uint64_t *fp)
+{
+	uint64_t h = HASH_INIT;
+	size_t i, first;
+
+	for (i = 0; i < nareas; ) {
+		uint64_t start = areas[i].off, end = start;
+
+		for (first = i; i < nareas; i++) {
+			if (areas[i].off > end + NEGCACHE_READ_GAP ||
+			    areas[i].off + areas[i].len - start > BLKID_PREFETCH_MAX)
+				break;
+			end = areas[i].off + areas[i].len;
+		}
+		if (i == first)		/* huge area, read it directly */
+			i++;
+
+		if (i - first > 1 && !blkid_probe_get_buffer(pr, start, end - start))
+			return -1;
+
+		for ( ; first < i; first++) {
+			const struct negcache_area *a = &areas[first];
+			unsigned char *data = blkid_probe_get_buffer(pr, a->off, a->len);
+
+			if (!data)
+				return -1;
+			h = hash_num(h, a->off);
+			h = hash_num(h, a->len);
+			h = hash_mem(h, data, a->len);
+		}
+	}
+
+	*fp = h;
+	return 0;
+}
+
+static int is_cacheable(blkid_probe pr)
+{
+	return is_enabled() &&
+	       ((pr->devno && S_ISBLK(pr->mode)) ||
+		(negcache_regfiles && S_ISREG(pr->mode))) &&
+	       !pr->parent &&
+	       pr->size > 0 &&
+	       !pr->chains[BLKID_CHAIN_TOPLGY].enabled;
+}
+
+/*
+ * Called at the begin of blkid_do_safeprobe() and blkid_do_fullprobe(), the
+ * @safe is non-zero for the safeprobe.
+ *
+ * Returns 0 if nothing has been found on unmodified device last time (the
+ * probing may be skipped), otherwise starts to record areas used by probing
+ * functions and returns 1.
+ */
+int blkid_negcache_lookup(blkid_probe pr, int safe)
+{
+	struct negcache_ent ent;
+	uint64_t fp;
+	size_t i;
+
+	if (!is_cacheable(pr))
+		return 1;
+
+	if (read_ent(pr, &ent) == 0 &&
+	    ent.setup == probe_setup_hash(pr, safe) &&
+	    areas_fingerprint(pr, ent.areas, ent.nareas, &fp) == 0 &&
+	    ent.fp == fp) {
+		DBG(DEBUG_LOWPROBE, printf("negcache: %u areas unchanged, "
+				"nothing to probe\n", ent.nareas));
+		negcache_nhits++;
+
+		/* the same as the probing functions do */
+		for (i = 0; i < BLKID_NCHAINS; i++) {
+			if (pr->chains[i].enabled)
+				blkid_probe_chain_reset_vals(pr, &pr->chains[i]);
+		}
+		return 0;
+	}
+
+	if (!pr->negcache) {
+		pr->negcache = malloc(sizeof(struct blkid_negcache));
+		if (!pr->negcache)
+			return 1;
+	}
+	pr->negcache->failed = 0;
+	pr->negcache->nareas = 0;
+	pr->prob_flags |= BLKID_PROBE_FL_NEGCACHE;
+	return 1;
+}
+
+/*
+ * Adds area to the sorted list of the used areas. The overlapping and
+ * adjacent areas are merged. If the list is full, then the closest areas are
+ * merged -- the fingerprint covers also the gap between them, but it does not
+ * matter.
+ */
+void blkid_negcache_record(blkid_probe pr, blkid_loff_t off, blkid_loff_t len,
+			   int failed)
+{
+	struct blkid_negcache *nc = pr->negcache;
+	struct negcache_area *a;
+	uint64_t end = off + len;
+	size_t i, n;
+
+	if (!nc || nc->failed)
+		return;
+	if (failed && off >= 0 && off + len > pr->size)
+		return;		/* out of the device, depends on size only */
+	if (failed || off < 0 || len <= 0) {
+		DBG(DEBUG_LOWPROBE, printf("negcache: unreadable area "
+				"off=%jd len=%jd\n", off, len));
+		nc->failed = 1;
+		return;
+	}
+
+	/* first area which is not before @off */
+	for (i = 0; i < nc->nareas; i++) {
+		if (nc->areas[i].off + nc->areas[i].len >= (uint64_t) off)
+			break;
+	}
+
+	a = &nc->areas[i];
+	if (i < nc->nareas && a->off <= end) {
+		/* merge with the following areas */
+		uint64_t start = min((uint64_t) off, a->off);
+
+		for (n = i; n < nc->nareas && nc->areas[n].off <= end; n++)
+			end = max(end, nc->areas[n].off + nc->areas[n].len);
+
+		a->off = start;
+		a->len = end - start;
+		if (n > i + 1) {
+			memmove(a + 1, &nc->areas[n],
+				(nc->nareas - n) * sizeof(*a));
+			nc->nareas -= n - i - 1;
+		}
+		return;
+	}
+
+	memmove(a + 1, a, (nc->nareas - i) * sizeof(*a));
+	a->off = off;
+	a->len = len;
+	nc->nareas++;
+
+	if (nc->nareas > NEGCACHE_MAXAREAS) {
+		/* too many areas, merge the closest neighbours */
+		uint64_t gap, mingap = UINT64_MAX;
+
+		for (n = 0; n + 1 < nc->nareas; n++) {
+			gap = nc->areas[n + 1].off -
+			      (nc->areas[n].off + nc->areas[n].len);
+			if (gap < mingap) {
+				mingap = gap;
+				i = n;
+			}
+		}
+		if (mingap > BLKID_PREFETCH_GAP) {
+			DBG(DEBUG_LOWPROBE, printf("negcache: too many areas\n"));
+			nc->failed = 1;
+			return;
+		}
+		a = &nc->areas[i];
+		a->len = a[1].off + a[1].len - a->off;
+		memmove(a + 1, a + 2, (nc->nareas - i - 2) * sizeof(*a));
+		nc->nareas--;
+	}
+}
+
+/*
+ * Called at the end of blkid_do_safeprobe() and blkid_do_fullprobe() on all
+ * paths, stops recording of the areas. The areas are stored to the cache if
+ * @store is non-zero (nothing has been detected).
+ */
+void blkid_negcache_end(blkid_probe pr, int safe, int store)
+{
+	struct blkid_negcache *nc = pr->negcache;
+	struct negcache_ent ent;
+
+	if (!(pr->prob_flags & BLKID_PROBE_FL_NEGCACHE))
+		return;
+	pr->prob_flags &= ~BLKID_PROBE_FL_NEGCACHE;
+
+	/* the result depends on the whole-disk */
+	if (!store || pr->disk_probe || !nc || nc->failed || !nc->nareas)
+		return;
+
+	memset(&ent, 0, sizeof(ent));
+	ent.nareas = nc->nareas;
+	ent.devno = pr->devno;
+	ent.off = pr->off;
+	ent.size = pr->size;
+	ent.setup = probe_setup_hash(pr, safe);
+	memcpy(ent.areas, nc->areas, nc->nareas * sizeof(struct negcache_area));
+
+	if (areas_fingerprint(pr, ent.areas, ent.nareas, &ent.fp) != 0)
+		return;
+
+	if (write_ent(pr, &ent) == 0)
+		DBG(DEBUG_LOWPROBE, printf("negcache: stored %zu areas\n",
+					nc->nareas));
+}
+
+/*
+ * Removes entry for the device, called when the device has been modified by
+ * libblkid.
+ */
+void blkid_negcache_invalidate(blkid_probe pr)
+{
+	struct negcache_ent ent;
+
+	if (!is_cacheable(pr) || read_ent(pr, &ent) != 0)
+		return;
+
+	memset(&ent, 0, sizeof(ent));
+	write_ent(pr, &ent);
+
+	DBG(DEBUG_LOWPROBE, printf("negcache: entry invalidated\n"));
+}
+
+void blkid_negcache_free(blkid_probe pr)
+{
+	free(pr->negcache);
+	pr->negcache = NULL;
+}
+
+#ifdef TEST_PROGRAM
+int main(int argc, char **argv)
+{
+	blkid_probe pr;
+	unsigned int nhits;
+	int i, rc = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <cachefile> <device|file>\n"
+			"Probe the device twice, the second probing should "
+			"use the negative cache\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	blkid_init_debug(0);
+
+	negcache_enabled = 1;
+	negcache_file = argv[1];
+	negcache_uid = geteuid();
+	negcache_regfiles = 1;
+
+	pr = blkid_new_probe_from_filename(argv[2]);
+	if (!pr) {
+		fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[2]);
+		return EXIT_FAILURE;
+	}
+	blkid_probe_enable_partitions(pr, 1);
+
+	for (i = 0; i < 2; i++) {
+		nhits = negcache_nhits;
+		rc = blkid_do_safeprobe(pr);
+		printf("probe #%d: %s%s\n", i + 1,
+			rc == 1 ? "nothing detected" :
+			rc == 0 ? "detected" : "failed",
+			negcache_nhits != nhits ? " (cached)" : "");
+	}
+
+	blkid_free_probe(pr);
+	return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
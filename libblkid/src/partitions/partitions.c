@@ -590,6 +590,10 @@ static int partitions_probe(blkid_probe pr, struct blkid_chain *chn)
 		printf("--> starting probing loop [PARTS idx=%d]\n",
 		chn->idx));
 
+	if (chn->idx < 0)
+		/* read magic strings areas by a few large reads */
+		blkid_probe_prefetch_idmags(pr, chn);
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
@@ -257,6 +257,7 @@ void blkid_free_probe(blkid_probe pr)
 		close(pr->fd);
 	blkid_probe_reset_buffer(pr);
 	blkid_free_probe(pr->disk_probe);
+	blkid_negcache_free(pr);
 
 	DBG(DEBUG_LOWPROBE, printf("free probe %p\n", pr));
 	free(pr);
@@ -523,73 +524,196 @@ int __blkid_probe_filter_types(blkid_probe pr, int chain, int flag, char *names[
 	return 0;
 }
 
-unsigned char *blkid_probe_get_buffer(blkid_probe pr,
-				blkid_loff_t off, blkid_loff_t len)
+/*
+ * Returns prober which owns buffers for the area of @pr. The cloned probers
+ * point to the same area as parent and they use parent's buffers. The @off
+ * is updated to be relative to the returned prober.
+ */
+static blkid_probe probe_buffer_owner(blkid_probe pr, blkid_loff_t *off)
 {
-	struct list_head *p;
-	struct blkid_bufinfo *bf = NULL;
-
-	if (pr->size <= 0)
-		return NULL;
-
-	if (pr->parent &&
-	    pr->parent->devno == pr->devno &&
-	    pr->parent->off <= pr->off &&
-	    pr->parent->off + pr->parent->size >= pr->off + pr->size) {
+	while (pr->parent &&
+	       pr->parent->devno == pr->devno &&
+	       pr->parent->off <= pr->off &&
+	       pr->parent->off + pr->parent->size >= pr->off + pr->size) {
 		/*
-		 * This is a cloned prober and points to the same area as
-		 * parent. Let's use parent's buffers.
-		 *
 		 * Note that pr->off (and pr->parent->off) is always from the
 		 * beginig of the device.
 		 */
-		return blkid_probe_get_buffer(pr->parent,
-				pr->off + off - pr->parent->off, len);
+		*off = pr->off + *off - pr->parent->off;
+		pr = pr->parent;
 	}
+	return pr;
+}
+
+static struct blkid_bufinfo *probe_find_buffer(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len)
+{
+	struct list_head *p;
 
 	list_for_each(p, &pr->buffers) {
 		struct blkid_bufinfo *x =
 				list_entry(p, struct blkid_bufinfo, bufs);
 
-		if (x->off <= off && off + len <= x->off + x->len) {
-			DBG(DEBUG_LOWPROBE,
-				printf("\treuse buffer: off=%jd len=%jd pr=%p\n",
-							x->off, x->len, pr));
-			bf = x;
-			break;
-		}
+		if (x->off <= off && off + len <= x->off + x->len)
+			return x;
 	}
-	if (!bf) {
-		ssize_t ret;
+	return NULL;
+}
 
-		if (blkid_llseek(pr->fd, pr->off + off, SEEK_SET) < 0)
-			return NULL;
+static struct blkid_bufinfo *probe_read_buffer(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len)
+{
+	struct blkid_bufinfo *bf;
+	ssize_t ret;
 
-		/* allocate info and space for data by why call */
-		bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
-		if (!bf)
-			return NULL;
+	/* allocate info and space for data by one call */
+	bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
+	if (!bf)
+		return NULL;
 
-		bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
-		bf->len = len;
-		bf->off = off;
-		INIT_LIST_HEAD(&bf->bufs);
+	bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
+	bf->len = len;
+	bf->off = off;
+	INIT_LIST_HEAD(&bf->bufs);
 
-		DBG(DEBUG_LOWPROBE,
-			printf("\tbuffer read: off=%jd len=%jd pr=%p\n",
-				off, len, pr));
+	DBG(DEBUG_LOWPROBE,
+		printf("\tbuffer read: off=%jd len=%jd pr=%p\n",
+			off, len, pr));
 
-		ret = read(pr->fd, bf->data, len);
-		if (ret != (ssize_t) len) {
-			free(bf);
-			return NULL;
-		}
-		list_add_tail(&bf->bufs, &pr->buffers);
+	ret = pread(pr->fd, bf->data, len, pr->off + off);
+	if (ret != (ssize_t) len) {
+		free(bf);
+		return NULL;
 	}
+	list_add_tail(&bf->bufs, &pr->buffers);
+	return bf;
+}
+
+unsigned char *blkid_probe_get_buffer(blkid_probe pr,
+				blkid_loff_t off, blkid_loff_t len)
+{
+	struct blkid_bufinfo *bf;
+
+	if (pr->size <= 0)
+		return NULL;
+
+	pr = probe_buffer_owner(pr, &off);
+
+	bf = probe_find_buffer(pr, off, len);
+	if (bf)
+		DBG(DEBUG_LOWPROBE,
+			printf("\treuse buffer: off=%jd len=%jd pr=%p\n",
+						bf->off, bf->len, pr));
+	else
+		bf = probe_read_buffer(pr, off, len);
+
+	if (pr->prob_flags & BLKID_PROBE_FL_NEGCACHE)
+		blkid_negcache_record(pr, off, len, bf == NULL);
+	if (!bf)
+		return NULL;
 
 	return off ? bf->data + (off - bf->off) : bf->data;
 }
 
+static int cmp_loff(const void *a, const void *b)
+{
+	blkid_loff_t x = *((const blkid_loff_t *) a),
+		     y = *((const blkid_loff_t *) b);
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * Reads all magic string areas (see blkid_probe_get_idmag()) for all enabled
+ * probing functions of the chain in advance. The nearby areas are merged into
+ * large buffers, so the probing functions don't have to read the device by
+ * many small read() calls at scattered offsets. The areas which cannot be
+ * merged with any other area are ignored here and read on demand.
+ *
+ * Returns: number of the merged read() calls or -1 in case of error.
+ */
+int blkid_probe_prefetch_idmags(blkid_probe pr, struct blkid_chain *chn)
+{
+	const struct blkid_chaindrv *drv = chn->driver;
+	blkid_loff_t *offs, base = 0;
+	size_t i, n = 0, nmags = 0;
+	int nreads = 0;
+
+	if (pr->size <= 0)
+		return 0;
+
+	for (i = 0; i < drv->nidinfos; i++) {
+		const struct blkid_idmag *mag = &drv->idinfos[i]->magics[0];
+
+		for ( ; mag && mag->magic; mag++)
+			nmags++;
+	}
+	if (!nmags)
+		return 0;
+
+	offs = malloc(nmags * sizeof(blkid_loff_t));
+	if (!offs)
+		return -1;
+
+	for (i = 0; i < drv->nidinfos; i++) {
+		const struct blkid_idinfo *id = drv->idinfos[i];
+		const struct blkid_idmag *mag = &id->magics[0];
+
+		if (chn->fltr && blkid_bmp_get_item(chn->fltr, i))
+			continue;
+		if (id->minsz && id->minsz > pr->size)
+			continue;
+
+		for ( ; mag && mag->magic; mag++) {
+			blkid_loff_t off = (mag->kboff + (mag->sboff >> 10)) << 10;
+
+			if (off + 1024 <= pr->size)
+				offs[n++] = off;
+		}
+	}
+
+	qsort(offs, n, sizeof(blkid_loff_t), cmp_loff);
+
+	/* remove duplicate areas */
+	for (i = 1, nmags = n ? 1 : 0; i < n; i++) {
+		if (offs[i] != offs[nmags - 1])
+			offs[nmags++] = offs[i];
+	}
+	n = nmags;
+
+	pr = probe_buffer_owner(pr, &base);
+
+	for (i = 0; i < n; ) {
+		blkid_loff_t start = base + offs[i], end = start + 1024;
+		size_t nareas = 0;
+
+		for ( ; i < n; i++) {
+			blkid_loff_t off = base + offs[i];
+
+			if (off > end + BLKID_PREFETCH_GAP ||
+			    off + 1024 - start > BLKID_PREFETCH_MAX)
+				break;
+			if (probe_find_buffer(pr, off, 1024))
+				continue;		/* already in memory */
+			if (!nareas)
+				start = off;
+			if (off + 1024 > end)
+				end = off + 1024;
+			nareas++;
+		}
+
+		if (nareas < 2)
+			continue;
+		if (probe_read_buffer(pr, start, end - start))
+			nreads++;
+	}
+
+	DBG(DEBUG_LOWPROBE,
+		printf("prefetch [%s]: %zu magic areas by %d read() call(s)\n",
+			drv->name, n, nreads));
+	free(offs);
+	return nreads;
+}
 
 static void blkid_probe_reset_buffer(blkid_probe pr)
 {
@@ -1013,6 +1137,7 @@ int blkid_do_wipe(blkid_probe pr, int dryrun)
 		if (write_all(fd, buf, len))
 			return -1;
 		fsync(fd);
+		blkid_negcache_invalidate(pr);
 		return blkid_probe_step_back(pr);
 	}
 
@@ -1131,6 +1256,9 @@ int blkid_do_safeprobe(blkid_probe pr)
 
 	blkid_probe_start(pr);
 
+	if (blkid_negcache_lookup(pr, TRUE) == 0)
+		goto done;
+
 	pr->prob_flags |= BLKID_PROBE_FL_IGNORE_BACKUP;
 
 	for (i = 0; i < BLKID_NCHAINS; i++) {
@@ -1160,6 +1288,7 @@ int blkid_do_safeprobe(blkid_probe pr)
 	}
 
 done:
+	blkid_negcache_end(pr, TRUE, rc >= 0 && !count);
 	blkid_probe_end(pr);
 	if (rc < 0)
 		return rc;
@@ -1187,6 +1316,9 @@ int blkid_do_fullprobe(blkid_probe pr)
 
 	blkid_probe_start(pr);
 
+	if (blkid_negcache_lookup(pr, FALSE) == 0)
+		goto done;
+
 	for (i = 0; i < BLKID_NCHAINS; i++) {
 		struct blkid_chain *chn;
 
@@ -1214,6 +1346,7 @@ int blkid_do_fullprobe(blkid_probe pr)
 	}
 
 done:
+	blkid_negcache_end(pr, FALSE, rc >= 0 && !count);
 	blkid_probe_end(pr);
 	if (rc < 0)
 		return rc;
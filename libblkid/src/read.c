@@ -383,8 +383,11 @@ done:
  * Parse the specified filename, and return the data in the supplied or
  * a newly allocated cache struct.  If the file doesn't exist, return a
  * new empty cache struct.
+ *
+ * If @deferred is true and there is a valid binary cache, then the binary
+ * cache is only mapped and the devices are read later by blkid_load_cache().
  */
-void blkid_read_cache(blkid_cache cache)
+static void read_cache(blkid_cache cache, int deferred)
 {
 	FILE *file;
 	char buf[4096];
@@ -394,6 +397,8 @@ void blkid_read_cache(blkid_cache cache)
 	if (!cache)
 		return;
 
+	blkid_load_cache(cache);
+
 	/*
 	 * If the file doesn't exist, then we just return an empty
 	 * struct so that the cache can be populated.
@@ -409,6 +414,16 @@ void blkid_read_cache(blkid_cache cache)
 		goto errout;
 	}
 
+	if (blkid_bincache_open(cache, &st) == 0) {
+		cache->bic_flags |= BLKID_BIC_FL_BINARY;
+		if (!deferred)
+			blkid_bincache_load(cache);
+
+		cache->bic_flags &= ~BLKID_BIC_FL_CHANGED;
+		cache->bic_ftime = st.st_mtime;
+		goto errout;
+	}
+
 	DBG(DEBUG_CACHE, printf("reading cache file %s\n",
 				cache->bic_filename));
 
@@ -451,6 +466,16 @@ errout:
 	return;
 }
 
+void blkid_read_cache(blkid_cache cache)
+{
+	read_cache(cache, 0);
+}
+
+void blkid_read_cache_deferred(blkid_cache cache)
+{
+	read_cache(cache, 1);
+}
+
 #ifdef TEST_PROGRAM
 static void debug_dump_dev(blkid_dev dev)
 {
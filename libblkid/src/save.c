@@ -50,6 +50,18 @@ static int save_dev(blkid_dev dev, FILE *file)
 	return 0;
 }
 
+/*
+ * Write the binary cache if enabled in blkid.conf, see bincache.c.
+ */
+static void save_bincache(blkid_cache cache, const char *filename)
+{
+	struct blkid_config *conf = blkid_read_config(NULL);
+
+	if (conf && conf->bincache)
+		blkid_bincache_save(cache, filename);
+	blkid_free_config(conf);
+}
+
 /*
  * Write out the cache struct to the cache file on disk.
  */
@@ -67,7 +79,10 @@ int blkid_flush_cache(blkid_cache cache)
 		return -BLKID_ERR_PARAM;
 
 	if (list_empty(&cache->bic_devs) ||
-	    !(cache->bic_flags & BLKID_BIC_FL_CHANGED)) {
+	    !(cache->bic_flags & BLKID_BIC_FL_CHANGED) ||
+	    (cache->bic_flags & BLKID_BIC_FL_BINARY)) {
+		/* note that the cache with mapped (and not read) binary cache
+		 * is incomplete, the cache files on disk are still valid */
 		DBG(DEBUG_SAVE, printf("skipping cache file write\n"));
 		return 0;
 	}
@@ -184,6 +199,8 @@ int blkid_flush_cache(blkid_cache cache)
 		}
 	}
 
+	if (ret == 1)
+		save_bincache(cache, filename);
 errout:
 	free(tmp);
 	if (filename != cache->bic_filename)
@@ -152,6 +152,40 @@ static const struct blkid_idinfo *idinfos[] =
 	&f2fs_idinfo
 };
 
+/*
+ * Magic strings dispatch table
+ *
+ * All magic strings from idinfos[] grouped by 1KiB areas (see
+ * blkid_probe_get_idmag()) and sorted by offset within the area. The probing
+ * loop reads every area only once and the probing functions are called only
+ * for idinfos with a matching magic string.
+ *
+ * The table is built on the first use and it's never deallocated.
+ */
+struct idmag_entry {
+	const struct blkid_idmag *mag;
+	blkid_loff_t	off;		/* area offset */
+	unsigned int	pos;		/* magic offset within the area */
+	size_t		id;		/* index to idinfos[] */
+};
+
+struct idmag_area {
+	blkid_loff_t	off;
+	size_t		first;		/* the first entry */
+	size_t		nents;		/* number of entries */
+};
+
+struct idmag_table {
+	size_t			nareas;
+	struct idmag_area	*areas;
+	struct idmag_entry	*ents;
+
+	/* idinfos without magic strings, always probed */
+	unsigned long		nomagic[blkid_bmp_nwords(ARRAY_SIZE(idinfos))];
+};
+
+static struct idmag_table *idmag_table;
+
 /*
  * Driver definition
  */
@@ -327,8 +361,131 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
 /*
  * The blkid_do_probe() backend.
  */
+static int cmp_idmag_entry(const void *a, const void *b)
+{
+	const struct idmag_entry *x = a, *y = b;
+
+	if (x->off != y->off)
+		return x->off < y->off ? -1 : 1;
+	if (x->pos != y->pos)
+		return x->pos < y->pos ? -1 : 1;
+	if (x->id != y->id)
+		return x->id < y->id ? -1 : 1;
+	return x->mag < y->mag ? -1 : x->mag > y->mag;
+}
+
+static struct idmag_table *get_idmag_table(void)
+{
+	struct idmag_table *tb;
+	struct idmag_entry *e;
+	size_t i, n = 0;
+
+	if (idmag_table)
+		return idmag_table;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag = &idinfos[i]->magics[0];
+
+		for ( ; mag->magic; mag++)
+			n++;
+	}
+
+	/* the table, areas and entries in one chunk, the number of areas is
+	 * not greater than number of the entries */
+	tb = calloc(1, sizeof(*tb) + n * (sizeof(struct idmag_area) +
+					  sizeof(struct idmag_entry)));
+	if (!tb)
+		return NULL;
+	tb->ents = (struct idmag_entry *) (tb + 1);
+	tb->areas = (struct idmag_area *) (tb->ents + n);
+
+	for (i = 0, e = tb->ents; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag = &idinfos[i]->magics[0];
+
+		if (!mag->magic)
+			blkid_bmp_set_item(tb->nomagic, i);
+
+		for ( ; mag->magic; mag++) {
+			if ((mag->sboff & 0x3ff) + mag->len > 1024 || !mag->len) {
+				/* does not fit into the area, see
+				 * blkid_probe_get_idmag() */
+				blkid_bmp_set_item(tb->nomagic, i);
+				continue;
+			}
+			e->mag = mag;
+			e->off = (mag->kboff + (mag->sboff >> 10)) << 10;
+			e->pos = mag->sboff & 0x3ff;
+			e->id = i;
+			e++;
+		}
+	}
+	n = e - tb->ents;
+	qsort(tb->ents, n, sizeof(struct idmag_entry), cmp_idmag_entry);
+
+	for (i = 0; i < n; i++) {
+		struct idmag_area *ar = tb->nareas ? &tb->areas[tb->nareas - 1] : NULL;
+
+		if (!ar || ar->off != tb->ents[i].off) {
+			ar = &tb->areas[tb->nareas++];
+			ar->off = tb->ents[i].off;
+			ar->first = i;
+		}
+		ar->nents++;
+	}
+
+	DBG(DEBUG_LOWPROBE, printf("idmag table: %zu magics in %zu areas\n",
+				n, tb->nareas));
+
+	/* another thread may be faster */
+	if (!__sync_bool_compare_and_swap(&idmag_table, NULL, tb))
+		free(tb);
+	return idmag_table;
+}
+
+/*
+ * Sets bits in @cands for idinfos (starting at @start) which have a matching
+ * magic string or no magic string at all.
+ */
+static void get_idmag_candidates(blkid_probe pr, struct blkid_chain *chn,
+				 const struct idmag_table *tb, size_t start,
+				 unsigned long *cands)
+{
+	size_t i;
+
+	memcpy(cands, tb->nomagic, sizeof(tb->nomagic));
+
+	for (i = 0; i < tb->nareas; i++) {
+		const struct idmag_area *ar = &tb->areas[i];
+		const struct idmag_entry *e = &tb->ents[ar->first],
+					 *end = e + ar->nents;
+		unsigned char *buf = NULL;
+
+		for ( ; e < end; e++) {
+			if (e->id < start || blkid_bmp_get_item(cands, e->id))
+				continue;
+			if (chn->fltr && blkid_bmp_get_item(chn->fltr, e->id))
+				continue;
+			if (idinfos[e->id]->minsz &&
+			    idinfos[e->id]->minsz > pr->size)
+				continue;
+
+			/* read the area only if necessary */
+			if (!buf) {
+				buf = blkid_probe_get_buffer(pr, ar->off, 1024);
+				if (!buf)
+					break;
+			}
+			if (buf[e->pos] == (unsigned char) e->mag->magic[0] &&
+			    memcmp(buf + e->pos, e->mag->magic, e->mag->len) == 0)
+				blkid_bmp_set_item(cands, e->id);
+		}
+	}
+}
+
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 {
+	unsigned long cands[blkid_bmp_nwords(ARRAY_SIZE(idinfos))];
+	const struct idmag_table *tb;
 	size_t i;
 
 	if (!pr || chn->idx < -1)
@@ -345,8 +502,16 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 		 * is 1 byte */
 		goto nothing;
 
+	if (chn->idx < 0)
+		/* read magic strings areas by a few large reads */
+		blkid_probe_prefetch_idmags(pr, chn);
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
+	tb = get_idmag_table();
+	if (tb)
+		get_idmag_candidates(pr, chn, tb, i, cands);
+
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
 		const struct blkid_idinfo *id;
 		const struct blkid_idmag *mag = NULL;
@@ -373,6 +538,10 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 		if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
 			continue;
 
+		/* no matching magic string */
+		if (tb && !blkid_bmp_get_item(cands, i))
+			continue;
+
 		DBG(DEBUG_LOWPROBE, printf("[%zd] %s:\n", i, id->name));
 
 		if (blkid_probe_get_idmag(pr, id, &off, &mag))
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "blkidP.h"
 
@@ -30,6 +31,120 @@ static blkid_tag blkid_new_tag(void)
 	return tag;
 }
 
+/*
+ * NAME=value hash index for blkid_find_dev_with_tag(). The index is built on
+ * demand by the first lookup and then kept in sync by blkid_set_tag() and
+ * blkid_free_tag(). The tags are linked into the buckets by tag->bit_idxnext.
+ */
+struct blkid_tagidx {
+	size_t		ntags;		/* number of indexed tags */
+	size_t		nbuckets;	/* power of 2 */
+	blkid_tag	buckets[];
+};
+
+#define BLKID_TAGIDX_MINBUCKETS	64
+
+/* FNV-1a hash of NAME=value, used also by binary cache (see bincache.c) */
+uint32_t blkid_tag_hash(const char *name, const char *value)
+{
+	uint32_t h = 2166136261U;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) name; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	h = (h ^ '=') * 16777619U;
+	for (p = (const unsigned char *) value; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	return h;
+}
+
+static inline blkid_tag *tagidx_bucket(struct blkid_tagidx *idx,
+				       const char *name, const char *value)
+{
+	return &idx->buckets[blkid_tag_hash(name, value) & (idx->nbuckets - 1)];
+}
+
+static void tagidx_add(blkid_cache cache, blkid_tag tag)
+{
+	struct blkid_tagidx *idx = cache->bic_tagidx;
+	blkid_tag *b;
+
+	if (!idx || !tag->bit_val)
+		return;
+	if (idx->ntags >= 2 * idx->nbuckets) {
+		/* too many collisions, rebuild on the next lookup */
+		blkid_free_tagidx(cache);
+		return;
+	}
+
+	b = tagidx_bucket(idx, tag->bit_name, tag->bit_val);
+	tag->bit_idxnext = *b;
+	*b = tag;
+	idx->ntags++;
+}
+
+static void tagidx_remove(blkid_cache cache, blkid_tag tag)
+{
+	struct blkid_tagidx *idx = cache->bic_tagidx;
+	blkid_tag *p;
+
+	if (!idx || !tag->bit_val)
+		return;
+
+	for (p = tagidx_bucket(idx, tag->bit_name, tag->bit_val); *p;
+	     p = &(*p)->bit_idxnext) {
+		if (*p == tag) {
+			*p = tag->bit_idxnext;
+			tag->bit_idxnext = NULL;
+			idx->ntags--;
+			break;
+		}
+	}
+}
+
+void blkid_free_tagidx(blkid_cache cache)
+{
+	free(cache->bic_tagidx);
+	cache->bic_tagidx = NULL;
+}
+
+static struct blkid_tagidx *get_tagidx(blkid_cache cache)
+{
+	struct blkid_tagidx *idx;
+	struct list_head *p, *t;
+	size_t ntags = 0, nbuckets = BLKID_TAGIDX_MINBUCKETS;
+
+	if (cache->bic_tagidx)
+		return cache->bic_tagidx;
+
+	list_for_each(p, &cache->bic_tags) {
+		blkid_tag head = list_entry(p, struct blkid_struct_tag, bit_tags);
+
+		list_for_each(t, &head->bit_names)
+			ntags++;
+	}
+	while (nbuckets < ntags)
+		nbuckets <<= 1;
+
+	idx = calloc(1, sizeof(*idx) + nbuckets * sizeof(blkid_tag));
+	if (!idx)
+		return NULL;
+	idx->nbuckets = nbuckets;
+	cache->bic_tagidx = idx;
+
+	DBG(DEBUG_TAG, printf("building tags index [tags=%zu, buckets=%zu]\n",
+				ntags, nbuckets));
+
+	list_for_each(p, &cache->bic_tags) {
+		blkid_tag head = list_entry(p, struct blkid_struct_tag, bit_tags);
+
+		list_for_each(t, &head->bit_names)
+			tagidx_add(cache, list_entry(t, struct blkid_struct_tag,
+						     bit_names));
+	}
+	return idx;
+}
+
 #ifdef CONFIG_BLKID_DEBUG
 void blkid_debug_dump_tag(blkid_tag tag)
 {
@@ -51,6 +166,9 @@ void blkid_free_tag(blkid_tag tag)
 		   tag->bit_val ? tag->bit_val : "(NULL)"));
 	DBG(DEBUG_TAG, blkid_debug_dump_tag(tag));
 
+	if (tag->bit_dev && tag->bit_dev->bid_cache)
+		tagidx_remove(tag->bit_dev->bid_cache, tag);
+
 	list_del(&tag->bit_tags);	/* list of tags for this device */
 	list_del(&tag->bit_names);	/* list of tags with this type */
 
@@ -158,8 +276,12 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 			free(val);
 			return 0;
 		}
+		if (dev->bid_cache)
+			tagidx_remove(dev->bid_cache, t);
 		free(t->bit_val);
 		t->bit_val = val;
+		if (dev->bid_cache)
+			tagidx_add(dev->bid_cache, t);
 	} else {
 		/* Existing tag not present, add to device */
 		if (!(t = blkid_new_tag()))
@@ -187,6 +309,8 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 					      &dev->bid_cache->bic_tags);
 			}
 			list_add_tail(&t->bit_names, &head->bit_names);
+			t->bit_seqno = ++dev->bid_cache->bic_tagseq;
+			tagidx_add(dev->bid_cache, t);
 		}
 	}
 
@@ -322,6 +446,68 @@ extern void blkid_tag_iterate_end(blkid_tag_iterate iter)
 	free(iter);
 }
 
+/*
+ * Returns the device with the highest priority (and the oldest tag if more
+ * devices have the same priority) which exists in the system.
+ */
+static blkid_dev find_dev_by_index(blkid_cache cache,
+				   const char *type, const char *value)
+{
+	struct blkid_tagidx *idx = get_tagidx(cache);
+	blkid_tag tmp, best = NULL;
+	struct list_head *p;
+
+	if (!idx) {
+		/* no memory for the index, use tags list */
+		blkid_tag head = blkid_find_head_cache(cache, type);
+
+		if (!head)
+			return NULL;
+		list_for_each(p, &head->bit_names) {
+			tmp = list_entry(p, struct blkid_struct_tag, bit_names);
+
+			if (!strcmp(tmp->bit_val, value) &&
+			    (!best || tmp->bit_dev->bid_pri > best->bit_dev->bid_pri) &&
+			    !access(tmp->bit_dev->bid_name, F_OK))
+				best = tmp;
+		}
+		return best ? best->bit_dev : NULL;
+	}
+
+	for (tmp = *tagidx_bucket(idx, type, value); tmp; tmp = tmp->bit_idxnext) {
+		if (strcmp(tmp->bit_val, value) || strcmp(tmp->bit_name, type))
+			continue;
+		if (best && (tmp->bit_dev->bid_pri < best->bit_dev->bid_pri ||
+			     (tmp->bit_dev->bid_pri == best->bit_dev->bid_pri &&
+			      tmp->bit_seqno > best->bit_seqno)))
+			continue;
+		if (!access(tmp->bit_dev->bid_name, F_OK))
+			best = tmp;
+	}
+	return best ? best->bit_dev : NULL;
+}
+
+/*
+ * Verifies the devices modified since they have been probed. Returns number
+ * of the verified devices.
+ */
+static int verify_changed_devs(blkid_cache cache)
+{
+	struct list_head *p, *pnext;
+	int n = 0;
+
+	list_for_each_safe(p, pnext, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+		struct stat st;
+
+		if (stat(dev->bid_name, &st) == 0 && st.st_mtime < dev->bid_time)
+			continue;
+		blkid_verify(cache, dev);
+		n++;
+	}
+	return n;
+}
+
 /*
  * This function returns a device which matches a particular
  * type/value pair.  If there is more than one device that matches the
@@ -332,37 +518,29 @@ extern blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
 					 const char *type,
 					 const char *value)
 {
-	blkid_tag	head;
 	blkid_dev	dev;
-	int		pri;
-	struct list_head *p;
-	int		probe_new = 0;
+	int		probe_new = 0, verified = 0;
 
 	if (!cache || !type || !value)
 		return NULL;
 
+	if (cache->bic_flags & BLKID_BIC_FL_BINARY) {
+		/* try the binary cache index, don't read all devices */
+		dev = blkid_bincache_find_dev(cache, type, value);
+		if (dev && !(dev->bid_flags & BLKID_BID_FL_VERIFIED))
+			dev = blkid_verify(cache, dev);
+		if (dev && (dev->bid_flags & BLKID_BID_FL_VERIFIED) &&
+		    blkid_dev_has_tag(dev, type, value))
+			return dev;
+	}
+
 	blkid_read_cache(cache);
 
 	DBG(DEBUG_TAG, printf("looking for %s=%s in cache\n", type, value));
 
 try_again:
-	pri = -1;
-	dev = 0;
-	head = blkid_find_head_cache(cache, type);
-
-	if (head) {
-		list_for_each(p, &head->bit_names) {
-			blkid_tag tmp = list_entry(p, struct blkid_struct_tag,
-						   bit_names);
+	dev = find_dev_by_index(cache, type, value);
 
-			if (!strcmp(tmp->bit_val, value) &&
-			    (tmp->bit_dev->bid_pri > pri) &&
-			    !access(tmp->bit_dev->bid_name, F_OK)) {
-				dev = tmp->bit_dev;
-				pri = dev->bid_pri;
-			}
-		}
-	}
 	if (dev && !(dev->bid_flags & BLKID_BID_FL_VERIFIED)) {
 		dev = blkid_verify(cache, dev);
 		if (!dev || (dev && (dev->bid_flags & BLKID_BID_FL_VERIFIED)))
@@ -377,6 +555,17 @@ try_again:
 	}
 
 	if (!dev && !(cache->bic_flags & BLKID_BIC_FL_PROBED)) {
+		/* don't rescan all devices again and again for missing tags,
+		 * but the known devices may be changed (e.g. by mkfs) */
+		if (blkid_full_scan_is_recent()) {
+			if (verified++ || !verify_changed_devs(cache)) {
+				DBG(DEBUG_TAG, printf("%s=%s not found, all "
+					"devices scanned recently\n",
+					type, value));
+				return NULL;
+			}
+			goto try_again;
+		}
 		if (blkid_probe_all(cache) < 0)
 			return NULL;
 		goto try_again;
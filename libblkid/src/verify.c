@@ -21,18 +21,16 @@
 #endif
 #include "blkidP.h"
 
-static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
+static void blkid_vals_to_tags(struct blkid_prval *vals, int nvals,
+			       blkid_dev dev)
 {
-	const char *data;
-	const char *name;
-	int nvals, n;
-	size_t len;
-
-	nvals = blkid_probe_numof_values(pr);
+	int n;
 
 	for (n = 0; n < nvals; n++) {
-		if (blkid_probe_get_value(pr, n, &name, &data, &len) != 0)
-			continue;
+		const char *name = vals[n].name;
+		const char *data = (const char *) vals[n].data;
+		size_t len = vals[n].len;
+
 		if (strncmp(name, "PART_ENTRY_", 11) == 0) {
 			if (strcmp(name, "PART_ENTRY_UUID") == 0)
 				blkid_set_tag(dev, "PARTUUID", data, len);
@@ -47,6 +45,137 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
 	}
 }
 
+static void blkid_probe_setup_verify(blkid_probe pr)
+{
+	/* enable superblocks probing */
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
+		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
+		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
+
+	/* enable partitions probing */
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+}
+
+static void blkid_probe_cleanup_verify(blkid_probe pr)
+{
+	blkid_reset_probe(pr);
+	blkid_probe_reset_superblocks_filter(pr);
+}
+
+static void get_probe_time(time_t *sec, suseconds_t *usec)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	struct timeval tv;
+	if (!gettimeofday(&tv, NULL)) {
+		*sec = tv.tv_sec;
+		*usec = tv.tv_usec;
+		return;
+	}
+#endif
+	*sec = time(0);
+	*usec = 0;
+}
+
+/*
+ * Probes the device @dp->name by @pr and stores the result to @dp. This
+ * function does not touch any cache, so it's possible to call it from more
+ * threads (every thread with its own @pr).
+ */
+void blkid_probe_devprobe(blkid_probe pr, struct blkid_devprobe *dp)
+{
+	int fd, n;
+
+	dp->rc = -1;
+	dp->nvals = 0;
+
+	fd = open(dp->name, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	if (blkid_probe_set_device(pr, fd, 0, 0))
+		goto done;
+
+	blkid_probe_setup_verify(pr);
+	dp->rc = blkid_do_safeprobe(pr);
+	get_probe_time(&dp->time, &dp->utime);
+
+	if (dp->rc == 0 && pr->nvals) {
+		dp->vals = malloc(pr->nvals * sizeof(struct blkid_prval));
+		if (!dp->vals) {
+			dp->rc = -1;
+			goto done;
+		}
+		for (n = 0; n < pr->nvals; n++) {
+			dp->vals[n] = pr->vals[n];
+			dp->vals[n].chain = NULL;
+		}
+		dp->nvals = pr->nvals;
+	}
+done:
+	DBG(DEBUG_PROBE, printf("%s: probed in advance [rc=%d]\n",
+				dp->name, dp->rc));
+	blkid_probe_cleanup_verify(pr);
+	close(fd);
+}
+
+void blkid_free_devprobes(blkid_cache cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->bic_ndevprobes; i++) {
+		free(cache->bic_devprobes[i].name);
+		free(cache->bic_devprobes[i].vals);
+	}
+	free(cache->bic_devprobes);
+	cache->bic_devprobes = NULL;
+	cache->bic_ndevprobes = 0;
+}
+
+static int cmp_devprobe(const void *a, const void *b)
+{
+	dev_t x = ((const struct blkid_devprobe *) a)->devno,
+	      y = ((const struct blkid_devprobe *) b)->devno;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * Sorts probing results by devno to make get_devprobe() fast.
+ */
+void blkid_sort_devprobes(blkid_cache cache)
+{
+	if (cache->bic_ndevprobes > 1)
+		qsort(cache->bic_devprobes, cache->bic_ndevprobes,
+		      sizeof(struct blkid_devprobe), cmp_devprobe);
+}
+
+static struct blkid_devprobe *get_devprobe(blkid_cache cache, dev_t devno)
+{
+	struct blkid_devprobe key, *dp;
+
+	if (!devno || !cache->bic_ndevprobes)
+		return NULL;
+
+	key.devno = devno;
+	dp = bsearch(&key, cache->bic_devprobes, cache->bic_ndevprobes,
+			sizeof(struct blkid_devprobe), cmp_devprobe);
+
+	return dp && dp->rc >= 0 ? dp : NULL;
+}
+
+static void remove_tags(blkid_dev dev)
+{
+	blkid_tag_iterate iter;
+	const char *type, *value;
+
+	iter = blkid_tag_iterate_begin(dev);
+	while (blkid_tag_next(iter, &type, &value) == 0)
+		blkid_set_tag(dev, type, NULL, 0);
+	blkid_tag_iterate_end(iter);
+}
+
 /*
  * Verify that the data in dev is consistent with what is on the actual
  * block device (using the devname field only).  Normally this will be
@@ -58,8 +187,7 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
  */
 blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 {
-	blkid_tag_iterate iter;
-	const char *type, *value;
+	struct blkid_devprobe *dp;
 	struct stat st;
 	time_t diff, now;
 	int fd;
@@ -115,6 +243,26 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		   (unsigned long)diff));
 #endif
 
+	dp = get_devprobe(cache, st.st_rdev);
+	if (dp) {
+		/* already probed by probe_all() threads */
+		DBG(DEBUG_PROBE, printf("%s: use result probed in advance\n",
+					dev->bid_name));
+		remove_tags(dev);
+		if (dp->rc) {
+			blkid_free_dev(dev);
+			return NULL;
+		}
+		dev->bid_time = dp->time;
+		dev->bid_utime = dp->utime;
+		dev->bid_devno = st.st_rdev;
+		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
+		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
+
+		blkid_vals_to_tags(dp->vals, dp->nvals, dev);
+		return dev;
+	}
+
 	if (!cache->probe) {
 		cache->probe = blkid_new_probe();
 		if (!cache->probe) {
@@ -139,20 +287,9 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 	}
 
 	/* remove old cache info */
-	iter = blkid_tag_iterate_begin(dev);
-	while (blkid_tag_next(iter, &type, &value) == 0)
-		blkid_set_tag(dev, type, NULL, 0);
-	blkid_tag_iterate_end(iter);
+	remove_tags(dev);
 
-	/* enable superblocks probing */
-	blkid_probe_enable_superblocks(cache->probe, TRUE);
-	blkid_probe_set_superblocks_flags(cache->probe,
-		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
-		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
-
-	/* enable partitions probing */
-	blkid_probe_enable_partitions(cache->probe, TRUE);
-	blkid_probe_set_partitions_flags(cache->probe, BLKID_PARTS_ENTRY_DETAILS);
+	blkid_probe_setup_verify(cache->probe);
 
 	/* probe */
 	if (blkid_do_safeprobe(cache->probe)) {
@@ -162,27 +299,19 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 	}
 
 	if (dev) {
-#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
-		struct timeval tv;
-		if (!gettimeofday(&tv, NULL)) {
-			dev->bid_time = tv.tv_sec;
-			dev->bid_utime = tv.tv_usec;
-		} else
-#endif
-			dev->bid_time = time(0);
+		get_probe_time(&dev->bid_time, &dev->bid_utime);
 
 		dev->bid_devno = st.st_rdev;
 		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
 		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
 
-		blkid_probe_to_tags(cache->probe, dev);
+		blkid_vals_to_tags(cache->probe->vals, cache->probe->nvals, dev);
 
 		DBG(DEBUG_PROBE, printf("%s: devno 0x%04llx, type %s\n",
 			   dev->bid_name, (long long)st.st_rdev, dev->bid_type));
 	}
 
-	blkid_reset_probe(cache->probe);
-	blkid_probe_reset_superblocks_filter(cache->probe);
+	blkid_probe_cleanup_verify(cache->probe);
 	close(fd);
 	return dev;
 }
@@ -30,24 +30,54 @@
 
 /*
  * Canonicalized (resolved) paths & tags cache
+ *
+ * The entries are hashed by the key (path or "TAG\0VALUE"), the tag entries
+ * are also hashed by the value (device name) for reverse lookups. All entries
+ * are in the LRU list, the most recently used entry is the first.
+ *
+ * The library functions which keep the returned strings across more cache
+ * lookups pin the cache (see mnt_cache_pin()); the entries removed from
+ * the pinned cache are not deallocated until the cache is unpinned.
  */
-#define MNT_CACHE_CHUNKSZ	128
+#define MNT_CACHE_MINBUCKETS	64
 
 #define MNT_CACHE_ISTAG		(1 << 1) /* entry is TAG */
 #define MNT_CACHE_ISPATH	(1 << 2) /* entry is path */
 #define MNT_CACHE_TAGREAD	(1 << 3) /* tag read by mnt_cache_read_tags() */
+#define MNT_CACHE_STAT		(1 << 4) /* dev, ino and mtime are valid */
 
 /* path cache entry */
 struct mnt_cache_entry {
 	char			*key;	/* search key (e.g. uncanonicalized path) */
 	char			*value;	/* value (e.g. canonicalized path) */
 	int			flag;
+
+	unsigned int		khash;	/* key hash */
+	unsigned int		vhash;	/* value hash (tags only) */
+	struct mnt_cache_entry	*knext;	/* next entry in the key bucket */
+	struct mnt_cache_entry	*vnext;	/* next entry in the value bucket */
+	struct list_head	lru;	/* cache LRU list */
+
+	/* see mnt_cache_enable_validation() */
+	dev_t			dev;
+	ino_t			ino;
+	time_t			mtime;
 };
 
 struct libmnt_cache {
-	struct mnt_cache_entry	*ents;
+	struct mnt_cache_entry	**keys;		/* key hash buckets */
+	struct mnt_cache_entry	**values;	/* value hash buckets */
+	size_t			nbuckets;	/* power of 2 */
 	size_t			nents;
-	size_t			nallocs;
+	size_t			maxents;	/* 0 means unlimited */
+	struct list_head	lru;
+
+	int			pinned;		/* see mnt_cache_pin() */
+	struct list_head	removed;	/* removed when pinned */
+
+	int			validate;	/* stat() based validation */
+	unsigned long		hits;
+	unsigned long		misses;
 
 	/* blkid_evaluate_tag() works in two ways:
 	 *
@@ -72,9 +102,29 @@ struct libmnt_cache *mnt_new_cache(void)
 	if (!cache)
 		return NULL;
 	DBG(CACHE, mnt_debug_h(cache, "alloc"));
+	INIT_LIST_HEAD(&cache->lru);
+	INIT_LIST_HEAD(&cache->removed);
 	return cache;
 }
 
+static void cache_free_entry(struct mnt_cache_entry *e)
+{
+	if (e->value != e->key)
+		free(e->value);
+	free(e->key);
+	free(e);
+}
+
+static void cache_free_list(struct list_head *head)
+{
+	while (!list_empty(head)) {
+		struct mnt_cache_entry *e = list_entry(head->next,
+					struct mnt_cache_entry, lru);
+		list_del(&e->lru);
+		cache_free_entry(e);
+	}
+}
+
 /**
  * mnt_free_cache:
  * @cache: pointer to struct libmnt_cache instance
@@ -83,55 +133,314 @@ struct libmnt_cache *mnt_new_cache(void)
  */
 void mnt_free_cache(struct libmnt_cache *cache)
 {
-	size_t i;
-
 	if (!cache)
 		return;
 
 	DBG(CACHE, mnt_debug_h(cache, "free"));
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (e->value != e->key)
-			free(e->value);
-		free(e->key);
-	}
-	free(cache->ents);
+	cache_free_list(&cache->lru);
+	cache_free_list(&cache->removed);
+	free(cache->keys);
+	free(cache->values);
 	if (cache->bc)
 		blkid_put_cache(cache->bc);
 	free(cache);
 }
 
+/**
+ * mnt_cache_set_maxents:
+ * @cache: pointer to struct libmnt_cache instance
+ * @maxents: maximal number of the entries or 0
+ *
+ * Limits the number of the entries in the cache, the least recently used
+ * entries are removed if the limit is exceeded. The default is 0 (unlimited).
+ *
+ * Note that the strings returned by mnt_resolve_path(), mnt_resolve_tag(), ...
+ * are owned by the cache and with the limit they are valid until the next
+ * cache update only. The library functions (mnt_table_find_target(),
+ * mnt_fs_match_source(), ...) are not affected by the limit.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_cache_set_maxents(struct libmnt_cache *cache, size_t maxents)
+{
+	assert(cache);
+	if (!cache)
+		return -EINVAL;
+
+	DBG(CACHE, mnt_debug_h(cache, "max entries: %zu", maxents));
+	cache->maxents = maxents;
+	return 0;
+}
+
+/*
+ * Pins the cache, the strings returned by the cache are valid until
+ * mnt_cache_unpin(). The calls may be nested, @cache may be NULL.
+ */
+void mnt_cache_pin(struct libmnt_cache *cache)
+{
+	if (cache)
+		cache->pinned++;
+}
+
+void mnt_cache_unpin(struct libmnt_cache *cache)
+{
+	if (!cache)
+		return;
+
+	assert(cache->pinned > 0);
+
+	if (cache->pinned > 0 && --cache->pinned == 0)
+		cache_free_list(&cache->removed);
+}
+
+/**
+ * mnt_cache_enable_validation:
+ * @cache: pointer to struct libmnt_cache instance
+ * @enable: TRUE or FALSE
+ *
+ * Enables stat(2) based validation of the cached entries. The cache remembers
+ * device, inode number and modification time of the cached path (or device
+ * node for tags) and the entry is removed from the cache if the file has been
+ * changed. The validation makes every lookup more expensive, it's useful for
+ * long-lived caches.
+ *
+ * Note that with the validation the strings returned by the cache functions
+ * are valid until the next lookup of the same path or tag only.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_cache_enable_validation(struct libmnt_cache *cache, int enable)
+{
+	assert(cache);
+	if (!cache)
+		return -EINVAL;
+
+	cache->validate = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * mnt_cache_get_stats:
+ * @cache: pointer to struct libmnt_cache instance
+ * @nents: returns number of the entries or NULL
+ * @hits: returns number of successful lookups or NULL
+ * @misses: returns number of unsuccessful lookups or NULL
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_cache_get_stats(struct libmnt_cache *cache, size_t *nents,
+			unsigned long *hits, unsigned long *misses)
+{
+	assert(cache);
+	if (!cache)
+		return -EINVAL;
+
+	if (nents)
+		*nents = cache->nents;
+	if (hits)
+		*hits = cache->hits;
+	if (misses)
+		*misses = cache->misses;
+	return 0;
+}
+
+/* FNV-1a */
+static unsigned int cache_hash(unsigned int h, const char *s, size_t len)
+{
+	while (len--) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static unsigned int hash_path(const char *path)
+{
+	return cache_hash(2166136261U, path, strlen(path));
+}
+
+/* the tag key is "TAG_NAME\0TAG_VALUE\0" */
+static unsigned int hash_tag(const char *token, const char *value)
+{
+	unsigned int h = cache_hash(2166136261U, token, strlen(token) + 1);
+
+	return cache_hash(h, value, strlen(value));
+}
+
+static int cache_resize(struct libmnt_cache *cache, size_t nbuckets)
+{
+	struct mnt_cache_entry **keys, **values;
+	struct list_head *p;
+
+	keys = calloc(nbuckets, sizeof(struct mnt_cache_entry *));
+	values = calloc(nbuckets, sizeof(struct mnt_cache_entry *));
+	if (!keys || !values) {
+		free(keys);
+		free(values);
+		return -ENOMEM;
+	}
+
+	DBG(CACHE, mnt_debug_h(cache, "resize to %zu buckets", nbuckets));
+
+	list_for_each(p, &cache->lru) {
+		struct mnt_cache_entry *e = list_entry(p,
+					struct mnt_cache_entry, lru);
+		struct mnt_cache_entry **b;
+
+		b = &keys[e->khash & (nbuckets - 1)];
+		e->knext = *b;
+		*b = e;
+
+		if (e->flag & MNT_CACHE_ISTAG) {
+			b = &values[e->vhash & (nbuckets - 1)];
+			e->vnext = *b;
+			*b = e;
+		}
+	}
+
+	free(cache->keys);
+	free(cache->values);
+	cache->keys = keys;
+	cache->values = values;
+	cache->nbuckets = nbuckets;
+	return 0;
+}
+
+static void cache_remove_entry(struct libmnt_cache *cache,
+			       struct mnt_cache_entry *e)
+{
+	struct mnt_cache_entry **b;
+
+	for (b = &cache->keys[e->khash & (cache->nbuckets - 1)]; *b;
+	     b = &(*b)->knext) {
+		if (*b == e) {
+			*b = e->knext;
+			break;
+		}
+	}
+	if (e->flag & MNT_CACHE_ISTAG) {
+		for (b = &cache->values[e->vhash & (cache->nbuckets - 1)]; *b;
+		     b = &(*b)->vnext) {
+			if (*b == e) {
+				*b = e->vnext;
+				break;
+			}
+		}
+	}
+
+	DBG(CACHE, mnt_debug_h(cache, "remove entry (%s): %s",
+			(e->flag & MNT_CACHE_ISPATH) ? "path" : "tag",
+			e->value));
+
+	list_del(&e->lru);
+	cache->nents--;
+
+	if (cache->pinned)
+		list_add(&e->lru, &cache->removed);
+	else
+		cache_free_entry(e);
+}
+
+/* the file used for validation, the path or device node for tags */
+static inline const char *entry_stat_path(struct mnt_cache_entry *e)
+{
+	return (e->flag & MNT_CACHE_ISPATH) ? e->key : e->value;
+}
+
+static void cache_stat_entry(struct mnt_cache_entry *e)
+{
+	struct stat st;
+
+	if (lstat(entry_stat_path(e), &st) != 0)
+		return;
+	e->dev = st.st_dev;
+	e->ino = st.st_ino;
+	e->mtime = st.st_mtime;
+	e->flag |= MNT_CACHE_STAT;
+}
+
+/*
+ * Returns @e or NULL if the entry is not valid anymore (and has been removed).
+ */
+static struct mnt_cache_entry *cache_use_entry(struct libmnt_cache *cache,
+					       struct mnt_cache_entry *e)
+{
+	if (cache->validate && (e->flag & MNT_CACHE_STAT)) {
+		struct stat st;
+
+		if (lstat(entry_stat_path(e), &st) != 0 ||
+		    st.st_dev != e->dev ||
+		    st.st_ino != e->ino ||
+		    st.st_mtime != e->mtime) {
+			DBG(CACHE, mnt_debug_h(cache, "%s: invalid entry",
+					entry_stat_path(e)));
+			cache_remove_entry(cache, e);
+			return NULL;
+		}
+	}
+
+	/* move to the begin of the LRU list */
+	list_del(&e->lru);
+	list_add(&e->lru, &cache->lru);
+	return e;
+}
+
 /* note that the @key could be tha same pointer as @value */
 static int cache_add_entry(struct libmnt_cache *cache, char *key,
 					char *value, int flag)
 {
-	struct mnt_cache_entry *e;
+	struct mnt_cache_entry *e, **b;
 
 	assert(cache);
 	assert(value);
 	assert(key);
 
-	if (cache->nents == cache->nallocs) {
-		size_t sz = cache->nallocs + MNT_CACHE_CHUNKSZ;
-
-		e = realloc(cache->ents, sz * sizeof(struct mnt_cache_entry));
-		if (!e)
+	if (cache->nents >= cache->nbuckets) {
+		size_t sz = cache->nbuckets ? cache->nbuckets << 1 :
+					      MNT_CACHE_MINBUCKETS;
+		if (cache_resize(cache, sz))
 			return -ENOMEM;
-		cache->ents = e;
-		cache->nallocs = sz;
 	}
 
-	e = &cache->ents[cache->nents];
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+
 	e->key = key;
 	e->value = value;
 	e->flag = flag;
+
+	if (flag & MNT_CACHE_ISTAG) {
+		e->khash = hash_tag(key, key + strlen(key) + 1);
+		e->vhash = hash_path(value);
+
+		b = &cache->values[e->vhash & (cache->nbuckets - 1)];
+		e->vnext = *b;
+		*b = e;
+	} else
+		e->khash = hash_path(key);
+
+	b = &cache->keys[e->khash & (cache->nbuckets - 1)];
+	e->knext = *b;
+	*b = e;
+
+	if (cache->validate)
+		cache_stat_entry(e);
+
+	list_add(&e->lru, &cache->lru);
 	cache->nents++;
 
 	DBG(CACHE, mnt_debug_h(cache, "add entry [%2zd] (%s): %s: %s",
 			cache->nents,
 			(flag & MNT_CACHE_ISPATH) ? "path" : "tag",
 			value, key));
+
+	/* LRU eviction, never remove the new entry */
+	while (cache->maxents && cache->nents > cache->maxents &&
+	       cache->lru.prev != &e->lru)
+		cache_remove_entry(cache, list_entry(cache->lru.prev,
+					struct mnt_cache_entry, lru));
 	return 0;
 }
 
@@ -176,7 +485,7 @@ static int cache_add_tag(struct libmnt_cache *cache, const char *tagname,
  */
 static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
 	assert(cache);
 	assert(path);
@@ -184,13 +493,22 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 	if (!cache || !path)
 		return NULL;
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISPATH))
-			continue;
-		if (strcmp(path, e->key) == 0)
-			return e->value;
+	if (cache->nbuckets) {
+		unsigned int h = hash_path(path);
+
+		for (e = cache->keys[h & (cache->nbuckets - 1)]; e; e = e->knext) {
+			if (e->khash != h || !(e->flag & MNT_CACHE_ISPATH))
+				continue;
+			if (strcmp(path, e->key) == 0) {
+				e = cache_use_entry(cache, e);
+				if (!e)
+					break;
+				cache->hits++;
+				return e->value;
+			}
+		}
 	}
+	cache->misses++;
 	return NULL;
 }
 
@@ -200,7 +518,7 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 static const char *cache_find_tag(struct libmnt_cache *cache,
 			const char *token, const char *value)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 	size_t tksz;
 
 	assert(cache);
@@ -212,13 +530,47 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 
 	tksz = strlen(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
+	if (cache->nbuckets) {
+		unsigned int h = hash_tag(token, value);
+
+		for (e = cache->keys[h & (cache->nbuckets - 1)]; e; e = e->knext) {
+			if (e->khash != h || !(e->flag & MNT_CACHE_ISTAG))
+				continue;
+			if (strcmp(token, e->key) == 0 &&
+			    strcmp(value, e->key + tksz + 1) == 0) {
+				e = cache_use_entry(cache, e);
+				if (!e)
+					break;
+				cache->hits++;
+				return e->value;
+			}
+		}
+	}
+	cache->misses++;
+	return NULL;
+}
+
+/*
+ * Returns tag entry for the @devname, if @token is NULL then the entry has to
+ * be read by mnt_cache_read_tags().
+ */
+static struct mnt_cache_entry *cache_find_dev_entry(struct libmnt_cache *cache,
+			const char *devname, const char *token)
+{
+	struct mnt_cache_entry *e;
+	unsigned int h;
+
+	if (!cache->nbuckets)
+		return NULL;
+
+	h = hash_path(devname);
+
+	for (e = cache->values[h & (cache->nbuckets - 1)]; e; e = e->vnext) {
+		if (e->vhash != h || strcmp(e->value, devname) != 0)
 			continue;
-		if (strcmp(token, e->key) == 0 &&
-		    strcmp(value, e->key + tksz + 1) == 0)
-			return e->value;
+		if (token ? strcmp(token, e->key) == 0 :	/* tag name */
+			    (e->flag & MNT_CACHE_TAGREAD) != 0)
+			return cache_use_entry(cache, e);
 	}
 	return NULL;
 }
@@ -226,22 +578,19 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 static char *cache_find_tag_value(struct libmnt_cache *cache,
 			const char *devname, const char *token)
 {
-	size_t i;
+	struct mnt_cache_entry *e;
 
 	assert(cache);
 	assert(devname);
 	assert(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISTAG))
-			continue;
-		if (strcmp(e->value, devname) == 0 &&	/* dev name */
-		    strcmp(token, e->key) == 0)	/* tag name */
-			return e->key + strlen(token) + 1;	/* tag value */
+	e = cache_find_dev_entry(cache, devname, token);
+	if (!e) {
+		cache->misses++;
+		return NULL;
 	}
-
-	return NULL;
+	cache->hits++;
+	return e->key + strlen(token) + 1;	/* tag value */
 }
 
 /**
@@ -271,19 +620,17 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	DBG(CACHE, mnt_debug_h(cache, "tags for %s requested", devname));
 
 	/* check is device is already cached */
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_TAGREAD))
-			continue;
-		if (strcmp(e->value, devname) == 0)
-			/* tags has been already read */
-			return 0;
-	}
+	if (cache_find_dev_entry(cache, devname, NULL))
+		/* tags has been already read */
+		return 0;
 
 	pr =  blkid_new_probe_from_filename(devname);
 	if (!pr)
 		return -1;
 
+	/* @devname may be a string from the cache */
+	mnt_cache_pin(cache);
+
 	blkid_probe_enable_superblocks(pr, 1);
 	blkid_probe_set_superblocks_flags(pr,
 			BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
@@ -302,7 +649,7 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 		const char *data;
 		char *dev;
 
-		if (cache_find_tag_value(cache, devname, tags[i])) {
+		if (cache_find_dev_entry(cache, devname, tags[i])) {
 			DBG(CACHE, mnt_debug_h(cache,
 					"\ntag %s already cached", tags[i]));
 			continue;
@@ -322,9 +669,11 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 
 	DBG(CACHE, mnt_debug_h(cache, "\tread %zd tags", ntags));
 	blkid_free_probe(pr);
+	mnt_cache_unpin(cache);
 	return ntags ? 0 : 1;
 error:
 	blkid_free_probe(pr);
+	mnt_cache_unpin(cache);
 	return rc < 0 ? rc : -1;
 }
 
@@ -605,6 +954,8 @@ char *mnt_resolve_spec(const char *spec, struct libmnt_cache *cache)
 
 #ifdef TEST_PROGRAM
 
+#include <sys/time.h>
+
 int test_resolve_path(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char line[BUFSIZ];
@@ -651,11 +1002,79 @@ int test_resolve_spec(struct libmnt_test *ts, int argc, char *argv[])
 	return 0;
 }
 
+int test_lru(struct libmnt_test *ts, int argc, char *argv[])
+{
+	char line[BUFSIZ];
+	struct libmnt_cache *cache;
+	unsigned long hits, misses;
+	size_t nents;
+
+	cache = mnt_new_cache();
+	if (!cache)
+		return -ENOMEM;
+
+	mnt_cache_set_maxents(cache, argc > 1 ? strtoul(argv[1], NULL, 10) : 0);
+	mnt_cache_enable_validation(cache, 1);
+
+	while(fgets(line, sizeof(line), stdin)) {
+		size_t sz = strlen(line);
+		char *p;
+
+		if (sz > 0 && line[sz - 1] == '\n')
+			line[sz - 1] = '\0';
+
+		p = mnt_resolve_path(line, cache);
+		printf("%s : %s\n", line, p);
+	}
+
+	mnt_cache_get_stats(cache, &nents, &hits, &misses);
+	printf("entries: %zu, hits: %lu, misses: %lu\n", nents, hits, misses);
+
+	mnt_free_cache(cache);
+	return 0;
+}
+
+int test_bench(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_cache *cache;
+	struct timeval start, end;
+	size_t i, n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	char buf[PATH_MAX];
+
+	cache = mnt_new_cache();
+	if (!cache)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		char *key;
+
+		snprintf(buf, sizeof(buf), "/dev/disk/by-id/bench-%zu", i);
+		key = strdup(buf);
+		if (!key || cache_add_entry(cache, key, key, MNT_CACHE_ISPATH))
+			return -ENOMEM;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "/dev/disk/by-id/bench-%zu", (i * 7919) % n);
+		if (!cache_find_path(cache, buf))
+			return -1;
+	}
+	gettimeofday(&end, NULL);
+
+	printf("%zu lookups in %zu entries: %.3f ms\n", n, n,
+			(end.tv_sec - start.tv_sec) * 1000.0 +
+			(end.tv_usec - start.tv_usec) / 1000.0);
+
+	mnt_free_cache(cache);
+	return 0;
+}
+
 int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char line[BUFSIZ];
 	struct libmnt_cache *cache;
-	size_t i;
+	struct list_head *p;
 
 	cache = mnt_new_cache();
 	if (!cache)
@@ -691,8 +1110,9 @@ int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 		}
 	}
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	list_for_each(p, &cache->lru) {
+		struct mnt_cache_entry *e = list_entry(p,
+					struct mnt_cache_entry, lru);
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 
@@ -711,6 +1131,8 @@ int main(int argc, char *argv[])
 		{ "--resolve-path", test_resolve_path, "  resolve paths from stdin" },
 		{ "--resolve-spec", test_resolve_spec, "  evaluate specs from stdin" },
 		{ "--read-tags", test_read_tags,       "  read devname or TAG from stdin (\"quit\" to exit)" },
+		{ "--lru", test_lru,                   "[<maxents>]  resolve paths from stdin, print statistic" },
+		{ "--bench", test_bench,               "[<nentries>]  lookups in large cache" },
 		{ NULL }
 	};
 
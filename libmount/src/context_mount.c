@@ -127,6 +127,11 @@ static int fix_optstr(struct libmnt_context *cxt)
 
 	fs = cxt->fs;
 
+	/* the options are modified in-place */
+	rc = mnt_fs_unshare_arena(fs);
+	if (rc)
+		goto done;
+
 	/*
 	 * The "user" options is our business (so we can modify the option),
 	 * but exception is command line for /sbin/mount.<type> helpers. Let's
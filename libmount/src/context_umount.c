@@ -91,6 +91,9 @@ static int lookup_umount_fs(struct libmnt_context *cxt)
 		if (stat(tgt, &st) == 0 && S_ISDIR(st.st_mode)) {
 			/* we'll canonicalized /proc/self/mountinfo */
 			cache = mnt_context_get_cache(cxt);
+
+			/* keep @cn_tgt valid while parsing mtab */
+			mnt_cache_pin(cache);
 			cn_tgt = mnt_resolve_path(tgt, cache);
 			if (cn_tgt)
 				mnt_context_set_tabfilter(cxt, mtab_filter, cn_tgt);
@@ -103,6 +106,7 @@ static int lookup_umount_fs(struct libmnt_context *cxt)
 		if (!cache)
 			free(cn_tgt);
 	}
+	mnt_cache_unpin(cache);
 
 	if (rc) {
 		DBG(CXT, mnt_debug_h(cxt, "umount: failed to read mtab"));
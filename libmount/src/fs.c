@@ -34,6 +34,64 @@ struct libmnt_fs *mnt_new_fs(void)
 	return fs;
 }
 
+/*
+ * The mountinfo parser in the arena mode (see mnt_table_enable_arena()) does
+ * not allocate the strings, the strings are slices of the file content owned
+ * by the table.
+ */
+static inline int is_arena_str(struct libmnt_fs *fs, const char *p)
+{
+	return fs->arena && p >= fs->arena->data &&
+	       p < fs->arena->data + fs->arena->size;
+}
+
+static inline void free_str(struct libmnt_fs *fs, char *p)
+{
+	if (!is_arena_str(fs, p))
+		free(p);
+}
+
+static int unshare_str(struct libmnt_fs *fs, char **p)
+{
+	char *x;
+
+	if (!*p || !is_arena_str(fs, *p))
+		return 0;
+	x = strdup(*p);
+	if (!x)
+		return -ENOMEM;
+	*p = x;
+	return 0;
+}
+
+/*
+ * Replaces arena strings with private copies. This is necessary before the
+ * entry is removed from the table or before any in-place modification of the
+ * strings (e.g. mnt_optstr_append_option()).
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_fs_unshare_arena(struct libmnt_fs *fs)
+{
+	assert(fs);
+
+	if (!fs->arena)
+		return 0;
+
+	if (unshare_str(fs, &fs->source) ||
+	    unshare_str(fs, &fs->root) ||
+	    unshare_str(fs, &fs->target) ||
+	    unshare_str(fs, &fs->fstype) ||
+	    unshare_str(fs, &fs->optstr) ||
+	    unshare_str(fs, &fs->vfs_optstr) ||
+	    unshare_str(fs, &fs->opt_fields) ||
+	    unshare_str(fs, &fs->fs_optstr))
+		return -ENOMEM;
+
+	fs->arena = NULL;
+	return 0;
+}
+
 /**
  * mnt_free_fs:
  * @fs: fs pointer
@@ -44,24 +102,29 @@ void mnt_free_fs(struct libmnt_fs *fs)
 {
 	if (!fs)
 		return;
-	list_del(&fs->ents);
+	if (fs->tab)
+		__mnt_table_remove_fs(fs->tab, fs);
+	else
+		list_del(&fs->ents);
 
 	/*DBG(FS, mnt_debug_h(fs, "free"));*/
 
-	free(fs->source);
+	free_str(fs, fs->source);
 	free(fs->bindsrc);
 	free(fs->tagname);
 	free(fs->tagval);
-	free(fs->root);
+	free_str(fs, fs->root);
 	free(fs->swaptype);
-	free(fs->target);
-	free(fs->fstype);
-	free(fs->optstr);
-	free(fs->vfs_optstr);
-	free(fs->fs_optstr);
+	free_str(fs, fs->target);
+	free_str(fs, fs->fstype);
+	free_str(fs, fs->optstr);
+	free_str(fs, fs->vfs_optstr);
+	free_str(fs, fs->fs_optstr);
 	free(fs->user_optstr);
 	free(fs->attrs);
-	free(fs->opt_fields);
+	free_str(fs, fs->opt_fields);
+	free(fs->ctarget);
+	free(fs->csrcpath);
 
 	free(fs);
 }
@@ -303,6 +366,15 @@ const char *mnt_fs_get_source(struct libmnt_fs *fs)
 	return fs ? fs->source : NULL;
 }
 
+/*
+ * The indexed fields have been modified, the table indexes are invalid.
+ */
+static inline void fs_reset_table_index(struct libmnt_fs *fs, int canonical)
+{
+	if (fs->tab)
+		mnt_table_reset_index(fs->tab, canonical);
+}
+
 /*
  * Used by parser ONLY (@source has to be freed on error)
  */
@@ -317,8 +389,10 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			return -1;
 	}
 
+	fs_reset_table_index(fs, 0);
+
 	if (fs->source != source)
-		free(fs->source);
+		free_str(fs, fs->source);
 
 	free(fs->tagname);
 	free(fs->tagval);
@@ -479,7 +553,9 @@ int mnt_fs_set_target(struct libmnt_fs *fs, const char *target)
 		if (!p)
 			return -ENOMEM;
 	}
-	free(fs->target);
+	fs_reset_table_index(fs, 0);
+
+	free_str(fs, fs->target);
 	fs->target = p;
 
 	return 0;
@@ -586,8 +662,11 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 {
 	assert(fs);
 
+	/* pseudo and network filesystems are not in canonicalized indexes */
+	fs_reset_table_index(fs, 1);
+
 	if (fstype != fs->fstype)
-		free(fs->fstype);
+		free_str(fs, fs->fstype);
 
 	fs->fstype = fstype;
 	fs->flags &= ~MNT_FS_PSEUDO;
@@ -645,9 +724,8 @@ int mnt_fs_set_fstype(struct libmnt_fs *fs, const char *fstype)
  */
 static char *merge_optstr(const char *vfs, const char *fs)
 {
-	char *res, *p;
+	char *res;
 	size_t sz;
-	int ro = 0, rw = 0;
 
 	if (!vfs && !fs)
 		return NULL;
@@ -661,9 +739,36 @@ static char *merge_optstr(const char *vfs, const char *fs)
 	res = malloc(sz);
 	if (!res)
 		return NULL;
-	p = res + 3;			/* make a room for rw/ro flag */
 
-	snprintf(p, sz - 3, "%s,%s", vfs, fs);
+	mnt_merge_optstr_to(res, sz, vfs, fs);
+	return res;
+}
+
+/*
+ * The same as merge_optstr(), but the result is written to @buf. The @buf has
+ * to be at least strlen(@vfs) + strlen(@fs) + 5 bytes.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_merge_optstr_to(char *buf, size_t bufsz, const char *vfs, const char *fs)
+{
+	char *p;
+	size_t vsz = strlen(vfs), fsz = strlen(fs);
+	int ro = 0, rw = 0;
+
+	if (bufsz < vsz + fsz + 5)
+		return -EINVAL;
+
+	if (!strcmp(vfs, fs)) {
+		memcpy(buf, vfs, vsz + 1);
+		return 0;
+	}
+
+	p = buf + 3;			/* make a room for rw/ro flag */
+
+	memcpy(p, vfs, vsz);
+	p[vsz] = ',';
+	memcpy(p + vsz + 1, fs, fsz + 1);
 
 	/* remove 'rw' flags */
 	rw += !mnt_optstr_remove_option(&p, "rw");	/* from vfs */
@@ -676,11 +781,11 @@ static char *merge_optstr(const char *vfs, const char *fs)
 			ro += !mnt_optstr_remove_option(&p, "ro");
 	}
 
-	if (!strlen(p))
-		memcpy(res, ro ? "ro" : "rw", 3);
+	if (!*p)
+		memcpy(buf, ro ? "ro" : "rw", 3);
 	else
-		memcpy(res, ro ? "ro," : "rw,", 3);
-	return res;
+		memcpy(buf, ro ? "ro," : "rw,", 3);
+	return 0;
 }
 
 /**
@@ -767,10 +872,10 @@ int mnt_fs_set_options(struct libmnt_fs *fs, const char *optstr)
 			return -ENOMEM;
 	}
 
-	free(fs->fs_optstr);
-	free(fs->vfs_optstr);
+	free_str(fs, fs->fs_optstr);
+	free_str(fs, fs->vfs_optstr);
 	free(fs->user_optstr);
-	free(fs->optstr);
+	free_str(fs, fs->optstr);
 
 	fs->fs_optstr = f;
 	fs->vfs_optstr = v;
@@ -803,6 +908,8 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
+	if (mnt_fs_unshare_arena(fs))
+		return -ENOMEM;
 
 	rc = mnt_split_optstr((char *) optstr, &u, &v, &f, 0, 0);
 	if (!rc && v)
@@ -844,6 +951,8 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
+	if (mnt_fs_unshare_arena(fs))
+		return -ENOMEM;
 
 	rc = mnt_split_optstr((char *) optstr, &u, &v, &f, 0, 0);
 	if (!rc && v)
@@ -1066,7 +1175,7 @@ int mnt_fs_set_root(struct libmnt_fs *fs, const char *root)
 		if (!p)
 			return -ENOMEM;
 	}
-	free(fs->root);
+	free_str(fs, fs->root);
 	fs->root = p;
 	return 0;
 }
@@ -1290,8 +1399,13 @@ int mnt_fs_match_target(struct libmnt_fs *fs, const char *target,
 	rc = mnt_fs_streq_target(fs, target);
 
 	if (!rc && cache) {
+		char *cn;
+
+		/* keep @cn valid for the second lookup */
+		mnt_cache_pin(cache);
+
 		/* 2) - canonicalized and non-canonicalized */
-		char *cn = mnt_resolve_path(target, cache);
+		cn = mnt_resolve_path(target, cache);
 		rc = (cn && strcmp(cn, fs->target) == 0);
 
 		/* 3) - canonicalized and canonicalized */
@@ -1299,6 +1413,8 @@ int mnt_fs_match_target(struct libmnt_fs *fs, const char *target,
 			char *tcn = mnt_resolve_path(fs->target, cache);
 			rc = (tcn && strcmp(cn, tcn) == 0);
 		}
+
+		mnt_cache_unpin(cache);
 	}
 
 	return rc;
@@ -1326,6 +1442,7 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 {
 	char *cn;
 	const char *src, *t, *v;
+	int rc = 0;
 
 	if (!fs)
 		return 0;
@@ -1346,24 +1463,31 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 	if (fs->flags & (MNT_FS_NET | MNT_FS_PSEUDO))
 		return 0;
 
+	/* @cn is used across more cache lookups */
+	mnt_cache_pin(cache);
+
 	cn = mnt_resolve_spec(source, cache);
 	if (!cn)
-		return 0;
+		goto done;
 
 	/* 2) canonicalized and native */
 	src = mnt_fs_get_srcpath(fs);
-	if (src && mnt_fs_streq_srcpath(fs, cn))
-		return 1;
+	if (src && mnt_fs_streq_srcpath(fs, cn)) {
+		rc = 1;
+		goto done;
+	}
 
 	/* 3) canonicalized and canonicalized */
 	if (src) {
 		src = mnt_resolve_path(src, cache);
-		if (src && !strcmp(cn, src))
-			return 1;
+		if (src && !strcmp(cn, src)) {
+			rc = 1;
+			goto done;
+		}
 	}
 	if (src || mnt_fs_get_tag(fs, &t, &v))
 		/* src path does not match and tag is not defined */
-		return 0;
+		goto done;
 
 	/* read @source's tags to the cache */
 	if (mnt_cache_read_tags(cache, cn) < 0) {
@@ -1376,16 +1500,17 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 			 */
 			char *x = mnt_resolve_tag(t, v, cache);
 			if (x && !strcmp(x, cn))
-				return 1;
+				rc = 1;
 		}
-		return 0;
+		goto done;
 	}
 
 	/* 4) has the @source a tag that matches with tag from @fs ? */
 	if (mnt_cache_device_has_tag(cache, cn, t, v))
-		return 1;
-
-	return 0;
+		rc = 1;
+done:
+	mnt_cache_unpin(cache);
+	return rc;
 }
 
 /**
@@ -0,0 +1,459 @@
+/*
+ * monitor.c - monitor of the mounted filesystems
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/**
+ * SECTION: monitor
+ * @title: Monitor
+ * @short_description: watch changes in the list of the mounted filesystems
+ *
+ * The monitor owns the mountinfo file descriptor and two tables. The
+ * current table describes the last known state of the mounted filesystems,
+ * the spare table is reused for the next update. The changes are detected by
+ * mnt_diff_tables() and accessible by mnt_monitor_next_change() or by
+ * callback (see mnt_monitor_set_callback()).
+ *
+ * <informalexample>
+ *   <programlisting>
+ *	struct libmnt_monitor *mn = mnt_new_monitor(NULL);
+ *	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+ *	struct libmnt_fs *old, *new;
+ *	int oper;
+ *
+ *	while (mnt_monitor_wait(mn, -1) > 0) {
+ *		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+ *		while (mnt_monitor_next_change(mn, itr, &old, &new, &oper) == 0)
+ *			printf("%s: %d\n", mnt_fs_get_target(new ? new : old), oper);
+ *	}
+ *   </programlisting>
+ * </informalexample>
+ *
+ * The kernel notifies about every mount table change, the monitor waits
+ * (see mnt_monitor_set_debounce()) to merge burst of the notifications to one
+ * update.
+ */
+#include <sys/time.h>
+#include <poll.h>
+
+#include "pathnames.h"
+#include "mountP.h"
+
+/* default debounce interval in milliseconds */
+#define MNT_MONITOR_DEBOUNCE		50
+
+/* max delay caused by debouncing in milliseconds */
+#define MNT_MONITOR_MAXDEBOUNCE		1000
+
+struct libmnt_monitor {
+	char		*filename;	/* monitored file */
+	FILE		*file;		/* open monitored file */
+
+	struct libmnt_table	*tb;		/* the current state */
+	struct libmnt_table	*tb_spare;	/* reused for the next update */
+	struct libmnt_tabdiff	*diff;		/* the last changes */
+
+	int		debounce;	/* debounce interval (msec) */
+
+	int		(*cb)(struct libmnt_monitor *mn,
+			      struct libmnt_fs *old_fs,
+			      struct libmnt_fs *new_fs,
+			      int oper, void *data);
+	void		*cbdata;
+};
+
+/**
+ * mnt_new_monitor:
+ * @filename: mountinfo file or NULL
+ *
+ * Opens and parses @filename (default is /proc/self/mountinfo). The monitor
+ * reports changes relative to the state of the file when the monitor has been
+ * created.
+ *
+ * Returns: newly allocated monitor or NULL in case of error.
+ */
+struct libmnt_monitor *mnt_new_monitor(const char *filename)
+{
+	struct libmnt_monitor *mn;
+
+	mn = calloc(1, sizeof(*mn));
+	if (!mn)
+		return NULL;
+
+	DBG(MONITOR, mnt_debug_h(mn, "alloc"));
+
+	mn->debounce = MNT_MONITOR_DEBOUNCE;
+	mn->filename = strdup(filename ? filename : _PATH_PROC_MOUNTINFO);
+	if (!mn->filename)
+		goto err;
+
+	mn->file = fopen(mn->filename, "r");
+	if (!mn->file)
+		goto err;
+
+	mn->tb = mnt_new_table();
+	mn->tb_spare = mnt_new_table();
+	mn->diff = mnt_new_tabdiff();
+	if (!mn->tb || !mn->tb_spare || !mn->diff)
+		goto err;
+
+	/* the tables are parsed again and again, don't allocate all strings */
+	mnt_table_enable_arena(mn->tb, 1);
+	mnt_table_enable_arena(mn->tb_spare, 1);
+
+	if (mnt_table_parse_stream(mn->tb, mn->file, mn->filename))
+		goto err;
+
+	return mn;
+err:
+	mnt_free_monitor(mn);
+	return NULL;
+}
+
+/**
+ * mnt_free_monitor:
+ * @mn: monitor
+ *
+ * Deallocates the monitor, all tables and closes the file.
+ */
+void mnt_free_monitor(struct libmnt_monitor *mn)
+{
+	if (!mn)
+		return;
+
+	DBG(MONITOR, mnt_debug_h(mn, "free"));
+
+	mnt_free_tabdiff(mn->diff);
+	mnt_free_table(mn->tb);
+	mnt_free_table(mn->tb_spare);
+	if (mn->file)
+		fclose(mn->file);
+	free(mn->filename);
+	free(mn);
+}
+
+/**
+ * mnt_monitor_get_fd:
+ * @mn: monitor
+ *
+ * The file descriptor is usable for poll(2) (POLLPRI event) in applications
+ * with their own event loop. Call mnt_monitor_wait() with zero timeout when
+ * the descriptor is ready.
+ *
+ * Returns: file descriptor or negative number in case of error.
+ */
+int mnt_monitor_get_fd(struct libmnt_monitor *mn)
+{
+	assert(mn);
+	return mn && mn->file ? fileno(mn->file) : -EINVAL;
+}
+
+/**
+ * mnt_monitor_get_table:
+ * @mn: monitor
+ *
+ * The table is updated by mnt_monitor_wait(), the entries from the table
+ * are valid until the next mnt_monitor_wait() call.
+ *
+ * Returns: the current table.
+ */
+struct libmnt_table *mnt_monitor_get_table(struct libmnt_monitor *mn)
+{
+	assert(mn);
+	return mn ? mn->tb : NULL;
+}
+
+/**
+ * mnt_monitor_set_debounce:
+ * @mn: monitor
+ * @msec: interval in milliseconds or zero
+ *
+ * The monitor does not update the table until the file is quiet for @msec
+ * milliseconds (but max one second after the first notification). The
+ * default is 50ms, zero disables the debouncing.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_monitor_set_debounce(struct libmnt_monitor *mn, int msec)
+{
+	assert(mn);
+	if (!mn || msec < 0)
+		return -EINVAL;
+	mn->debounce = msec;
+	return 0;
+}
+
+/**
+ * mnt_monitor_set_parser_errcb:
+ * @mn: monitor
+ * @cb: pointer to callback function
+ *
+ * See mnt_table_set_parser_errcb().
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_monitor_set_parser_errcb(struct libmnt_monitor *mn,
+		int (*cb)(struct libmnt_table *tb, const char *filename, int line))
+{
+	assert(mn);
+	if (!mn)
+		return -EINVAL;
+
+	mnt_table_set_parser_errcb(mn->tb, cb);
+	mnt_table_set_parser_errcb(mn->tb_spare, cb);
+	return 0;
+}
+
+/**
+ * mnt_monitor_set_callback:
+ * @mn: monitor
+ * @cb: function called for all changes or NULL
+ * @data: callback private data
+ *
+ * The callback is called by mnt_monitor_wait() for all detected changes. The
+ * arguments are the same as for mnt_tabdiff_next_change(). If the callback
+ * returns non-zero then the next changes are not reported and
+ * mnt_monitor_wait() returns the callback return code.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_monitor_set_callback(struct libmnt_monitor *mn,
+		int (*cb)(struct libmnt_monitor *mn,
+			  struct libmnt_fs *old_fs,
+			  struct libmnt_fs *new_fs,
+			  int oper, void *data),
+		void *data)
+{
+	assert(mn);
+	if (!mn)
+		return -EINVAL;
+	mn->cb = cb;
+	mn->cbdata = data;
+	return 0;
+}
+
+static int monitor_poll(struct libmnt_monitor *mn, int timeout)
+{
+	struct pollfd fds[1];
+	int rc;
+
+	fds[0].fd = fileno(mn->file);
+	fds[0].events = POLLPRI;
+
+	do {
+		rc = poll(fds, 1, timeout);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc < 0 ? -errno : rc;
+}
+
+static int msec_since(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 +
+	       (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * Waits until the file is quiet
+ */
+static void monitor_debounce(struct libmnt_monitor *mn)
+{
+	struct timeval start;
+	int n = 0;
+
+	if (!mn->debounce)
+		return;
+
+	gettimeofday(&start, NULL);
+
+	while (msec_since(&start) + mn->debounce < MNT_MONITOR_MAXDEBOUNCE &&
+	       monitor_poll(mn, mn->debounce) > 0)
+		n++;
+
+	DBG(MONITOR, mnt_debug_h(mn, "%d notifications merged", n));
+}
+
+/*
+ * Parses the file to the spare table, compares it with the current table and
+ * swaps the tables. Returns number of changes.
+ */
+static int monitor_update(struct libmnt_monitor *mn)
+{
+	struct libmnt_table *tmp;
+	int rc;
+
+	/* the old entries are not referenced by the last diff anymore */
+	mnt_reset_table(mn->tb_spare);
+
+	rewind(mn->file);
+	rc = mnt_table_parse_stream(mn->tb_spare, mn->file, mn->filename);
+	if (!rc)
+		rc = mnt_diff_tables(mn->diff, mn->tb, mn->tb_spare);
+	if (rc < 0) {
+		DBG(MONITOR, mnt_debug_h(mn, "update failed [rc=%d]", rc));
+		return rc;
+	}
+
+	tmp = mn->tb;
+	mn->tb = mn->tb_spare;
+	mn->tb_spare = tmp;
+
+	DBG(MONITOR, mnt_debug_h(mn, "%d changes", rc));
+	return rc;
+}
+
+static int monitor_call_cb(struct libmnt_monitor *mn)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *old, *new;
+	int oper, rc = 0;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+
+	while (rc == 0 && mnt_tabdiff_next_change(mn->diff, &itr,
+						  &old, &new, &oper) == 0)
+		rc = mn->cb(mn, old, new, oper, mn->cbdata);
+	return rc;
+}
+
+/**
+ * mnt_monitor_wait:
+ * @mn: monitor
+ * @timeout: timeout in milliseconds, -1 means infinite, 0 non-blocking
+ *
+ * Waits for a change of the monitored file, re-reads the file and compares
+ * it with the previous state. The notifications without real change
+ * (e.g. mount and umount of the same filesystem) are ignored and the function
+ * continues to wait.
+ *
+ * The changes are accessible by mnt_monitor_next_change() until the next
+ * mnt_monitor_wait() call.
+ *
+ * Returns: number of changes, 0 on timeout or negative number in case of
+ * error.
+ */
+int mnt_monitor_wait(struct libmnt_monitor *mn, int timeout)
+{
+	struct timeval start;
+	int rc;
+
+	assert(mn);
+	if (!mn || !mn->file)
+		return -EINVAL;
+
+	gettimeofday(&start, NULL);
+
+	do {
+		int msec = timeout;
+
+		if (timeout > 0) {
+			msec = timeout - msec_since(&start);
+			if (msec < 0)
+				msec = 0;
+		}
+
+		rc = monitor_poll(mn, msec);
+		if (rc <= 0)
+			break;		/* timeout or error */
+
+		monitor_debounce(mn);
+
+		rc = monitor_update(mn);
+		if (rc > 0 && mn->cb) {
+			int x = monitor_call_cb(mn);
+			if (x)
+				return x;
+		}
+	} while (rc == 0 && timeout != 0);
+
+	return rc;
+}
+
+/**
+ * mnt_monitor_next_change:
+ * @mn: monitor
+ * @itr: iterator
+ * @old_fs: returns the old entry or NULL if new entry added
+ * @new_fs: returns the new entry or NULL if old entry removed
+ * @oper: MNT_TABDIFF_{MOVE,UMOUNT,REMOUNT,MOUNT} flags
+ *
+ * Iterates over the changes detected by the last mnt_monitor_wait() call.
+ * See also mnt_tabdiff_next_change().
+ *
+ * Returns: 0 on success, negative number in case of error or 1 at end of list.
+ */
+int mnt_monitor_next_change(struct libmnt_monitor *mn, struct libmnt_iter *itr,
+		struct libmnt_fs **old_fs, struct libmnt_fs **new_fs, int *oper)
+{
+	assert(mn);
+	if (!mn)
+		return -EINVAL;
+	return mnt_tabdiff_next_change(mn->diff, itr, old_fs, new_fs, oper);
+}
+
+#ifdef TEST_PROGRAM
+
+static int print_change(struct libmnt_monitor *mn __attribute__((__unused__)),
+			struct libmnt_fs *old, struct libmnt_fs *new,
+			int oper, void *data __attribute__((__unused__)))
+{
+	printf("%s on %s: ", mnt_fs_get_source(new ? new : old),
+			     mnt_fs_get_target(new ? new : old));
+	switch (oper) {
+	case MNT_TABDIFF_MOVE:
+		printf("MOVED to %s\n", mnt_fs_get_target(new));
+		break;
+	case MNT_TABDIFF_UMOUNT:
+		printf("UMOUNTED\n");
+		break;
+	case MNT_TABDIFF_REMOUNT:
+		printf("REMOUNTED from '%s' to '%s'\n",
+				mnt_fs_get_options(old),
+				mnt_fs_get_options(new));
+		break;
+	case MNT_TABDIFF_MOUNT:
+		printf("MOUNTED\n");
+		break;
+	default:
+		printf("unknown change!\n");
+	}
+	return 0;
+}
+
+int test_wait(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_monitor *mn;
+	int rc, timeout = argc > 1 ? atoi(argv[1]) : -1;
+
+	mn = mnt_new_monitor(argc > 2 ? argv[2] : NULL);
+	if (!mn) {
+		warn("failed to initialize monitor");
+		return -1;
+	}
+	mnt_monitor_set_callback(mn, print_change, NULL);
+
+	while ((rc = mnt_monitor_wait(mn, timeout)) > 0) {
+		printf("--- %d changes\n", rc);
+		fflush(stdout);
+	}
+
+	mnt_free_monitor(mn);
+	return rc < 0 ? rc : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+		{ "--wait", test_wait, "[<timeout> [<file>]] prints changes" },
+		{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+
+#endif /* TEST_PROGRAM */
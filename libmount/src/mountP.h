@@ -47,6 +47,7 @@
 #define MNT_DEBUG_UTILS		(1 << 9)
 #define MNT_DEBUG_CXT		(1 << 10)
 #define MNT_DEBUG_DIFF		(1 << 11)
+#define MNT_DEBUG_MONITOR	(1 << 12)
 #define MNT_DEBUG_ALL		0xFFFF
 
 #ifdef CONFIG_LIBMOUNT_DEBUG
@@ -157,6 +158,10 @@ extern void mnt_free_filesystems(char **filesystems);
 
 extern char *mnt_get_kernel_cmdline_option(const char *name);
 
+/* cache.c */
+extern void mnt_cache_pin(struct libmnt_cache *cache);
+extern void mnt_cache_unpin(struct libmnt_cache *cache);
+
 /* tab.c */
 extern int mnt_table_set_parser_fltrcb(	struct libmnt_table *tb,
 					int (*cb)(struct libmnt_fs *, void *),
@@ -166,6 +171,22 @@ extern struct libmnt_fs *mnt_table_get_fs_root(struct libmnt_table *tb,
                                         struct libmnt_fs *fs,
                                         unsigned long mountflags,
                                         char **fsroot);
+extern int __mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs);
+
+/* tab_index.c */
+extern unsigned int mnt_index_hash_path(const char *path);
+extern unsigned int mnt_index_hash_tag(const char *name, const char *value);
+extern unsigned int mnt_index_hash_num(unsigned long long num);
+extern void mnt_table_reset_index(struct libmnt_table *tb, int canonical);
+extern void mnt_table_index_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs);
+extern void mnt_table_index_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs);
+extern struct libmnt_fs *mnt_table_index_find(struct libmnt_table *tb, int type,
+			unsigned int hash, int direction,
+			int (*match)(struct libmnt_fs *, void *), void *data,
+			struct libmnt_fs *best);
+extern ssize_t mnt_table_index_count(struct libmnt_table *tb, int type);
+extern struct libmnt_fs *mnt_table_find_id(struct libmnt_table *tb, int id);
+
 /*
  * Generic iterator
  */
@@ -193,6 +214,33 @@ struct libmnt_iter {
 	} while(0)
 
 
+/*
+ * Lookup indexes in struct libmnt_table (see tab_index.c)
+ */
+enum {
+	MNT_IDX_TARGET,		/* fs->target */
+	MNT_IDX_CTARGET,	/* canonicalized fs->target */
+	MNT_IDX_SRCPATH,	/* source path (non-tag source) */
+	MNT_IDX_CSRCPATH,	/* canonicalized source path */
+	MNT_IDX_TAG,		/* fs->tagname and fs->tagval */
+	MNT_IDX_DEVNO,		/* fs->devno */
+	MNT_IDX_ID,		/* fs->id */
+
+	MNT_IDX_NR
+};
+
+struct libmnt_index;
+
+/*
+ * Memory for the table strings, see mnt_table_enable_arena()
+ */
+struct libmnt_arena {
+	struct libmnt_arena *next;	/* next arena in the table */
+	char		*data;		/* file content + merged options */
+	size_t		size;		/* allocated size */
+	size_t		used;		/* used bytes */
+};
+
 /*
  * This struct represents one entry in mtab/fstab/mountinfo file.
  * (note that fstab[1] means the first column from fstab, and so on...)
@@ -235,6 +283,13 @@ struct libmnt_fs {
 	pid_t		tid;		/* /proc/<tid>/mountinfo otherwise zero */
 
 	void		*userdata;	/* library independent data */
+
+	struct libmnt_table *tab;	/* table where is the entry linked */
+	unsigned int	seqno;		/* position in the table */
+	struct libmnt_fs *idxnext[MNT_IDX_NR];	/* next entries in index buckets */
+	char		*ctarget;	/* canonicalized target (index key) */
+	char		*csrcpath;	/* canonicalized source path (index key) */
+	struct libmnt_arena *arena;	/* strings owned by the table arena */
 };
 
 /*
@@ -267,6 +322,12 @@ struct libmnt_table {
 
 
 	struct list_head	ents;	/* list of entries (libmnt_fs) */
+
+	unsigned int		seqno;	/* the last used entry seqno */
+	struct libmnt_index	*idx[MNT_IDX_NR];	/* lookup indexes */
+
+	int			use_arena;	/* see mnt_table_enable_arena() */
+	struct libmnt_arena	*arenas;	/* list of the arenas */
 };
 
 extern struct libmnt_table *__mnt_new_table_from_file(const char *filename, int fmt);
@@ -408,6 +469,10 @@ extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			__attribute__((nonnull(1)));
 extern int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 			__attribute__((nonnull(1)));
+extern int mnt_fs_unshare_arena(struct libmnt_fs *fs);
+extern int mnt_merge_optstr_to(char *buf, size_t bufsz,
+			const char *vfs, const char *fs)
+			__attribute__((nonnull));
 
 /* context.c */
 extern int mnt_context_prepare_srcpath(struct libmnt_context *cxt);
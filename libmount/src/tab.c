@@ -86,13 +86,25 @@ int mnt_reset_table(struct libmnt_table *tb)
 
 	DBG(TAB, mnt_debug_h(tb, "reset"));
 
+	mnt_table_reset_index(tb, 0);
+
 	while (!list_empty(&tb->ents)) {
 		struct libmnt_fs *fs = list_entry(tb->ents.next,
 				                  struct libmnt_fs, ents);
 		mnt_free_fs(fs);
 	}
 
+	/* all arena strings are unused now */
+	while (tb->arenas) {
+		struct libmnt_arena *a = tb->arenas;
+
+		tb->arenas = a->next;
+		free(a->data);
+		free(a);
+	}
+
 	tb->nents = 0;
+	tb->seqno = 0;
 	return 0;
 }
 
@@ -146,6 +158,8 @@ int mnt_table_set_cache(struct libmnt_table *tb, struct libmnt_cache *mpc)
 	assert(tb);
 	if (!tb)
 		return -EINVAL;
+	if (tb->cache != mpc)
+		mnt_table_reset_index(tb, 1);
 	tb->cache = mpc;
 	return 0;
 }
@@ -180,10 +194,27 @@ int mnt_table_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 		return -EINVAL;
 
 	list_add_tail(&fs->ents, &tb->ents);
+	fs->tab = tb;
+	fs->seqno = ++tb->seqno;
 
 	DBG(TAB, mnt_debug_h(tb, "add entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
 	tb->nents++;
+
+	mnt_table_index_add_fs(tb, fs);
+	return 0;
+}
+
+/*
+ * Unlinks @fs from the table, the arena strings are not unshared.
+ */
+int __mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
+{
+	mnt_table_index_remove_fs(tb, fs);
+
+	list_del_init(&fs->ents);
+	fs->tab = NULL;
+	tb->nents--;
 	return 0;
 }
 
@@ -201,9 +232,12 @@ int mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	if (!tb || !fs)
 		return -EINVAL;
-	list_del(&fs->ents);
-	tb->nents--;
-	return 0;
+
+	/* the removed entry could live longer than the table arena */
+	if (mnt_fs_unshare_arena(fs))
+		return -ENOMEM;
+
+	return __mnt_table_remove_fs(tb, fs);
 }
 
 /**
@@ -425,6 +459,22 @@ int mnt_table_set_iter(struct libmnt_table *tb, struct libmnt_iter *itr, struct
 	return 0;
 }
 
+static int match_target(struct libmnt_fs *fs, void *path)
+{
+	return mnt_fs_streq_target(fs, (const char *) path);
+}
+
+/* realpath(@path) against realpath(fs->target), see MNT_IDX_CTARGET */
+static int match_ctarget(struct libmnt_fs *fs, void *cn)
+{
+	if (mnt_fs_is_swaparea(fs)
+	    || (*fs->target == '/' && *(fs->target + 1) == '\0'))
+		return 0;
+
+	/* both canonicalized, strcmp() is fine here */
+	return strcmp(fs->ctarget, (const char *) cn) == 0;
+}
+
 /**
  * mnt_table_find_target:
  * @tb: tab pointer
@@ -436,12 +486,14 @@ int mnt_table_set_iter(struct libmnt_table *tb, struct libmnt_iter *itr, struct
  * against realpath(fs->target). The 2nd and 3rd iterations are not performed
  * when @tb cache is not set (see mnt_table_set_cache()).
  *
+ * All the iterations are based on hash indexes, the indexes are built on
+ * demand by the first lookup.
+ *
  * Returns: a tab entry or NULL.
  */
 struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *path, int direction)
 {
-	struct libmnt_iter itr;
-	struct libmnt_fs *fs = NULL;
+	struct libmnt_fs *fs;
 	char *cn;
 
 	assert(tb);
@@ -453,41 +505,81 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, mnt_debug_h(tb, "lookup TARGET: %s", path));
 
 	/* native @target */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, path))
-			return fs;
-	}
-	if (!tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
-		return NULL;
+	fs = mnt_table_index_find(tb, MNT_IDX_TARGET, mnt_index_hash_path(path),
+				  direction, match_target, (void *) path, NULL);
+	if (fs || !tb->cache)
+		return fs;
+
+	/* the CTARGET index resolves more paths, keep @cn valid */
+	mnt_cache_pin(tb->cache);
+
+	cn = mnt_resolve_path(path, tb->cache);
+	if (!cn)
+		goto done;
 
 	/* canonicalized paths in struct libmnt_table */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, cn))
-			return fs;
-	}
+	fs = mnt_table_index_find(tb, MNT_IDX_TARGET, mnt_index_hash_path(cn),
+				  direction, match_target, cn, NULL);
+	if (fs)
+		goto done;
 
 	/* non-canonicaled path in struct libmnt_table
 	 * -- note that mountpoint in /proc/self/mountinfo is already
-	 *    canonicalized by kernel
+	 *    canonicalized by kernel, so kernel entries are not in the index
 	 */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		char *p;
+	fs = mnt_table_index_find(tb, MNT_IDX_CTARGET, mnt_index_hash_path(cn),
+				  direction, match_ctarget, cn, NULL);
+done:
+	mnt_cache_unpin(tb->cache);
+	return fs;
+}
+
+static int match_srcpath(struct libmnt_fs *fs, void *path)
+{
+	return mnt_fs_streq_srcpath(fs, (const char *) path);
+}
 
-		if (!fs->target
-		    || mnt_fs_is_swaparea(fs)
-		    || mnt_fs_is_kernel(fs)
-		    || (*fs->target == '/' && *(fs->target + 1) == '\0'))
-		       continue;
+/* realpath(@path) against realpath(fs source path), see MNT_IDX_CSRCPATH */
+static int match_csrcpath(struct libmnt_fs *fs, void *cn)
+{
+	/* both canonicalized, strcmp() is fine here */
+	return strcmp(fs->csrcpath, (const char *) cn) == 0;
+}
 
-		p = mnt_resolve_path(fs->target, tb->cache);
-		/* both canonicalized, strcmp() is fine here */
-		if (p && strcmp(cn, p) == 0)
-			return fs;
+struct devtag_data {
+	struct libmnt_cache	*cache;
+	const char		*devname;
+};
+
+static int match_devtag(struct libmnt_fs *fs, void *data)
+{
+	struct devtag_data *d = (struct devtag_data *) data;
+
+	return mnt_cache_device_has_tag(d->cache, d->devname,
+					fs->tagname, fs->tagval);
+}
+
+/*
+ * Returns the first entry where the tag is the same as the tag from the
+ * device @cn, the device tags have to be already in the cache.
+ */
+static struct libmnt_fs *find_devtag(struct libmnt_table *tb, const char *cn,
+				     int direction)
+{
+	const char *tags[] = { "LABEL", "UUID", "TYPE", "PARTUUID", "PARTLABEL" };
+	struct devtag_data d = { .cache = tb->cache, .devname = cn };
+	struct libmnt_fs *fs = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(tags); i++) {
+		char *v = mnt_cache_find_tag_value(tb->cache, cn, tags[i]);
+
+		if (v)
+			fs = mnt_table_index_find(tb, MNT_IDX_TAG,
+					mnt_index_hash_tag(tags[i], v),
+					direction, match_devtag, &d, fs);
 	}
-	return NULL;
+	return fs;
 }
 
 /**
@@ -512,52 +604,63 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 {
 	struct libmnt_iter itr;
 	struct libmnt_fs *fs = NULL;
-	int ntags = 0;
+	ssize_t ntags;
 	char *cn;
-	const char *p;
 
 	assert(tb);
 
 	DBG(TAB, mnt_debug_h(tb, "lookup srcpath: %s", path));
 
 	/* native paths */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_srcpath(fs, path))
-			return fs;
-		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
-			ntags++;
+	if (path)
+		fs = mnt_table_index_find(tb, MNT_IDX_SRCPATH,
+				mnt_index_hash_path(path), direction,
+				match_srcpath, (void *) path, NULL);
+	else {
+		/* entries without source path are not indexed */
+		mnt_reset_iter(&itr, direction);
+		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+			if (mnt_fs_streq_srcpath(fs, NULL))
+				return fs;
+		}
+		return NULL;
 	}
+	if (fs)
+		return fs;
 
-	if (!path || !tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
+	if (!tb->cache)
 		return NULL;
 
+	/* the tags evaluation and the CSRCPATH index resolve more paths,
+	 * keep @cn valid */
+	mnt_cache_pin(tb->cache);
+
+	cn = mnt_resolve_path(path, tb->cache);
+	if (!cn)
+		goto done;
+
+	ntags = mnt_table_index_count(tb, MNT_IDX_TAG);
+
 	/* canonicalized paths in struct libmnt_table */
-	if (ntags < mnt_table_get_nents(tb)) {
-		mnt_reset_iter(&itr, direction);
-		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_srcpath(fs, cn))
-				return fs;
-		}
+	if (ntags < (ssize_t) mnt_table_get_nents(tb)) {
+		fs = mnt_table_index_find(tb, MNT_IDX_SRCPATH,
+				mnt_index_hash_path(cn), direction,
+				match_srcpath, cn, NULL);
+		if (fs)
+			goto done;
 	}
 
 	/* evaluated tag */
-	if (ntags) {
+	if (ntags > 0) {
 		int rc = mnt_cache_read_tags(tb->cache, cn);
 
 		mnt_reset_iter(&itr, direction);
 
 		if (rc == 0) {
 			/* @path's TAGs are in the cache */
-			while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-				const char *t, *v;
-
-				if (mnt_fs_get_tag(fs, &t, &v))
-					continue;
-
-				if (mnt_cache_device_has_tag(tb->cache, cn, t, v))
-					return fs;
-			}
+			fs = find_devtag(tb, cn, direction);
+			if (fs)
+				goto done;
 		} else if (rc < 0 && errno == EACCES) {
 			/* @path is unaccessible, try evaluate all TAGs in @tb
 			 * by udev symlinks -- this could be expensive on systems
@@ -570,30 +673,28 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 
 				 /* both canonicalized, strcmp() is fine here */
 				 if (x && strcmp(x, cn) == 0)
-					 return fs;
+					 goto done;
 			 }
 		}
 	}
 
 	/* non-canonicalized paths in struct libmnt_table */
-	if (ntags <= mnt_table_get_nents(tb)) {
-		mnt_reset_iter(&itr, direction);
-		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_is_netfs(fs) || mnt_fs_is_pseudofs(fs))
-				continue;
-			p = mnt_fs_get_srcpath(fs);
-			if (p)
-				p = mnt_resolve_path(p, tb->cache);
+	fs = mnt_table_index_find(tb, MNT_IDX_CSRCPATH,
+				mnt_index_hash_path(cn), direction,
+				match_csrcpath, cn, NULL);
+done:
+	mnt_cache_unpin(tb->cache);
+	return fs;
+}
 
-			/* both canonicalized, strcmp() is fine here */
-			if (p && strcmp(p, cn) == 0)
-				return fs;
-		}
-	}
 
-	return NULL;
-}
+static int match_tag(struct libmnt_fs *fs, void *data)
+{
+	const char **tag = (const char **) data;
 
+	return strcmp(fs->tagname, tag[0]) == 0 &&
+	       strcmp(fs->tagval, tag[1]) == 0;
+}
 
 /**
  * mnt_table_find_tag:
@@ -612,8 +713,8 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 struct libmnt_fs *mnt_table_find_tag(struct libmnt_table *tb, const char *tag,
 			const char *val, int direction)
 {
-	struct libmnt_iter itr;
-	struct libmnt_fs *fs = NULL;
+	struct libmnt_fs *fs;
+	const char *data[] = { tag, val };
 
 	assert(tb);
 	assert(tag);
@@ -625,21 +726,22 @@ struct libmnt_fs *mnt_table_find_tag(struct libmnt_table *tb, const char *tag,
 	DBG(TAB, mnt_debug_h(tb, "lookup by TAG: %s %s", tag, val));
 
 	/* look up by TAG */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (fs->tagname && fs->tagval &&
-		    strcmp(fs->tagname, tag) == 0 &&
-		    strcmp(fs->tagval, val) == 0)
-			return fs;
-	}
+	fs = mnt_table_index_find(tb, MNT_IDX_TAG, mnt_index_hash_tag(tag, val),
+				  direction, match_tag, data, NULL);
+	if (fs)
+		return fs;
 
 	if (tb->cache) {
 		/* look up by device name */
-		char *cn = mnt_resolve_tag(tag, val, tb->cache);
+		char *cn;
+
+		mnt_cache_pin(tb->cache);
+		cn = mnt_resolve_tag(tag, val, tb->cache);
 		if (cn)
-			return mnt_table_find_srcpath(tb, cn, direction);
+			fs = mnt_table_find_srcpath(tb, cn, direction);
+		mnt_cache_unpin(tb->cache);
 	}
-	return NULL;
+	return fs;
 }
 
 /**
@@ -682,6 +784,20 @@ struct libmnt_fs *mnt_table_find_source(struct libmnt_table *tb,
 	return fs;
 }
 
+struct pair_data {
+	const char		*source;
+	const char		*target;
+	struct libmnt_cache	*cache;
+};
+
+static int match_pair(struct libmnt_fs *fs, void *data)
+{
+	struct pair_data *d = (struct pair_data *) data;
+
+	return mnt_fs_match_target(fs, d->target, d->cache) &&
+	       mnt_fs_match_source(fs, d->source, d->cache);
+}
+
 /**
  * mnt_table_find_pair
  * @tb: tab pointer
@@ -691,15 +807,17 @@ struct libmnt_fs *mnt_table_find_source(struct libmnt_table *tb,
  *
  * This function is implemented by mnt_fs_match_source() and
  * mnt_fs_match_target() functions. It means that this is more expensive that
- * others mnt_table_find_* function, because every @tab entry is fully evaluated.
+ * others mnt_table_find_* function, because every @tab entry with matching
+ * target is fully evaluated.
  *
  * Returns: a tab entry or NULL.
  */
 struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *source,
 				      const char *target, int direction)
 {
-	struct libmnt_fs *fs = NULL;
-	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	struct pair_data d = { .source = source, .target = target };
+	char *cn;
 
 	assert(tb);
 	assert(target);
@@ -709,15 +827,34 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 
 	DBG(TAB, mnt_debug_h(tb, "lookup SOURCE: %s TARGET: %s", source, target));
 
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+	d.cache = tb->cache;
 
-		if (mnt_fs_match_target(fs, target, tb->cache) &&
-		    mnt_fs_match_source(fs, source, tb->cache))
-			return fs;
+	/* only entries with matching target are fully evaluated, the
+	 * candidates are @target, realpath(@target) and entries with
+	 * realpath(fs->target) equal to realpath(@target)
+	 */
+	fs = mnt_table_index_find(tb, MNT_IDX_TARGET, mnt_index_hash_path(target),
+				  direction, match_pair, &d, NULL);
+
+	/* match_pair() resolves more paths, keep @cn valid */
+	mnt_cache_pin(tb->cache);
+
+	if (tb->cache && (cn = mnt_resolve_path(target, tb->cache))) {
+		unsigned int hash = mnt_index_hash_path(cn);
+
+		fs = mnt_table_index_find(tb, MNT_IDX_TARGET, hash,
+					  direction, match_pair, &d, fs);
+		fs = mnt_table_index_find(tb, MNT_IDX_CTARGET, hash,
+					  direction, match_pair, &d, fs);
 	}
 
-	return NULL;
+	mnt_cache_unpin(tb->cache);
+	return fs;
+}
+
+static int match_devno(struct libmnt_fs *fs, void *data)
+{
+	return mnt_fs_get_devno(fs) == *((dev_t *) data);
 }
 
 /**
@@ -744,6 +881,12 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 
 	DBG(TAB, mnt_debug_h(tb, "lookup DEVNO: %d", (int) devno));
 
+	if (devno)
+		return mnt_table_index_find(tb, MNT_IDX_DEVNO,
+				mnt_index_hash_num(devno), direction,
+				match_devno, &devno, NULL);
+
+	/* zero devno is not indexed */
 	mnt_reset_iter(&itr, direction);
 
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -940,6 +1083,9 @@ int mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_fs)
 	if (!src)
 		src = mnt_fs_get_source(fstab_fs);
 
+	/* @src and @xtgt are used across more cache lookups */
+	mnt_cache_pin(tb->cache);
+
 	if (src && tb->cache && !mnt_fs_is_pseudofs(fstab_fs))
 		src = mnt_resolve_spec(src, tb->cache);
 
@@ -1002,6 +1148,7 @@ int mnt_table_is_fs_mounted(struct libmnt_table *tb, struct libmnt_fs *fstab_fs)
 	if (fs)
 		rc = 1;		/* success */
 done:
+	mnt_cache_unpin(tb->cache);
 	free(root);
 
 	DBG(TAB, mnt_debug_h(tb, "mnt_table_is_fs_mounted: %s [rc=%d]", src, rc));
@@ -1010,6 +1157,8 @@ done:
 
 #ifdef TEST_PROGRAM
 
+#include <sys/time.h>
+
 static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
 {
 	fprintf(stderr, "%s:%d: parse error\n", filename, line);
@@ -1017,7 +1166,7 @@ static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
 	return 1;	/* all errors are recoverable -- this is default */
 }
 
-struct libmnt_table *create_table(const char *file)
+static struct libmnt_table *__create_table(const char *file, int arena)
 {
 	struct libmnt_table *tb;
 
@@ -1028,6 +1177,7 @@ struct libmnt_table *create_table(const char *file)
 		goto err;
 
 	mnt_table_set_parser_errcb(tb, parser_errcb);
+	mnt_table_enable_arena(tb, arena);
 
 	if (mnt_table_parse_file(tb, file) != 0)
 		goto err;
@@ -1038,6 +1188,11 @@ err:
 	return NULL;
 }
 
+struct libmnt_table *create_table(const char *file)
+{
+	return __create_table(file, 0);
+}
+
 int test_copy_fs(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_table *tb;
@@ -1068,14 +1223,14 @@ done:
 	return rc;
 }
 
-int test_parse(struct libmnt_test *ts, int argc, char *argv[])
+static int __test_parse(const char *file, int arena)
 {
 	struct libmnt_table *tb = NULL;
 	struct libmnt_iter *itr = NULL;
 	struct libmnt_fs *fs;
 	int rc = -1;
 
-	tb = create_table(argv[1]);
+	tb = __create_table(file, arena);
 	if (!tb)
 		return -1;
 
@@ -1092,6 +1247,39 @@ done:
 	return rc;
 }
 
+int test_parse(struct libmnt_test *ts, int argc, char *argv[])
+{
+	return __test_parse(argv[1], 0);
+}
+
+int test_parse_arena(struct libmnt_test *ts, int argc, char *argv[])
+{
+	return __test_parse(argv[1], 1);
+}
+
+int test_parse_bench(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct timeval start, end;
+	int i, arena, loops = argc > 2 ? atoi(argv[2]) : 100;
+
+	for (arena = 0; arena < 2; arena++) {
+		gettimeofday(&start, NULL);
+		for (i = 0; i < loops; i++) {
+			struct libmnt_table *tb = __create_table(argv[1], arena);
+			if (!tb)
+				return -1;
+			mnt_free_table(tb);
+		}
+		gettimeofday(&end, NULL);
+
+		printf("%s: %d loops: %.3f ms\n",
+			arena ? "arena" : "default", loops,
+			(end.tv_sec - start.tv_sec) * 1000.0 +
+			(end.tv_usec - start.tv_usec) / 1000.0);
+	}
+	return 0;
+}
+
 int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 {
 	struct libmnt_table *tb;
@@ -1100,7 +1288,7 @@ int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 	const char *file, *find, *what;
 	int rc = -1;
 
-	if (argc != 4) {
+	if (argc != 4 && argc != 5) {
 		fprintf(stderr, "try --help\n");
 		return -EINVAL;
 	}
@@ -1115,6 +1303,8 @@ int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 	mpc = mnt_new_cache();
 	if (!mpc)
 		goto done;
+	if (argc == 5)
+		mnt_cache_set_maxents(mpc, strtoul(argv[4], NULL, 10));
 	mnt_table_set_cache(tb, mpc);
 
 	if (strcasecmp(find, "source") == 0)
@@ -1157,6 +1347,8 @@ int test_find_pair(struct libmnt_test *ts, int argc, char *argv[])
 	mpc = mnt_new_cache();
 	if (!mpc)
 		goto done;
+	if (argc == 5)
+		mnt_cache_set_maxents(mpc, strtoul(argv[4], NULL, 10));
 	mnt_table_set_cache(tb, mpc);
 
 	fs = mnt_table_find_pair(tb, argv[2], argv[3], MNT_ITER_FORWARD);
@@ -1222,9 +1414,11 @@ int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 	{ "--parse",    test_parse,        "<file>  parse and print tab" },
-	{ "--find-forward",  test_find_fw, "<file> <source|target> <string>" },
-	{ "--find-backward", test_find_bw, "<file> <source|target> <string>" },
-	{ "--find-pair",     test_find_pair, "<file> <source> <target>" },
+	{ "--parse-arena", test_parse_arena, "<file>  parse and print tab in arena mode" },
+	{ "--parse-bench", test_parse_bench, "<file> [<loops>]  compare parser modes" },
+	{ "--find-forward",  test_find_fw, "<file> <source|target> <string> [<maxents>]" },
+	{ "--find-backward", test_find_bw, "<file> <source|target> <string> [<maxents>]" },
+	{ "--find-pair",     test_find_pair, "<file> <source> <target> [<maxents>]" },
 	{ "--copy-fs",       test_copy_fs, "<file>  copy root FS from the file" },
 	{ "--is-mounted",    test_is_mounted, "<fstab> check what from <file> are already mounted" },
 	{ NULL }
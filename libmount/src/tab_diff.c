@@ -19,6 +19,8 @@ struct tabdiff_entry {
 	struct libmnt_fs *new_fs;	/* pointer to the new FS */
 
 	struct list_head changes;
+
+	struct tabdiff_entry *next;	/* next MOUNT entry in the same bucket */
 };
 
 struct libmnt_tabdiff {
@@ -26,6 +28,10 @@ struct libmnt_tabdiff {
 
 	struct list_head changes;	/* list with modified entries */
 	struct list_head unused;	/* list with unuused entries */
+
+	/* hash (mount ID and source) of the newly mounted entries */
+	struct tabdiff_entry	**mounts;
+	size_t			nbuckets;	/* power of 2 */
 };
 
 /**
@@ -75,7 +81,13 @@ void mnt_free_tabdiff(struct libmnt_tabdiff *df)
 			                  struct tabdiff_entry, changes);
 		free_tabdiff_entry(de);
 	}
+	while (!list_empty(&df->unused)) {
+		struct tabdiff_entry *de = list_entry(df->unused.next,
+			                  struct tabdiff_entry, changes);
+		free_tabdiff_entry(de);
+	}
 
+	free(df->mounts);
 	free(df);
 }
 
@@ -120,8 +132,10 @@ int mnt_tabdiff_next_change(struct libmnt_tabdiff *df, struct libmnt_iter *itr,
 	return rc;
 }
 
-static int tabdiff_reset(struct libmnt_tabdiff *df)
+static int tabdiff_reset(struct libmnt_tabdiff *df, size_t nents)
 {
+	size_t nbuckets = 64;
+
 	assert(df);
 
 	DBG(DIFF, mnt_debug_h(df, "reseting"));
@@ -136,15 +150,38 @@ static int tabdiff_reset(struct libmnt_tabdiff *df)
 		list_add_tail(&de->changes, &df->unused);
 
 		de->new_fs = de->old_fs = NULL;
+		de->next = NULL;
 		de->oper = 0;
 	}
 
 	df->nchanges = 0;
+
+	while (nbuckets < nents)
+		nbuckets <<= 1;
+
+	if (nbuckets > df->nbuckets) {
+		struct tabdiff_entry **x = realloc(df->mounts,
+					nbuckets * sizeof(struct tabdiff_entry *));
+		if (!x)
+			return -ENOMEM;
+		df->mounts = x;
+		df->nbuckets = nbuckets;
+	}
+	memset(df->mounts, 0, df->nbuckets * sizeof(struct tabdiff_entry *));
 	return 0;
 }
 
-static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
-			     struct libmnt_fs *new, int oper)
+static unsigned int tabdiff_hash(const char *src, int id)
+{
+	unsigned int h = mnt_index_hash_num(id);
+
+	if (src)
+		h ^= mnt_index_hash_path(src);
+	return h;
+}
+
+static struct tabdiff_entry *tabdiff_add_entry(struct libmnt_tabdiff *df,
+			struct libmnt_fs *old, struct libmnt_fs *new, int oper)
 {
 	struct tabdiff_entry *de;
 
@@ -159,7 +196,7 @@ static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
 	} else {
 		de = calloc(1, sizeof(*de));
 		if (!de)
-			return -ENOMEM;
+			return NULL;
 	}
 
 	INIT_LIST_HEAD(&de->changes);
@@ -170,31 +207,57 @@ static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
 
 	list_add_tail(&de->changes, &df->changes);
 	df->nchanges++;
-	return 0;
+	return de;
+}
+
+/*
+ * Adds all MOUNT entries to the hash. The buckets keep the order of the
+ * changes list, so tabdiff_get_mount() returns the first matching entry.
+ */
+static void tabdiff_hash_mounts(struct libmnt_tabdiff *df)
+{
+	struct list_head *p;
+
+	list_for_each_backwardly(p, &df->changes) {
+		struct tabdiff_entry *de, **b;
+
+		de = list_entry(p, struct tabdiff_entry, changes);
+		if (de->oper != MNT_TABDIFF_MOUNT)
+			continue;
+
+		b = &df->mounts[tabdiff_hash(mnt_fs_get_source(de->new_fs),
+				mnt_fs_get_id(de->new_fs)) & (df->nbuckets - 1)];
+		de->next = *b;
+		*b = de;
+	}
 }
 
+/*
+ * Returns the first MOUNT entry with the same mount ID and source and removes
+ * the entry from the hash.
+ */
 static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
 					       const char *src,
 					       int id)
 {
-	struct list_head *p;
+	struct tabdiff_entry **b;
 
 	assert(df);
 
-	list_for_each(p, &df->changes) {
-		struct tabdiff_entry *de;
+	b = &df->mounts[tabdiff_hash(src, id) & (df->nbuckets - 1)];
 
-		de = list_entry(p, struct tabdiff_entry, changes);
-
-		if (de->oper == MNT_TABDIFF_MOUNT && de->new_fs &&
-		    mnt_fs_get_id(de->new_fs) == id) {
+	for (; *b; b = &(*b)->next) {
+		struct tabdiff_entry *de = *b;
 
+		if (mnt_fs_get_id(de->new_fs) == id) {
 			const char *s = mnt_fs_get_source(de->new_fs);
 
-			if (s == NULL && src == NULL)
-				return de;
-			if (s && src && strcmp(s, src) == 0)
+			if ((s == NULL && src == NULL) ||
+			    (s && src && strcmp(s, src) == 0)) {
+				*b = de->next;
+				de->next = NULL;
 				return de;
+			}
 		}
 	}
 	return NULL;
@@ -209,6 +272,11 @@ static struct tabdiff_entry *tabdiff_get_mount(struct libmnt_tabdiff *df,
  * Compares @old_tab and @new_tab, the result is stored in @df and accessible by
  * mnt_tabdiff_next_change().
  *
+ * The entries are matched by source and target (see mnt_table_find_pair()),
+ * the moved filesystems are detected by mount ID and source. All the lookups
+ * are based on hash indexes, so the function is linear to the number of the
+ * entries.
+ *
  * Returns: number of changes, negative number in case of error.
  */
 int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
@@ -216,16 +284,18 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 {
 	struct libmnt_fs *fs;
 	struct libmnt_iter itr;
-	int no, nn;
+	int no, nn, rc;
 
 	if (!df || !old_tab || !new_tab)
 		return -EINVAL;
 
-	tabdiff_reset(df);
-
 	no = mnt_table_get_nents(old_tab);
 	nn = mnt_table_get_nents(new_tab);
 
+	rc = tabdiff_reset(df, nn);
+	if (rc)
+		return rc;
+
 	if (!no && !nn)			/* both tables are empty */
 		return 0;
 
@@ -237,13 +307,17 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 
 	/* all mounted or umounted */
 	if (!no && nn) {
-		while(mnt_table_next_fs(new_tab, &itr, &fs) == 0)
-			tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
+		while(mnt_table_next_fs(new_tab, &itr, &fs) == 0) {
+			if (!tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT))
+				return -ENOMEM;
+		}
 		goto done;
 
 	} else if (no && !nn) {
-		while(mnt_table_next_fs(old_tab, &itr, &fs) == 0)
-			tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+		while(mnt_table_next_fs(old_tab, &itr, &fs) == 0) {
+			if (!tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT))
+				return -ENOMEM;
+		}
 		goto done;
 	}
 
@@ -254,22 +328,26 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 			   *tgt = mnt_fs_get_target(fs);
 
 		o_fs = mnt_table_find_pair(old_tab, src, tgt, MNT_ITER_FORWARD);
-		if (!o_fs)
+		if (!o_fs) {
 			/* 'fs' is not in the old table -- so newly mounted */
-			tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
-		else {
+			if (!tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT))
+				return -ENOMEM;
+		} else {
 			/* is modified? */
 			const char *v1 = mnt_fs_get_vfs_options(o_fs),
 				   *v2 = mnt_fs_get_vfs_options(fs),
 				   *f1 = mnt_fs_get_fs_options(o_fs),
 				   *f2 = mnt_fs_get_fs_options(fs);
 
-			if ((v1 && v2 && strcmp(v1, v2)) || (f1 && f2 && strcmp(f1, f2)))
-				tabdiff_add_entry(df, o_fs, fs, MNT_TABDIFF_REMOUNT);
+			if (((v1 && v2 && strcmp(v1, v2)) || (f1 && f2 && strcmp(f1, f2)))
+			    && !tabdiff_add_entry(df, o_fs, fs, MNT_TABDIFF_REMOUNT))
+				return -ENOMEM;
 		}
 	}
 
 	/* search umounted or moved */
+	tabdiff_hash_mounts(df);
+
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while(mnt_table_next_fs(old_tab, &itr, &fs) == 0) {
 		const char *src = mnt_fs_get_source(fs),
@@ -282,8 +360,8 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 			if (de) {
 				de->oper = MNT_TABDIFF_MOVE;
 				de->old_fs = fs;
-			} else
-				tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+			} else if (!tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT))
+				return -ENOMEM;
 		}
 	}
 done:
@@ -293,6 +371,8 @@ done:
 
 #ifdef TEST_PROGRAM
 
+#include <sys/time.h>
+
 int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_table *tb_old = NULL, *tb_new = NULL;
@@ -349,10 +429,116 @@ done:
 	return rc;
 }
 
+static struct libmnt_fs *bench_new_fs(int id, const char *source,
+				       const char *target, const char *vfsopts)
+{
+	struct libmnt_fs *fs = mnt_new_fs();
+
+	if (!fs)
+		err(EXIT_FAILURE, "failed to allocate fs");
+
+	fs->id = id;
+	fs->parent = 1;
+	fs->devno = makedev(0, id);
+	fs->flags |= MNT_FS_KERNEL;
+
+	if (mnt_fs_set_source(fs, source) ||
+	    mnt_fs_set_target(fs, target) ||
+	    mnt_fs_set_fstype(fs, "ext4") ||
+	    mnt_fs_set_root(fs, "/") ||
+	    !(fs->vfs_optstr = strdup(vfsopts)) ||
+	    !(fs->fs_optstr = strdup("rw,data=ordered")))
+		err(EXIT_FAILURE, "failed to set fs");
+	return fs;
+}
+
+/*
+ * Generates two mountinfo-like tables with @nents entries, 1/10 of the
+ * entries is umounted, moved, remounted and newly mounted.
+ */
+int test_bench(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb_old, *tb_new;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_iter *itr;
+	struct timeval start, end;
+	int i, nents, rc, change, nchg[MNT_TABDIFF_REMOUNT + 1] = { 0 };
+
+	nents = argc > 1 ? atoi(argv[1]) : 100000;
+	if (nents <= 0)
+		return -EINVAL;
+
+	tb_old = mnt_new_table();
+	tb_new = mnt_new_table();
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!tb_old || !tb_new || !diff || !itr)
+		err(EXIT_FAILURE, "failed to allocate resources");
+
+	for (i = 0; i < nents; i++) {
+		char src[32], tgt[64];
+		int id = i + 2;
+
+		snprintf(src, sizeof(src), "/dev/sd%d", id);
+		snprintf(tgt, sizeof(tgt), "/mnt/bench/%d", id);
+
+		mnt_table_add_fs(tb_old, bench_new_fs(id, src, tgt, "rw,relatime"));
+
+		switch (i % 10) {
+		case 0:		/* umounted */
+			break;
+		case 1:		/* remounted */
+			mnt_table_add_fs(tb_new, bench_new_fs(id, src, tgt, "ro,relatime"));
+			break;
+		case 2:		/* moved */
+			snprintf(tgt, sizeof(tgt), "/mnt/moved/%d", id);
+			mnt_table_add_fs(tb_new, bench_new_fs(id, src, tgt, "rw,relatime"));
+			break;
+		case 3:		/* unchanged + newly mounted */
+			mnt_table_add_fs(tb_new, bench_new_fs(id, src, tgt, "rw,relatime"));
+			snprintf(src, sizeof(src), "/dev/vd%d", id);
+			snprintf(tgt, sizeof(tgt), "/mnt/new/%d", id);
+			mnt_table_add_fs(tb_new, bench_new_fs(id + nents, src, tgt, "rw"));
+			break;
+		default:	/* unchanged */
+			mnt_table_add_fs(tb_new, bench_new_fs(id, src, tgt, "rw,relatime"));
+			break;
+		}
+	}
+
+	gettimeofday(&start, NULL);
+	rc = mnt_diff_tables(diff, tb_old, tb_new);
+	gettimeofday(&end, NULL);
+
+	if (rc < 0)
+		goto done;
+
+	while (mnt_tabdiff_next_change(diff, itr, NULL, NULL, &change) == 0) {
+		if (change > 0 && change <= MNT_TABDIFF_REMOUNT)
+			nchg[change]++;
+	}
+
+	printf("old=%d new=%d changes=%d: mount=%d umount=%d move=%d remount=%d\n",
+			mnt_table_get_nents(tb_old), mnt_table_get_nents(tb_new), rc,
+			nchg[MNT_TABDIFF_MOUNT], nchg[MNT_TABDIFF_UMOUNT],
+			nchg[MNT_TABDIFF_MOVE], nchg[MNT_TABDIFF_REMOUNT]);
+	fprintf(stderr, "diff time: %.3f ms\n",
+			(end.tv_sec - start.tv_sec) * 1000.0 +
+			(end.tv_usec - start.tv_usec) / 1000.0);
+	rc = 0;
+done:
+	mnt_free_table(tb_old);
+	mnt_free_table(tb_new);
+	mnt_free_tabdiff(diff);
+	mnt_free_iter(itr);
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 		{ "--diff", test_diff, "<old> <new> prints change" },
+		{ "--bench", test_bench, "[<nentries>] diff generated tables" },
 		{ NULL }
 	};
 
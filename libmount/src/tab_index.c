@@ -0,0 +1,378 @@
+/*
+ * tab_index.c - hash indexes for libmount tables
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/*
+ * Hash indexes for mnt_table_find_*() functions.
+ *
+ * The indexes are built on demand by the first lookup and then kept in sync
+ * by mnt_table_add_fs() and mnt_table_remove_fs(). The entries are linked into
+ * the buckets by fs->idxnext[], so the index does not allocate any memory per
+ * entry. The original order of the entries in the table is described by
+ * fs->seqno, the lookup returns the first matching entry according to the
+ * iterator direction.
+ *
+ * The canonicalized indexes (MNT_IDX_C*) are available only if the table cache
+ * is defined, the canonicalized paths are stored in the fs struct.
+ *
+ * Any change to the indexed fs fields (target, source, ...) resets all indexes
+ * in the table.
+ */
+#include "mountP.h"
+
+struct libmnt_index {
+	size_t		nents;		/* number of indexed entries */
+	size_t		nbuckets;	/* power of 2 */
+	struct libmnt_fs *buckets[];
+};
+
+#define MNT_INDEX_MINBUCKETS	64
+
+/* FNV-1a, one trailing slash is ignored (see streq_except_trailing_slash()) */
+static unsigned int hash_mem(unsigned int h, const char *s, size_t len)
+{
+	while (len--) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+unsigned int mnt_index_hash_path(const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len && path[len - 1] == '/')
+		len--;
+	return hash_mem(2166136261U, path, len);
+}
+
+unsigned int mnt_index_hash_tag(const char *name, const char *value)
+{
+	unsigned int h = hash_mem(2166136261U, name, strlen(name));
+
+	h = hash_mem(h, "=", 1);
+	return hash_mem(h, value, strlen(value));
+}
+
+unsigned int mnt_index_hash_num(unsigned long long num)
+{
+	return hash_mem(2166136261U, (char *) &num, sizeof(num));
+}
+
+static int is_canonical_index(int type)
+{
+	return type == MNT_IDX_CTARGET || type == MNT_IDX_CSRCPATH;
+}
+
+/*
+ * Sets the canonicalized keys for @fs, returns non-zero if the key is not
+ * available (the entry is not indexed).
+ */
+static int fs_canonicalize_key(struct libmnt_table *tb, struct libmnt_fs *fs, int type)
+{
+	const char *p;
+	char *cn;
+
+	if (type == MNT_IDX_CTARGET) {
+		if (fs->ctarget)
+			return 0;
+		p = fs->target;
+		if (!p || mnt_fs_is_kernel(fs))
+			return 1;
+	} else {
+		if (fs->csrcpath)
+			return 0;
+		p = mnt_fs_get_srcpath(fs);
+		if (!p || mnt_fs_is_netfs(fs) || mnt_fs_is_pseudofs(fs))
+			return 1;
+	}
+
+	cn = mnt_resolve_path(p, tb->cache);
+	if (!cn)
+		return 1;
+
+	/* the cache is not required to live longer than the table, use copy */
+	cn = strdup(cn);
+	if (!cn)
+		return 1;
+
+	if (type == MNT_IDX_CTARGET)
+		fs->ctarget = cn;
+	else
+		fs->csrcpath = cn;
+	return 0;
+}
+
+/*
+ * Returns 0 and @hash for indexed entries or 1 if the entry does not belong to
+ * the index.
+ */
+static int fs_key_hash(struct libmnt_fs *fs, int type, unsigned int *hash)
+{
+	const char *p = NULL;
+
+	switch (type) {
+	case MNT_IDX_TARGET:
+		p = fs->target;
+		break;
+	case MNT_IDX_CTARGET:
+		p = fs->ctarget;
+		break;
+	case MNT_IDX_SRCPATH:
+		p = mnt_fs_get_srcpath(fs);
+		break;
+	case MNT_IDX_CSRCPATH:
+		p = fs->csrcpath;
+		break;
+	case MNT_IDX_TAG:
+		if (!fs->tagname || !fs->tagval)
+			return 1;
+		*hash = mnt_index_hash_tag(fs->tagname, fs->tagval);
+		return 0;
+	case MNT_IDX_DEVNO:
+		if (!fs->devno)
+			return 1;
+		*hash = mnt_index_hash_num(fs->devno);
+		return 0;
+	case MNT_IDX_ID:
+		if (fs->id <= 0)
+			return 1;
+		*hash = mnt_index_hash_num(fs->id);
+		return 0;
+	}
+
+	if (!p)
+		return 1;
+	*hash = mnt_index_hash_path(p);
+	return 0;
+}
+
+static void index_add_fs(struct libmnt_index *idx, struct libmnt_fs *fs,
+			 unsigned int hash, int type)
+{
+	struct libmnt_fs **b = &idx->buckets[hash & (idx->nbuckets - 1)];
+
+	fs->idxnext[type] = *b;
+	*b = fs;
+	idx->nents++;
+}
+
+static void index_remove_fs(struct libmnt_index *idx, struct libmnt_fs *fs,
+			    unsigned int hash, int type)
+{
+	struct libmnt_fs **p = &idx->buckets[hash & (idx->nbuckets - 1)];
+
+	for (; *p; p = &(*p)->idxnext[type]) {
+		if (*p == fs) {
+			*p = fs->idxnext[type];
+			fs->idxnext[type] = NULL;
+			idx->nents--;
+			break;
+		}
+	}
+}
+
+static void free_index(struct libmnt_table *tb, int type)
+{
+	struct libmnt_index *idx = tb->idx[type];
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	if (!idx)
+		return;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		fs->idxnext[type] = NULL;
+
+		if (type == MNT_IDX_CTARGET) {
+			free(fs->ctarget);
+			fs->ctarget = NULL;
+		} else if (type == MNT_IDX_CSRCPATH) {
+			free(fs->csrcpath);
+			fs->csrcpath = NULL;
+		}
+	}
+
+	free(idx);
+	tb->idx[type] = NULL;
+}
+
+/*
+ * Deallocates all indexes, or canonicalized indexes only if @canonical is
+ * non-zero (e.g. the table cache has been changed).
+ */
+void mnt_table_reset_index(struct libmnt_table *tb, int canonical)
+{
+	int i;
+
+	assert(tb);
+
+	for (i = 0; i < MNT_IDX_NR; i++) {
+		if (tb->idx[i] && (!canonical || is_canonical_index(i))) {
+			DBG(TAB, mnt_debug_h(tb, "reset index %d", i));
+			free_index(tb, i);
+		}
+	}
+}
+
+static struct libmnt_index *build_index(struct libmnt_table *tb, int type)
+{
+	struct libmnt_index *idx;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	size_t nbuckets = MNT_INDEX_MINBUCKETS;
+
+	if (is_canonical_index(type) && !tb->cache)
+		return NULL;
+
+	while (nbuckets < (size_t) tb->nents)
+		nbuckets <<= 1;
+
+	idx = calloc(1, sizeof(*idx) + nbuckets * sizeof(struct libmnt_fs *));
+	if (!idx)
+		return NULL;
+	idx->nbuckets = nbuckets;
+
+	DBG(TAB, mnt_debug_h(tb, "building index %d [buckets=%zu]", type, nbuckets));
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		unsigned int hash;
+
+		fs->idxnext[type] = NULL;
+		if (is_canonical_index(type) && fs_canonicalize_key(tb, fs, type))
+			continue;
+		if (fs_key_hash(fs, type, &hash) == 0)
+			index_add_fs(idx, fs, hash, type);
+	}
+
+	tb->idx[type] = idx;
+	return idx;
+}
+
+static struct libmnt_index *get_index(struct libmnt_table *tb, int type)
+{
+	if (tb->idx[type])
+		return tb->idx[type];
+	return build_index(tb, type);
+}
+
+/*
+ * Called by mnt_table_add_fs() when @fs is already in the table.
+ */
+void mnt_table_index_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
+{
+	int i;
+
+	for (i = 0; i < MNT_IDX_NR; i++) {
+		struct libmnt_index *idx = tb->idx[i];
+		unsigned int hash;
+
+		if (!idx)
+			continue;
+		if (idx->nents >= 2 * idx->nbuckets) {
+			/* too many collisions, rebuild on the next lookup */
+			free_index(tb, i);
+			continue;
+		}
+		if (is_canonical_index(i) && fs_canonicalize_key(tb, fs, i))
+			continue;
+		if (fs_key_hash(fs, i, &hash) == 0)
+			index_add_fs(idx, fs, hash, i);
+	}
+}
+
+/*
+ * Called by mnt_table_remove_fs() when @fs is still in the table.
+ */
+void mnt_table_index_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
+{
+	int i;
+
+	for (i = 0; i < MNT_IDX_NR; i++) {
+		struct libmnt_index *idx = tb->idx[i];
+		unsigned int hash;
+
+		if (idx && fs_key_hash(fs, i, &hash) == 0)
+			index_remove_fs(idx, fs, hash, i);
+		fs->idxnext[i] = NULL;
+	}
+
+	free(fs->ctarget);
+	free(fs->csrcpath);
+	fs->ctarget = fs->csrcpath = NULL;
+}
+
+/*
+ * Returns the first entry (according to @direction) from the @type index with
+ * the key @hash and for which @match() returns non-zero. The @match() is
+ * required, the hash is not unique.
+ *
+ * The @best is a result from a previous lookup (or NULL), it's returned if no
+ * better entry is found. This allows to search in more indexes.
+ */
+struct libmnt_fs *mnt_table_index_find(struct libmnt_table *tb, int type,
+			unsigned int hash, int direction,
+			int (*match)(struct libmnt_fs *, void *), void *data,
+			struct libmnt_fs *best)
+{
+	struct libmnt_index *idx;
+	struct libmnt_fs *fs;
+
+	assert(tb);
+	assert(match);
+
+	idx = get_index(tb, type);
+	if (!idx)
+		return best;
+
+	for (fs = idx->buckets[hash & (idx->nbuckets - 1)]; fs;
+	     fs = fs->idxnext[type]) {
+
+		if (best && (direction == MNT_ITER_FORWARD ?
+				fs->seqno > best->seqno :
+				fs->seqno < best->seqno))
+			continue;
+		if (match(fs, data))
+			best = fs;
+	}
+
+	return best;
+}
+
+/*
+ * Returns number of entries in the index or a negative number if the index is
+ * not available.
+ */
+ssize_t mnt_table_index_count(struct libmnt_table *tb, int type)
+{
+	struct libmnt_index *idx = get_index(tb, type);
+
+	return idx ? (ssize_t) idx->nents : -1;
+}
+
+static int match_id(struct libmnt_fs *fs, void *data)
+{
+	return fs->id == *((int *) data);
+}
+
+/*
+ * Returns entry with mount @id (mountinfo only).
+ *
+ * Don't export to library API!
+ */
+struct libmnt_fs *mnt_table_find_id(struct libmnt_table *tb, int id)
+{
+	assert(tb);
+
+	if (!tb || id <= 0)
+		return NULL;
+
+	return mnt_table_index_find(tb, MNT_IDX_ID, mnt_index_hash_num(id),
+			MNT_ITER_FORWARD, match_id, &id, NULL);
+}
@@ -206,6 +206,121 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, char *s)
 	return rc;
 }
 
+/*
+ * Returns the next word terminated in-place, the word is unmangled only if
+ * it contains any escape sequence.
+ */
+static char *next_word(char **s)
+{
+	char *p = skip_spaces(*s), *word = p;
+	int mangled = 0;
+
+	if (!*p)
+		return NULL;
+	for (; *p && *p != ' ' && *p != '\t'; p++) {
+		if (*p == '\\')
+			mangled = 1;
+	}
+	if (*p)
+		*p++ = '\0';
+	*s = p;
+
+	if (mangled)
+		unmangle_string(word);
+	return word;
+}
+
+static char *arena_alloc(struct libmnt_arena *a, size_t sz)
+{
+	char *p;
+
+	if (a->size - a->used < sz)
+		return NULL;
+	p = a->data + a->used;
+	a->used += sz;
+	return p;
+}
+
+/*
+ * Parses one line from mountinfo file in the arena mode. The line is modified
+ * and all strings are slices of the line or allocated in the @arena.
+ */
+static int mnt_parse_mountinfo_line_arena(struct libmnt_fs *fs, char *s,
+					  struct libmnt_arena *arena)
+{
+	int rc;
+	unsigned int maj, min;
+	char *fstype, *src, *p, *end = NULL;
+	size_t sz;
+
+	fs->arena = arena;
+
+	/* (1) id, (2) parent */
+	if (next_number(&s, &fs->id) || next_number(&s, &fs->parent))
+		goto err;
+
+	/* (3) maj:min */
+	s = skip_spaces(s);
+	maj = strtoul(s, &end, 10);
+	if (!end || end == s || *end != ':')
+		goto err;
+	s = end + 1;
+	min = strtoul(s, &end, 10);
+	if (!end || end == s)
+		goto err;
+	s = end;
+
+	fs->root = next_word(&s);		/* (4) mountroot */
+	fs->target = next_word(&s);		/* (5) target */
+	fs->vfs_optstr = next_word(&s);		/* (6) vfs options */
+	if (!fs->vfs_optstr)
+		goto err;
+
+	/* (7) optional fields, terminated by " - " */
+	if (*s == '-' && *(s + 1) == ' ')
+		s += 2;
+	else {
+		p = strstr(s, " - ");
+		if (!p) {
+			DBG(TAB, mnt_debug("mountinfo parse error: not found separator"));
+			return -EINVAL;
+		}
+		*p = '\0';
+		if (p > s)
+			fs->opt_fields = s;
+		s = p + 3;
+	}
+
+	fstype = next_word(&s);			/* (8) FS type */
+	src = next_word(&s);			/* (9) source */
+	fs->fs_optstr = next_word(&s);		/* (10) fs options */
+	if (!fs->fs_optstr)
+		goto err;
+
+	fs->flags |= MNT_FS_KERNEL;
+	fs->devno = makedev(maj, min);
+
+	rc = __mnt_fs_set_fstype_ptr(fs, fstype);
+	if (!rc)
+		rc = __mnt_fs_set_source_ptr(fs, src);
+	if (rc)
+		return rc;
+
+	/* merge VFS and FS options to the one string */
+	sz = strlen(fs->vfs_optstr) + strlen(fs->fs_optstr) + 5;
+	p = arena_alloc(arena, sz);
+	if (p && mnt_merge_optstr_to(p, sz, fs->vfs_optstr, fs->fs_optstr) == 0)
+		fs->optstr = p;
+	else
+		fs->optstr = mnt_fs_strdup_options(fs);
+	if (!fs->optstr)
+		return -ENOMEM;
+	return 0;
+err:
+	DBG(TAB, mnt_debug("mountinfo parse error: '%s'", s));
+	return -EINVAL;
+}
+
 /*
  * Parses one line from utab file
  */
@@ -344,6 +459,63 @@ static int guess_table_format(char *line)
 	return MNT_FMT_FSTAB;		/* fstab, mtab or /proc/mounts */
 }
 
+static int mnt_table_parse_error(struct libmnt_table *tb,
+				 const char *filename, int nlines)
+{
+	DBG(TAB, mnt_debug_h(tb, "%s:%d: %s parse error", filename, nlines,
+				tb->fmt == MNT_FMT_MOUNTINFO ? "mountinfo" :
+				tb->fmt == MNT_FMT_SWAPS ? "swaps" :
+				tb->fmt == MNT_FMT_FSTAB ? "tab" : "utab"));
+
+	/* by default all errors are recoverable, otherwise behavior depends on
+	 * errcb() function. See mnt_table_set_parser_errcb().
+	 */
+	return tb->errcb ? tb->errcb(tb, filename, nlines) : 1;
+}
+
+/*
+ * Parses non-blank non-comment line, returns 0 on success, 1 if the line has
+ * to be ignored (e.g. swaps header) or errcb() result on parse error.
+ */
+static int mnt_table_parse_line(struct libmnt_table *tb, struct libmnt_fs *fs,
+				char *s, struct libmnt_arena *arena,
+				const char *filename, int nlines)
+{
+	int rc;
+
+	if (tb->fmt == MNT_FMT_GUESS) {
+		tb->fmt = guess_table_format(s);
+		if (tb->fmt == MNT_FMT_SWAPS)
+			return 1;			/* skip swap header */
+	}
+
+	switch (tb->fmt) {
+	case MNT_FMT_FSTAB:
+		rc = mnt_parse_table_line(fs, s);
+		break;
+	case MNT_FMT_MOUNTINFO:
+		rc = arena ? mnt_parse_mountinfo_line_arena(fs, s, arena) :
+			     mnt_parse_mountinfo_line(fs, s);
+		break;
+	case MNT_FMT_UTAB:
+		rc = mnt_parse_utab_line(fs, s);
+		break;
+	case MNT_FMT_SWAPS:
+		if (strncmp(s, "Filename\t", 9) == 0)
+			return 1;			/* skip swap header */
+		rc = mnt_parse_swaps_line(fs, s);
+		break;
+	default:
+		rc = -1;	/* unknown format */
+		break;
+	}
+
+	if (rc == 0)
+		return 0;
+
+	return mnt_table_parse_error(tb, filename, nlines);
+}
+
 /*
  * Read and parse the next line from {fs,m}tab or mountinfo
  */
@@ -352,14 +524,12 @@ static int mnt_table_parse_next(struct libmnt_table *tb, FILE *f, struct libmnt_
 {
 	char buf[BUFSIZ];
 	char *s;
-	int rc;
 
 	assert(tb);
 	assert(f);
 	assert(fs);
 
 	/* read the next non-blank non-comment line */
-next_line:
 	do {
 		if (fgets(buf, sizeof(buf), f) == NULL)
 			return -EINVAL;
@@ -376,7 +546,7 @@ next_line:
 				DBG(TAB, mnt_debug_h(tb,
 					"%s:%d: missing newline at line",
 					filename, *nlines));
-				goto err;
+				return mnt_table_parse_error(tb, filename, *nlines);
 			}
 		}
 		*s = '\0';
@@ -385,44 +555,100 @@ next_line:
 		s = skip_spaces(buf);
 	} while (*s == '\0' || *s == '#');
 
-	if (tb->fmt == MNT_FMT_GUESS) {
-		tb->fmt = guess_table_format(s);
-		if (tb->fmt == MNT_FMT_SWAPS)
-			goto next_line;			/* skip swap header */
-	}
+	return mnt_table_parse_line(tb, fs, s, NULL, filename, *nlines);
+}
 
-	switch (tb->fmt) {
-	case MNT_FMT_FSTAB:
-		rc = mnt_parse_table_line(fs, s);
-		break;
-	case MNT_FMT_MOUNTINFO:
-		rc = mnt_parse_mountinfo_line(fs, s);
-		break;
-	case MNT_FMT_UTAB:
-		rc = mnt_parse_utab_line(fs, s);
-		break;
-	case MNT_FMT_SWAPS:
-		if (strncmp(s, "Filename\t", 9) == 0)
-			goto next_line;			/* skip swap header */
-		rc = mnt_parse_swaps_line(fs, s);
-		break;
-	default:
-		rc = -1;	/* unknown format */
-		break;
+/*
+ * Arena mode, see mnt_table_enable_arena(). Reads whole @f to the one buffer,
+ * the buffer is extended to have space for the merged mount options.
+ */
+static int mnt_table_read_arena(struct libmnt_table *tb, FILE *f,
+				struct libmnt_arena **arena)
+{
+	struct libmnt_arena *a;
+	char *buf = NULL, *p, *x;
+	size_t len = 0, sz = 0, nlines = 0;
+
+	do {
+		if (len + 1 >= sz) {
+			sz = sz ? sz * 2 : BUFSIZ * 4;
+			x = realloc(buf, sz);
+			if (!x)
+				goto nomem;
+			buf = x;
+		}
+		p = buf + len;
+		len += fread(p, 1, sz - len - 1, f);
+	} while (!feof(f) && !ferror(f));
+
+	if (ferror(f)) {
+		free(buf);
+		return -EIO;
 	}
+	buf[len] = '\0';
+
+	for (p = buf; (p = memchr(p, '\n', len - (p - buf))); p++)
+		nlines++;
+
+	/* the merged options string is never longer than the line + 4 bytes */
+	sz = len + 1 + len + 5 * (nlines + 1);
+	x = realloc(buf, sz);
+	if (!x)
+		goto nomem;
+	buf = x;
+
+	a = calloc(1, sizeof(*a));
+	if (!a)
+		goto nomem;
+	a->data = buf;
+	a->size = sz;
+	a->used = len + 1;
+	a->next = tb->arenas;
+	tb->arenas = a;
+
+	DBG(TAB, mnt_debug_h(tb, "arena: %zu bytes, %zu lines", len, nlines));
+	*arena = a;
+	return 0;
+nomem:
+	free(buf);
+	return -ENOMEM;
+}
 
-	if (rc == 0)
-		return 0;
-err:
-	DBG(TAB, mnt_debug_h(tb, "%s:%d: %s parse error", filename, *nlines,
-				tb->fmt == MNT_FMT_MOUNTINFO ? "mountinfo" :
-				tb->fmt == MNT_FMT_SWAPS ? "swaps" :
-				tb->fmt == MNT_FMT_FSTAB ? "tab" : "utab"));
+/*
+ * Returns the next line from arena
+ */
+static int mnt_table_parse_next_arena(struct libmnt_table *tb, char **pos,
+				struct libmnt_fs *fs, struct libmnt_arena *arena,
+				const char *filename, int *nlines)
+{
+	char *s, *end;
 
-	/* by default all errors are recoverable, otherwise behavior depends on
-	 * errcb() function. See mnt_table_set_parser_errcb().
-	 */
-	return tb->errcb ? tb->errcb(tb, filename, *nlines) : 1;
+	assert(tb);
+	assert(pos);
+	assert(fs);
+
+	/* the next non-blank non-comment line */
+	do {
+		s = *pos;
+		if (!*s)
+			return -EINVAL;
+		++*nlines;
+		end = strchr(s, '\n');
+		if (end) {
+			*end = '\0';
+			*pos = end + 1;
+		} else {
+			DBG(TAB, mnt_debug_h(tb,
+				"%s: no final newline",	filename));
+			end = strchr(s, '\0');
+			*pos = end;
+		}
+		if (--end >= s && *end == '\r')
+			*end = '\0';
+		s = skip_spaces(s);
+	} while (*s == '\0' || *s == '#');
+
+	return mnt_table_parse_line(tb, fs, s, arena, filename, *nlines);
 }
 
 static pid_t path_to_tid(const char *filename)
@@ -505,6 +731,8 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	int rc = -1;
 	int flags = 0;
 	pid_t tid = -1;
+	struct libmnt_arena *arena = NULL;
+	char *pos = NULL;
 
 	assert(tb);
 	assert(f);
@@ -520,20 +748,32 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	if (filename && strcmp(filename, _PATH_PROC_MOUNTS) == 0)
 		flags = MNT_FS_KERNEL;
 
-	while (!feof(f)) {
+	if (tb->use_arena &&
+	    (tb->fmt == MNT_FMT_GUESS || tb->fmt == MNT_FMT_MOUNTINFO)) {
+		rc = mnt_table_read_arena(tb, f, &arena);
+		if (rc)
+			goto err;
+		pos = arena->data;
+	}
+
+	while (arena ? *pos != '\0' : !feof(f)) {
 		struct libmnt_fs *fs = mnt_new_fs();
 
 		if (!fs)
 			goto err;
 
-		rc = mnt_table_parse_next(tb, f, fs, filename, &nlines);
+		if (arena)
+			rc = mnt_table_parse_next_arena(tb, &pos, fs, arena,
+							filename, &nlines);
+		else
+			rc = mnt_table_parse_next(tb, f, fs, filename, &nlines);
 
 		if (!rc && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
 			rc = 1;	/* filtered out by callback... */
 
 		if (!rc) {
-			rc = mnt_table_add_fs(tb, fs);
 			fs->flags |= flags;
+			rc = mnt_table_add_fs(tb, fs);
 
 			if (rc == 0 && tb->fmt == MNT_FMT_MOUNTINFO)
 				rc = kernel_fs_postparse(tb, fs, &tid, filename);
@@ -542,12 +782,19 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 			mnt_free_fs(fs);
 			if (rc == 1)
 				continue;	/* recoverable error */
-			if (feof(f))
+			if (arena ? *pos == '\0' : feof(f))
 				break;
 			goto err;		/* fatal error */
 		}
 	}
 
+	if (arena && tb->fmt != MNT_FMT_MOUNTINFO) {
+		/* not mountinfo, the strings are not in the arena */
+		tb->arenas = arena->next;
+		free(arena->data);
+		free(arena);
+	}
+
 	DBG(TAB, mnt_debug_h(tb, "%s: stop parsing (%d entries)",
 				filename, mnt_table_get_nents(tb)));
 	return 0;
@@ -816,6 +1063,33 @@ int mnt_table_set_parser_fltrcb(struct libmnt_table *tb,
 	return 0;
 }
 
+/**
+ * mnt_table_enable_arena:
+ * @tb: table
+ * @enable: TRUE or FALSE
+ *
+ * Enables or disables the arena mode for the mountinfo parser. In this mode
+ * the whole file is read to the one buffer owned by the table and the strings
+ * in the mountinfo entries are not allocated separately, the strings point to
+ * the buffer. All the memory is deallocated by mnt_reset_table() or
+ * mnt_free_table().
+ *
+ * The mode is recommended for applications that often read large mountinfo
+ * files. The entries are still usable in the same way as without the arena,
+ * mnt_table_remove_fs() makes a private copy of the strings.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int mnt_table_enable_arena(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, mnt_debug_h(tb, "arena mode: %s", enable ? "ON" : "OFF"));
+	tb->use_arena = enable ? 1 : 0;
+	return 0;
+}
+
 /**
  * mnt_table_parse_swaps:
  * @tb: table
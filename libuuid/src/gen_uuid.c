@@ -71,6 +71,12 @@
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
+#if defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H)
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #ifdef HAVE_SYS_SOCKIO_H
 #include <sys/sockio.h>
 #endif
@@ -332,29 +338,36 @@ try_again:
 }
 
 #if defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H)
-/*
- * Try using the uuidd daemon to generate the UUID
- *
- * Returns 0 on success, non-zero on failure.
- */
-static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL	0
+#endif
+
+static int connect_daemon(void)
 {
-	char op_buf[64];
-	int op_len;
-	int s;
-	ssize_t ret;
-	int32_t reply_len = 0, expected = 16;
 	struct sockaddr_un srv_addr;
+	int s;
 
 	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
 		return -1;
+	fcntl(s, F_SETFD, FD_CLOEXEC);
 
 	srv_addr.sun_family = AF_UNIX;
 	strcpy(srv_addr.sun_path, UUIDD_SOCKET_PATH);
 
 	if (connect(s, (const struct sockaddr *) &srv_addr,
-		    sizeof(struct sockaddr_un)) < 0)
-		goto fail;
+		    sizeof(struct sockaddr_un)) < 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static int request_daemon(int s, int op, uuid_t out, int *num)
+{
+	char op_buf[64];
+	int op_len;
+	ssize_t ret;
+	int32_t reply_len = 0, expected = 16;
 
 	op_buf[0] = op;
 	op_len = 1;
@@ -364,29 +377,240 @@ static int get_uuid_via_daemon(int op, uuid_t out, int *num)
 		expected += sizeof(*num);
 	}
 
-	ret = write(s, op_buf, op_len);
-	if (ret < 1)
-		goto fail;
+	/* don't kill the application by SIGPIPE if the daemon has closed
+	 * the connection */
+	if (send(s, op_buf, op_len, MSG_NOSIGNAL) != op_len)
+		return -1;
 
 	ret = read_all(s, (char *) &reply_len, sizeof(reply_len));
-	if (ret < 0)
-		goto fail;
-
-	if (reply_len != expected)
-		goto fail;
+	if (ret != sizeof(reply_len) || reply_len != expected)
+		return -1;
 
 	ret = read_all(s, op_buf, reply_len);
+	if (ret != expected)
+		return -1;
 
+	/* number of UUIDs really reserved by the daemon */
 	if (op == UUIDD_OP_BULK_TIME_UUID)
-		memcpy(op_buf+16, num, sizeof(int));
+		memcpy(num, op_buf+16, sizeof(int));
 
 	memcpy(out, op_buf, 16);
+	return 0;
+}
 
-	close(s);
-	return ((ret == expected) ? 0 : -1);
+/*
+ * Per-thread connection to the daemon
+ */
+struct daemon_conn {
+	int	fd;
+	pid_t	pid;		/* process the connection belongs to */
+	dev_t	dev;		/* the socket, see daemon_conn_is_valid() */
+	ino_t	ino;
+};
+
+/*
+ * The application may close our descriptor and the number may be reused for
+ * another file. Returns 1 if @conn->fd is still our socket.
+ */
+static int daemon_conn_is_valid(struct daemon_conn *conn)
+{
+	struct stat st;
+
+	return conn->fd >= 0 &&
+	       fstat(conn->fd, &st) == 0 &&
+	       S_ISSOCK(st.st_mode) &&
+	       st.st_dev == conn->dev &&
+	       st.st_ino == conn->ino;
+}
+
+static void daemon_conn_close(struct daemon_conn *conn)
+{
+	if (daemon_conn_is_valid(conn))
+		close(conn->fd);
+	conn->fd = -1;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_key_t daemon_conn_key;
+static int daemon_conn_key_ok;
+static pthread_once_t daemon_conn_key_once = PTHREAD_ONCE_INIT;
+
+/* closes the connection when the thread exits */
+static void daemon_conn_destroy(void *data)
+{
+	struct daemon_conn *conn = data;
+
+	if (conn->pid == getpid())
+		daemon_conn_close(conn);
+}
+
+static void daemon_conn_key_init(void)
+{
+	daemon_conn_key_ok = pthread_key_create(&daemon_conn_key,
+						daemon_conn_destroy) == 0;
+}
+#endif
+
+static int daemon_conn_open(struct daemon_conn *conn)
+{
+	struct stat st;
+
+	conn->fd = connect_daemon();
+	if (conn->fd < 0)
+		return -1;
+	if (fstat(conn->fd, &st) != 0) {
+		close(conn->fd);
+		conn->fd = -1;
+		return -1;
+	}
+	conn->pid = getpid();
+	conn->dev = st.st_dev;
+	conn->ino = st.st_ino;
+
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&daemon_conn_key_once, daemon_conn_key_init);
+	if (daemon_conn_key_ok)
+		pthread_setspecific(daemon_conn_key, conn);
+#endif
+	return 0;
+}
+
+/*
+ * Try using the uuidd daemon to generate the UUID
+ *
+ * The connection is kept open for the next requests from the same thread (the
+ * daemon serves more requests per connection) and closed when the thread
+ * exits. The connection inherited from the parent process is not used after
+ * fork().
+ *
+ * Returns 0 on success, non-zero on failure.
+ */
+static int get_uuid_via_daemon(int op, uuid_t out, int *num)
+{
+	THREAD_LOCAL struct daemon_conn conn = { .fd = -1 };
+	int reused = 1;
+
+	if (conn.fd >= 0 && !daemon_conn_is_valid(&conn))
+		conn.fd = -1;		/* not our file anymore */
+	if (conn.fd >= 0 && conn.pid != getpid())
+		daemon_conn_close(&conn);
+
+	do {
+		if (conn.fd < 0) {
+			if (daemon_conn_open(&conn) != 0)
+				return -1;
+			reused = 0;
+		}
+		if (request_daemon(conn.fd, op, out, num) == 0)
+			return 0;
+
+		/* the old connection may be closed by the daemon (e.g. the
+		 * daemon has been restarted), try it again with a new one */
+		daemon_conn_close(&conn);
+	} while (reused--);
 
-fail:
-	close(s);
+	return -1;
+}
+
+/*
+ * The shared memory channel published by uuidd (see uuidd.h). The mapping is
+ * shared by all threads and it's (re)mapped after successful request to the
+ * daemon only, so the clients don't try to open the file if the daemon is not
+ * running.
+ */
+static struct uuidd_shm *uuidd_shm;
+
+static void map_daemon_shm(void)
+{
+	static ino_t ino;
+	struct uuidd_shm *shm, *old = uuidd_shm;
+	struct stat st;
+	int fd;
+
+	fd = open(UUIDD_SHM_PATH, O_RDWR);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 ||
+	    st.st_size < (off_t) sizeof(struct uuidd_shm) ||
+	    (old && st.st_ino == ino)) {
+		close(fd);
+		return;
+	}
+	shm = mmap(NULL, sizeof(struct uuidd_shm), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return;
+	if (shm->magic != UUIDD_SHM_MAGIC ||
+	    shm->size != sizeof(struct uuidd_shm)) {
+		munmap(shm, sizeof(struct uuidd_shm));
+		return;
+	}
+
+	/* the file has been re-created by a new daemon; the old mapping is
+	 * not unmapped, it may be still used by another thread */
+	ino = st.st_ino;
+
+	/* another thread may map the file in the meantime, keep only one
+	 * mapping */
+	if (!__sync_bool_compare_and_swap(&uuidd_shm, old, shm))
+		munmap(shm, sizeof(struct uuidd_shm));
+}
+
+/*
+ * Claims up to @num time UUIDs from the current shared memory block, the
+ * first UUID is stored to @out and @num is updated to the number of the
+ * claimed UUIDs. Returns 0 on success, -1 if the block is not usable.
+ */
+static int get_uuid_via_shm(uuid_t out, int *num)
+{
+	struct uuidd_shm *shm = uuidd_shm;
+	struct uuidd_shm_block *blk;
+	uint64_t gen, start, count, n = num ? *num : 1;
+	int64_t expires;
+	struct uuid uu;
+	uuid_t first;
+	int tries;
+
+	if (!shm || n < 1)
+		return -1;
+
+	for (tries = 0; tries < 4; tries++) {
+		gen = shm->head;
+		__sync_synchronize();
+
+		blk = &shm->blocks[gen % UUIDD_SHM_NBLOCKS];
+		if (blk->gen != gen)
+			continue;		/* replaced in the meantime */
+
+		start = __sync_fetch_and_add(&blk->claimed, n);
+		count = blk->count;
+		expires = blk->expires;
+		memcpy(first, blk->first, sizeof(uuid_t));
+
+		__sync_synchronize();
+		if (blk->gen != gen)
+			continue;		/* the data are not consistent */
+
+		if (start >= count || expires < time(NULL))
+			return -1;		/* exhausted or too old */
+		if (n > count - start)
+			n = count - start;
+
+		/* first + start, see uuid_time_next() */
+		uuid_unpack(first, &uu);
+		start += uu.time_low;
+		uu.time_low = (uint32_t) start;
+		start = (start >> 32) + uu.time_mid +
+			((uint64_t) (uu.time_hi_and_version & 0x0FFF) << 16);
+		uu.time_mid = (uint16_t) start;
+		uu.time_hi_and_version = ((start >> 16) & 0x0FFF) | 0x1000;
+		uuid_pack(&uu, out);
+
+		if (num)
+			*num = n;
+		return 0;
+	}
 	return -1;
 }
 
@@ -395,6 +619,13 @@ static int get_uuid_via_daemon(int op, uuid_t out, int *num)
 {
 	return -1;
 }
+static void map_daemon_shm(void)
+{
+}
+static int get_uuid_via_shm(uuid_t out, int *num)
+{
+	return -1;
+}
 #endif
 
 int __uuid_generate_time(uuid_t out, int *num)
@@ -426,6 +657,36 @@ int __uuid_generate_time(uuid_t out, int *num)
 	return ret;
 }
 
+/*
+ * Reserves @num time-based UUIDs by uuidd (the shared memory block is used if
+ * possible, otherwise the socket) or by one update of the global clock state
+ * counter. The first UUID is stored to @out, the others are the next
+ * clock ticks (see uuid_time_next()). The @num is updated to the number of
+ * really reserved UUIDs (uuidd may reserve less UUIDs than requested).
+ *
+ * Returns 0 if the UUIDs has been reserved in a safe manner, -1 otherwise.
+ */
+static int uuid_reserve_time(uuid_t out, int *num)
+{
+	if (get_uuid_via_shm(out, num) == 0)
+		return 0;
+	if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID, out, num) == 0) {
+		map_daemon_shm();
+		return 0;
+	}
+	return __uuid_generate_time(out, num);
+}
+
+static void uuid_time_next(struct uuid *uu)
+{
+	uu->time_low++;
+	if (uu->time_low == 0) {
+		uu->time_mid++;
+		if (uu->time_mid == 0)
+			uu->time_hi_and_version++;
+	}
+}
+
 /*
  * Generate time-based UUID and store it to @out
  *
@@ -436,44 +697,46 @@ int __uuid_generate_time(uuid_t out, int *num)
  */
 static int uuid_generate_time_generic(uuid_t out) {
 #ifdef HAVE_TLS
+	/* per-thread reservation, no lock is necessary for the next UUIDs */
 	THREAD_LOCAL int		num = 0;
+	THREAD_LOCAL int		ret = 0;
 	THREAD_LOCAL struct uuid	uu;
 	THREAD_LOCAL time_t		last_time = 0;
+	THREAD_LOCAL pid_t		last_pid = 0;
 	time_t				now;
 
 	if (num > 0) {
 		now = time(0);
 		if (now > last_time+1)
 			num = 0;
+		/* don't share the reservation with a forked child */
+		else if (last_pid != getpid())
+			num = 0;
 	}
 	if (num <= 0) {
 		num = 1000;
-		if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
-					out, &num) == 0) {
-			last_time = time(0);
-			uuid_unpack(out, &uu);
-			num--;
-			return 0;
-		}
-		num = 0;
-	}
-	if (num > 0) {
-		uu.time_low++;
-		if (uu.time_low == 0) {
-			uu.time_mid++;
-			if (uu.time_mid == 0)
-				uu.time_hi_and_version++;
-		}
+		ret = uuid_reserve_time(out, &num);
+		last_time = time(0);
+		last_pid = getpid();
+		uuid_unpack(out, &uu);
 		num--;
-		uuid_pack(&uu, out);
-		return 0;
+		return ret;
 	}
+
+	uuid_time_next(&uu);
+	num--;
+	uuid_pack(&uu, out);
+	return ret;
 #else
-	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
+	if (get_uuid_via_shm(out, 0) == 0)
 		return 0;
-#endif
+	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0) {
+		map_daemon_shm();
+		return 0;
+	}
 
 	return __uuid_generate_time(out, 0);
+#endif
 }
 
 /*
@@ -492,10 +755,50 @@ int uuid_generate_time_safe(uuid_t out)
 	return uuid_generate_time_generic(out);
 }
 
+/*
+ * Generate @num time-based UUIDs and store them to @out.
+ *
+ * The UUIDs are reserved by one request to uuidd (up to 1000 UUIDs per
+ * request) or by one update of the global clock state counter.
+ *
+ * Returns 0 if all UUIDs have been generated in a safe manner (see
+ * uuid_generate_time_safe()), otherwise returns -1.
+ */
+int uuid_generate_time_bulk(uuid_t out[], int num)
+{
+	struct uuid uu;
+	int i = 0, ret = 0;
+
+	if (!out || num < 1)
+		return -1;
+
+	while (i < num) {
+		/* uuidd does not limit the request */
+		int max = min(num - i, 1000);
+		int n = max;
+
+		if (uuid_reserve_time(out[i], &n) != 0)
+			ret = -1;
+		if (n < 1 || n > max)
+			n = 1;
+
+		uuid_unpack(out[i], &uu);
+		n += i;
+		for (i++; i < n; i++) {
+			uuid_time_next(&uu);
+			uuid_pack(&uu, out[i]);
+		}
+	}
+	return ret;
+}
 
+
+/*
+ * Generate @num (or one if @num is NULL) random-based UUIDs to @out. All
+ * random bytes are read from the buffered generator at once.
+ */
 void __uuid_generate_random(uuid_t out, int *num)
 {
-	uuid_t	buf;
 	struct uuid uu;
 	int i, n;
 
@@ -504,9 +807,10 @@ void __uuid_generate_random(uuid_t out, int *num)
 	else
 		n = *num;
 
+	random_get_bytes_fast(out, n * sizeof(uuid_t));
+
 	for (i = 0; i < n; i++) {
-		random_get_bytes(buf, sizeof(buf));
-		uuid_unpack(buf, &uu);
+		uuid_unpack(out, &uu);
 
 		uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
 		uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF)
@@ -530,9 +834,12 @@ void uuid_generate_random(uuid_t out)
  */
 static int have_random_source(void)
 {
+	static int has_random;
 	struct stat s;
 
-	return (!stat("/dev/random", &s) || !stat("/dev/urandom", &s));
+	if (!has_random)
+		has_random = (!stat("/dev/random", &s) || !stat("/dev/urandom", &s));
+	return has_random;
 }
 
 
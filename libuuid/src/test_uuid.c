@@ -40,6 +40,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
 
 #include "uuid.h"
 
@@ -60,6 +64,122 @@ static int test_uuid(const char * uuid, int isValid)
 	return 0;
 }
 
+static int cmp_uuid(const void *a, const void *b)
+{
+	return uuid_compare(*(const uuid_t *) a, *(const uuid_t *) b);
+}
+
+static int test_bulk(int num)
+{
+	uuid_t *uu;
+	int i, failed = 0;
+
+	uu = calloc(num, sizeof(uuid_t));
+	if (!uu)
+		return 1;
+
+	uuid_generate_time_bulk(uu, num);
+
+	for (i = 0; i < num; i++) {
+		if (uuid_type(uu[i]) != 1 ||
+		    uuid_variant(uu[i]) != UUID_VARIANT_DCE) {
+			printf("UUID bulk: incorrect type or variant!\n");
+			failed++;
+			break;
+		}
+	}
+
+	qsort(uu, num, sizeof(uuid_t), cmp_uuid);
+	for (i = 1; i < num; i++) {
+		if (uuid_compare(uu[i - 1], uu[i]) == 0) {
+			printf("UUID bulk: duplicate UUID!\n");
+			failed++;
+			break;
+		}
+	}
+	if (!failed)
+		printf("UUID bulk generate of %d UUIDs succeeded.\n", num);
+
+	free(uu);
+	return failed;
+}
+
+static int test_random(int num)
+{
+	uuid_t *uu;
+	int i, failed = 0;
+
+	uu = calloc(num, sizeof(uuid_t));
+	if (!uu)
+		return 1;
+
+	for (i = 0; i < num; i++) {
+		uuid_generate_random(uu[i]);
+		if (uuid_type(uu[i]) != 4 ||
+		    uuid_variant(uu[i]) != UUID_VARIANT_DCE) {
+			printf("UUID random: incorrect type or variant!\n");
+			failed++;
+			break;
+		}
+	}
+
+	qsort(uu, num, sizeof(uuid_t), cmp_uuid);
+	for (i = 1; i < num; i++) {
+		if (uuid_compare(uu[i - 1], uu[i]) == 0) {
+			printf("UUID random: duplicate UUID!\n");
+			failed++;
+			break;
+		}
+	}
+	if (!failed)
+		printf("UUID random generate of %d UUIDs succeeded.\n", num);
+
+	free(uu);
+	return failed;
+}
+
+#ifndef _WIN32
+static double time_diff(struct timeval *a, struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000.0 +
+	       (b->tv_usec - a->tv_usec) / 1000.0;
+}
+
+static int bench(int num)
+{
+	struct timeval start, end;
+	uuid_t *uu;
+	int i;
+
+	uu = calloc(num, sizeof(uuid_t));
+	if (!uu)
+		return 1;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < num; i++)
+		uuid_generate_random(uu[i]);
+	gettimeofday(&end, NULL);
+	printf("uuid_generate_random:    %d UUIDs in %.3f ms\n",
+			num, time_diff(&start, &end));
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < num; i++)
+		uuid_generate_time(uu[i]);
+	gettimeofday(&end, NULL);
+	printf("uuid_generate_time:      %d UUIDs in %.3f ms\n",
+			num, time_diff(&start, &end));
+
+	gettimeofday(&start, NULL);
+	uuid_generate_time_bulk(uu, num);
+	gettimeofday(&end, NULL);
+	printf("uuid_generate_time_bulk: %d UUIDs in %.3f ms\n",
+			num, time_diff(&start, &end));
+
+	free(uu);
+	return 0;
+}
+#endif
+
 #ifdef __GNUC__
 #define ATTR(x) __attribute__(x)
 #else
@@ -67,7 +187,7 @@ static int test_uuid(const char * uuid, int isValid)
 #endif
 
 int
-main(int argc ATTR((unused)) , char **argv ATTR((unused)))
+main(int argc, char **argv)
 {
 	uuid_t		buf, tst;
 	char		str[100];
@@ -78,6 +198,10 @@ main(int argc ATTR((unused)) , char **argv ATTR((unused)))
 	int failed = 0;
 	int type, variant;
 
+#ifndef _WIN32
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return bench(argc > 2 ? atoi(argv[2]) : 1000000);
+#endif
 	uuid_generate(buf);
 	uuid_unparse(buf, str);
 	printf("UUID generate = %s\n", str);
@@ -160,6 +284,9 @@ main(int argc ATTR((unused)) , char **argv ATTR((unused)))
 		printf("UUID copy and compare failed!\n");
 		failed++;
 	}
+	failed += test_bulk(5000);
+	failed += test_random(5000);
+
 	failed += test_uuid("84949cc5-4701-4a84-895b-354c584a981b", 1);
 	failed += test_uuid("84949CC5-4701-4A84-895B-354C584A981B", 1);
 	failed += test_uuid("84949cc5-4701-4a84-895b-354c584a981bc", 0);
@@ -80,6 +80,7 @@ void uuid_generate(uuid_t out);
 void uuid_generate_random(uuid_t out);
 void uuid_generate_time(uuid_t out);
 int uuid_generate_time_safe(uuid_t out);
+int uuid_generate_time_bulk(uuid_t out[], int num);
 
 /* isnull.c */
 int uuid_is_null(const uuid_t uu);
@@ -38,6 +38,7 @@
 #define UUIDD_DIR		_PATH_LOCALSTATEDIR "/uuidd"
 #define UUIDD_SOCKET_PATH	UUIDD_DIR "/request"
 #define UUIDD_PIDFILE_PATH	UUIDD_DIR "/uuidd.pid"
+#define UUIDD_SHM_PATH		UUIDD_DIR "/shm"
 #define UUIDD_PATH		"/usr/sbin/uuidd"
 
 #define UUIDD_OP_GETPID			0
@@ -46,7 +47,50 @@
 #define UUIDD_OP_RANDOM_UUID		3
 #define UUIDD_OP_BULK_TIME_UUID		4
 #define UUIDD_OP_BULK_RANDOM_UUID	5
-#define UUIDD_MAX_OP			UUIDD_OP_BULK_RANDOM_UUID
+#define UUIDD_OP_STREAM_RANDOM_UUID	6
+#define UUIDD_MAX_OP			UUIDD_OP_STREAM_RANDOM_UUID
+
+/*
+ * The request is one byte operation code, the BULK and STREAM operations are
+ * followed by int32 number of requested UUIDs. The daemon keeps the connection
+ * open, so more requests may be sent by one connection.
+ *
+ * The reply is int32 length of the reply data followed by the data, except
+ * UUIDD_OP_STREAM_RANDOM_UUID where the reply is int32 number of UUIDs followed
+ * by the binary UUIDs. The stream is not limited by the reply buffer size.
+ */
+
+/*
+ * Shared memory reservation channel
+ *
+ * The daemon reserves blocks of time-based UUIDs (clock ticks) and publishes
+ * them in the UUIDD_SHM_PATH file. The clients map the file and claim UUIDs
+ * from the current block by atomic add to the block 'claimed' counter. The
+ * socket is used if the current block is exhausted or expired, the daemon
+ * publishes a new block on the socket request.
+ *
+ * The daemon marks the block as invalid (gen = 0) when the block is updated,
+ * the client has to check that the block generation has not been changed
+ * after the block has been read.
+ */
+#define UUIDD_SHM_MAGIC		0x55554944	/* "UUID" */
+#define UUIDD_SHM_NBLOCKS	4
+#define UUIDD_SHM_BLOCKSZ	65536		/* UUIDs per block */
+
+struct uuidd_shm_block {
+	volatile uint64_t	gen;		/* generation or 0 if updated */
+	volatile uint64_t	claimed;	/* number of claimed UUIDs */
+	uint64_t		count;		/* number of UUIDs in the block */
+	int64_t			expires;	/* time(2) when the block expires */
+	uuid_t			first;		/* the first UUID of the block */
+};
+
+struct uuidd_shm {
+	uint32_t		magic;
+	uint32_t		size;		/* sizeof(struct uuidd_shm) */
+	volatile uint64_t	head;		/* generation of the current block */
+	struct uuidd_shm_block	blocks[UUIDD_SHM_NBLOCKS];
+};
 
 extern int __uuid_generate_time(uuid_t out, int *num);
 extern void __uuid_generate_random(uuid_t out, int *num);
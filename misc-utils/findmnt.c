@@ -29,7 +29,6 @@
 # include <sys/ioctl.h>
 #endif
 #include <assert.h>
-#include <poll.h>
 #include <sys/statvfs.h>
 #include <sys/types.h>
 #ifdef HAVE_LIBUDEV
@@ -758,6 +757,8 @@ static struct libmnt_table *parse_tabfiles(char **files,
 		return NULL;
 	}
 	mnt_table_set_parser_errcb(tb, parser_errcb);
+	if (tabtype == TABTYPE_KERNEL)
+		mnt_table_enable_arena(tb, 1);
 
 	do {
 		/* NULL means that libmount will use default paths */
@@ -961,21 +962,12 @@ static int poll_match(struct libmnt_fs *fs)
 	return rc;
 }
 
-static int poll_table(struct libmnt_table *tb, const char *tabfile,
-		  int timeout, struct tt *tt, int direction)
+static int poll_table(const char *tabfile, int timeout, struct tt *tt,
+		      int direction)
 {
-	FILE *f = NULL;
 	int rc = -1;
 	struct libmnt_iter *itr = NULL;
-	struct libmnt_table *tb_new = NULL;
-	struct libmnt_tabdiff *diff = NULL;
-	struct pollfd fds[1];
-
-	tb_new = mnt_new_table();
-	if (!tb_new) {
-		warn(_("failed to initialize libmount table"));
-		goto done;
-	}
+	struct libmnt_monitor *mn = NULL;
 
 	itr = mnt_new_iter(direction);
 	if (!itr) {
@@ -983,51 +975,30 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 		goto done;
 	}
 
-	diff = mnt_new_tabdiff();
-	if (!diff) {
-		warn(_("failed to initialize libmount tabdiff"));
-		goto done;
-	}
-
-	/* cache is unnecessary to detect changes */
-	mnt_table_set_cache(tb, NULL);
-	mnt_table_set_cache(tb_new, NULL);
-
-	f = fopen(tabfile, "r");
-	if (!f) {
+	mn = mnt_new_monitor(tabfile);
+	if (!mn) {
 		warn(_("cannot open %s"), tabfile);
 		goto done;
 	}
 
-	mnt_table_set_parser_errcb(tb_new, parser_errcb);
-
-	fds[0].fd = fileno(f);
-	fds[0].events = POLLPRI;
+	mnt_monitor_set_parser_errcb(mn, parser_errcb);
 
 	while (1) {
-		struct libmnt_table *tmp;
 		struct libmnt_fs *old, *new;
 		int change, count;
 
-		count = poll(fds, 1, timeout);
+		count = mnt_monitor_wait(mn, timeout);
 		if (count == 0)
 			break;	/* timeout */
 		if (count < 0) {
-			warn(_("poll() failed"));
+			warn(_("failed to read changes from %s"), tabfile);
 			goto done;
 		}
 
-		rewind(f);
-		rc = mnt_table_parse_stream(tb_new, f, tabfile);
-		if (!rc)
-			rc = mnt_diff_tables(diff, tb, tb_new);
-		if (rc < 0)
-			goto done;
-
 		count = 0;
 		mnt_reset_iter(itr, direction);
-		while(mnt_tabdiff_next_change(
-				diff, itr, &old, &new, &change) == 0) {
+		while(mnt_monitor_next_change(
+				mn, itr, &old, &new, &change) == 0) {
 
 			if (!has_poll_action(change))
 				continue;
@@ -1047,13 +1018,7 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 				goto done;
 		}
 
-		/* swap tables */
-		tmp = tb;
-		tb = tb_new;
-		tb_new = tmp;
-
 		tt_remove_lines(tt);
-		mnt_reset_table(tb_new);
 
 		if (count && (flags & FL_FIRSTONLY))
 			break;
@@ -1061,11 +1026,8 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	rc = 0;
 done:
-	mnt_free_table(tb_new);
-	mnt_free_tabdiff(diff);
+	mnt_free_monitor(mn);
 	mnt_free_iter(itr);
-	if (f)
-		fclose(f);
 	return rc;
 }
 
@@ -1407,8 +1369,13 @@ int main(int argc, char *argv[])
 
 
 	/*
-	 * initialize output formatting (tt.h)
+	 * initialize output formatting (tt.h), the raw and export output does
+	 * not need column widths, so the filesystems are printed continuously
 	 */
+	if ((tt_flags & (TT_FL_RAW | TT_FL_EXPORT))
+	    && !(flags & (FL_SUBMOUNTS | FL_POLL)))
+		tt_flags |= TT_FL_STREAM;
+
 	tt = tt_new_table(tt_flags);
 	if (!tt) {
 		warn(_("failed to initialize output table"));
@@ -1439,7 +1406,7 @@ int main(int argc, char *argv[])
 	 */
 	if (flags & FL_POLL) {
 		/* poll mode (accept the first tabfile only) */
-		rc = poll_table(tb, tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO, timeout, tt, direction);
+		rc = poll_table(tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO, timeout, tt, direction);
 
 	} else if ((tt_flags & TT_FL_TREE) && !(flags & FL_SUBMOUNTS)) {
 		/* whole tree */
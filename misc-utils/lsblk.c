@@ -48,6 +48,10 @@
 
 #include <assert.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include "c.h"
 #include "pathnames.h"
 #include "blkdev.h"
@@ -160,6 +164,7 @@ static struct colinfo infos[] = {
 
 struct lsblk {
 	struct tt *tt;			/* output table */
+	unsigned int nthreads;		/* number of threads to collect data */
 	unsigned int all_devices:1;	/* print all devices, including empty */
 	unsigned int bytes:1;		/* print SIZE in bytes */
 	unsigned int inverse:1;		/* print inverse dependencies */
@@ -184,12 +189,18 @@ static struct libmnt_cache *mntcache;
 
 #ifdef HAVE_LIBUDEV
 struct udev *udev;
+# ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t udev_lock = PTHREAD_MUTEX_INITIALIZER;
+# endif
 #endif
 
+struct blkdev_job;
+
 struct blkdev_cxt {
 	struct blkdev_cxt *parent;
 
 	struct tt_line *tt_line;
+	struct blkdev_job *job;	/* deferred line for --threads */
 	struct stat	st;
 
 	char *name;		/* kernel name in /sys/block */
@@ -409,12 +420,15 @@ static int get_udev_properties(struct blkdev_cxt *cxt)
 	if (cxt->probed)
 		return 0;		/* already done */
 
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_lock(&udev_lock);	/* udev context is not thread-safe */
+#endif
 	if (!udev)
 		udev = udev_new();
-	if (!udev)
-		return -1;
-
-	dev = udev_device_new_from_subsystem_sysname(udev, "block", cxt->name);
+	if (udev)
+		dev = udev_device_new_from_subsystem_sysname(udev, "block", cxt->name);
+	else
+		dev = NULL;
 	if (dev) {
 		const char *data;
 
@@ -440,6 +454,9 @@ static int get_udev_properties(struct blkdev_cxt *cxt)
 		udev_device_unref(dev);
 		cxt->probed = 1;
 	}
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_unlock(&udev_lock);
+#endif
 
 	return cxt->probed == 1 ? 0 : -1;
 
@@ -642,9 +659,11 @@ static char *get_transport(struct blkdev_cxt *cxt)
 #define is_parsable(_l)	(((_l)->tt->flags & TT_FL_RAW) || \
 			 ((_l)->tt->flags & TT_FL_EXPORT))
 
-static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line *ln)
+/*
+ * Returns newly allocated data for the column @id or NULL.
+ */
+static char *get_column_data(struct blkdev_cxt *cxt, int id)
 {
-	char buf[1024];
 	char *p = NULL;
 	int st_rc = 0;
 
@@ -656,33 +675,30 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 	case COL_NAME:
 		if (cxt->dm_name) {
 			if (is_parsable(lsblk))
-				tt_line_set_data(ln, col, xstrdup(cxt->dm_name));
-			else {
-				snprintf(buf, sizeof(buf), "%s (%s)",
-					cxt->dm_name, cxt->name);
-				tt_line_set_data(ln, col, xstrdup(buf));
-			}
+				p = xstrdup(cxt->dm_name);
+			else
+				xasprintf(&p, "%s (%s)", cxt->dm_name, cxt->name);
 			break;
 		}
 	case COL_KNAME:
-		tt_line_set_data(ln, col, xstrdup(cxt->name));
+		p = xstrdup(cxt->name);
 		break;
 	case COL_PKNAME:
 		if (cxt->parent)
-			tt_line_set_data(ln, col, xstrdup(cxt->parent->name));
+			p = xstrdup(cxt->parent->name);
 		break;
 	case COL_OWNER:
 	{
 		struct passwd *pw = st_rc ? NULL : getpwuid(cxt->st.st_uid);
 		if (pw)
-			tt_line_set_data(ln, col, xstrdup(pw->pw_name));
+			p = xstrdup(pw->pw_name);
 		break;
 	}
 	case COL_GROUP:
 	{
 		struct group *gr = st_rc ? NULL : getgrgid(cxt->st.st_gid);
 		if (gr)
-			tt_line_set_data(ln, col, xstrdup(gr->gr_name));
+			p = xstrdup(gr->gr_name);
 		break;
 	}
 	case COL_MODE:
@@ -691,103 +707,78 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 
 		if (!st_rc) {
 			strmode(cxt->st.st_mode, md);
-			tt_line_set_data(ln, col, xstrdup(md));
+			p = xstrdup(md);
 		}
 		break;
 	}
 	case COL_MAJMIN:
 		if (is_parsable(lsblk))
-			snprintf(buf, sizeof(buf), "%u:%u", cxt->maj, cxt->min);
+			xasprintf(&p, "%u:%u", cxt->maj, cxt->min);
 		else
-			snprintf(buf, sizeof(buf), "%3u:%-3u", cxt->maj, cxt->min);
-		tt_line_set_data(ln, col, xstrdup(buf));
+			xasprintf(&p, "%3u:%-3u", cxt->maj, cxt->min);
 		break;
 	case COL_FSTYPE:
 		probe_device(cxt);
 		if (cxt->fstype)
-			tt_line_set_data(ln, col, xstrdup(cxt->fstype));
+			p = xstrdup(cxt->fstype);
 		break;
 	case COL_TARGET:
-		if (!(cxt->nholders + cxt->npartitions)) {
-			if ((p = get_device_mountpoint(cxt)))
-				tt_line_set_data(ln, col, p);
-		}
+		if (!(cxt->nholders + cxt->npartitions))
+			p = get_device_mountpoint(cxt);
 		break;
 	case COL_LABEL:
 		probe_device(cxt);
-		if (!cxt->label)
-			break;
-
-		tt_line_set_data(ln, col, xstrdup(cxt->label));
+		if (cxt->label)
+			p = xstrdup(cxt->label);
 		break;
 	case COL_UUID:
 		probe_device(cxt);
 		if (cxt->uuid)
-			tt_line_set_data(ln, col, xstrdup(cxt->uuid));
+			p = xstrdup(cxt->uuid);
 		break;
 	case COL_PARTLABEL:
 		probe_device(cxt);
-		if (!cxt->partlabel)
-			break;
-
-		tt_line_set_data(ln, col, xstrdup(cxt->partlabel));
+		if (cxt->partlabel)
+			p = xstrdup(cxt->partlabel);
 		break;
 	case COL_PARTUUID:
 		probe_device(cxt);
 		if (cxt->partuuid)
-			tt_line_set_data(ln, col, xstrdup(cxt->partuuid));
+			p = xstrdup(cxt->partuuid);
 		break;
 	case COL_WWN:
 		get_udev_properties(cxt);
 		if (cxt->wwn)
-			tt_line_set_data(ln, col, xstrdup(cxt->wwn));
+			p = xstrdup(cxt->wwn);
 		break;
 	case COL_RA:
 		p = sysfs_strdup(&cxt->sysfs, "queue/read_ahead_kb");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_RO:
-		tt_line_set_data(ln, col, is_readonly_device(cxt) ?
-					xstrdup("1") : xstrdup("0"));
+		p = xstrdup(is_readonly_device(cxt) ? "1" : "0");
 		break;
 	case COL_RM:
 		p = sysfs_strdup(&cxt->sysfs, "removable");
 		if (!p && cxt->sysfs.parent)
 			p = sysfs_strdup(cxt->sysfs.parent, "removable");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_ROTA:
 		p = sysfs_strdup(&cxt->sysfs, "queue/rotational");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_RAND:
 		p = sysfs_strdup(&cxt->sysfs, "queue/add_random");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_MODEL:
-		if (!cxt->partition && cxt->nslaves == 0) {
+		if (!cxt->partition && cxt->nslaves == 0)
 			p = sysfs_strdup(&cxt->sysfs, "device/model");
-			if (p)
-				tt_line_set_data(ln, col, p);
-		}
 		break;
 	case COL_REV:
-		if (!cxt->partition && cxt->nslaves == 0) {
+		if (!cxt->partition && cxt->nslaves == 0)
 			p = sysfs_strdup(&cxt->sysfs, "device/rev");
-			if (p)
-				tt_line_set_data(ln, col, p);
-		}
 		break;
 	case COL_VENDOR:
-		if (!cxt->partition && cxt->nslaves == 0) {
+		if (!cxt->partition && cxt->nslaves == 0)
 			p = sysfs_strdup(&cxt->sysfs, "device/vendor");
-			if (p)
-				tt_line_set_data(ln, col, p);
-		}
 		break;
 	case COL_SIZE:
 		if (cxt->size) {
@@ -795,8 +786,6 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 				xasprintf(&p, "%jd", cxt->size);
 			else
 				p = size_to_human_string(SIZE_SUFFIX_1LETTER, cxt->size);
-			if (p)
-				tt_line_set_data(ln, col, p);
 		}
 		break;
 	case COL_STATE:
@@ -807,69 +796,47 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 			if (sysfs_read_int(&cxt->sysfs, "dm/suspended", &x) == 0)
 				p = x ? xstrdup("suspended") : xstrdup("running");
 		}
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_ALIOFF:
 		p = sysfs_strdup(&cxt->sysfs, "alignment_offset");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_MINIO:
 		p = sysfs_strdup(&cxt->sysfs, "queue/minimum_io_size");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_OPTIO:
 		p = sysfs_strdup(&cxt->sysfs, "queue/optimal_io_size");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_PHYSEC:
 		p = sysfs_strdup(&cxt->sysfs, "queue/physical_block_size");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_LOGSEC:
 		p = sysfs_strdup(&cxt->sysfs, "queue/logical_block_size");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_SCHED:
 		p = get_scheduler(cxt);
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_RQ_SIZE:
 		p = sysfs_strdup(&cxt->sysfs, "queue/nr_requests");
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_TYPE:
 		p = get_type(cxt);
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_HCTL:
 	{
 		int h, c, t, l;
-		if (sysfs_scsi_get_hctl(&cxt->sysfs, &h, &c, &t, &l) == 0) {
-			snprintf(buf, sizeof(buf), "%d:%d:%d:%d", h, c, t, l);
-			tt_line_set_data(ln, col, xstrdup(buf));
-		}
+		if (sysfs_scsi_get_hctl(&cxt->sysfs, &h, &c, &t, &l) == 0)
+			xasprintf(&p, "%d:%d:%d:%d", h, c, t, l);
 		break;
 	}
 	case COL_TRANSPORT:
 		p = get_transport(cxt);
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_DALIGN:
 		p = sysfs_strdup(&cxt->sysfs, "discard_alignment");
-		if (cxt->discard && p)
-			tt_line_set_data(ln, col, p);
-		else
-			tt_line_set_data(ln, col, "0");
+		if (!cxt->discard || !p) {
+			free(p);
+			p = xstrdup("0");
+		}
 		break;
 	case COL_DGRAN:
 		if (lsblk->bytes)
@@ -881,8 +848,6 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 					   "queue/discard_granularity", &x) == 0)
 				p = size_to_human_string(SIZE_SUFFIX_1LETTER, x);
 		}
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_DMAX:
 		if (lsblk->bytes)
@@ -894,15 +859,13 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 					   "queue/discard_max_bytes", &x) == 0)
 				p = size_to_human_string(SIZE_SUFFIX_1LETTER, x);
 		}
-		if (p)
-			tt_line_set_data(ln, col, p);
 		break;
 	case COL_DZERO:
 		p = sysfs_strdup(&cxt->sysfs, "queue/discard_zeroes_data");
-		if (cxt->discard && p)
-			tt_line_set_data(ln, col, p);
-		else
-			tt_line_set_data(ln, col, "0");
+		if (!cxt->discard || !p) {
+			free(p);
+			p = xstrdup("0");
+		}
 		break;
 	case COL_WSAME:
 		if (lsblk->bytes)
@@ -914,19 +877,226 @@ static void set_tt_data(struct blkdev_cxt *cxt, int col, int id, struct tt_line
 					   "queue/write_same_max_bytes", &x) == 0)
 				p = size_to_human_string(SIZE_SUFFIX_1LETTER, x);
 		}
-		tt_line_set_data(ln, col, p ? p : "0");
+		if (!p)
+			p = xstrdup("0");
 		break;
 	};
+
+	return p;
+}
+
+static void set_tt_data(struct tt_line *ln, int col, char *data)
+{
+	if (data)
+		tt_line_set_data_dup(ln, col, data);
+	free(data);
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * With --threads the device tree is walked as usual, but print_device() only
+ * records the devices. The column data are collected by a pool of threads and
+ * the lines are added to the table by the main thread in the original order,
+ * so the output is the same as for the serial scan.
+ */
+struct blkdev_job {
+	struct blkdev_job	*parent;	/* parental line */
+	struct blkdev_cxt	cxt;		/* copy of the device context */
+	dev_t			devno;
+	dev_t			pdevno;		/* cxt.sysfs.parent devno or 0 */
+	char			**data;		/* columns data */
+	struct tt_line		*tt_line;
+	int			done;
+};
+
+static struct blkdev_job **jobs;
+static size_t njobs;
+
+struct job_thread_data {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* a job is done */
+	size_t			next;		/* next unprocessed job */
+};
+
+/*
+ * The columns depend on the parental context or on non-thread-safe functions
+ * (getpwuid(), shared libmount table), the data are collected by the main
+ * thread in print_device().
+ */
+static int is_main_column(int id)
+{
+	switch (id) {
+	case COL_PKNAME:
+	case COL_TARGET:
+	case COL_OWNER:
+	case COL_GROUP:
+	case COL_MODE:
+		return 1;
+	}
+	return 0;
 }
 
-static void print_device(struct blkdev_cxt *cxt, struct tt_line *tt_parent)
+static void add_job(struct blkdev_cxt *cxt, struct blkdev_cxt *parent)
 {
+	struct blkdev_job *job = xcalloc(1, sizeof(*job));
+	struct blkdev_cxt *x = &job->cxt;
 	int i;
 
-	cxt->tt_line = tt_add_line(lsblk->tt, tt_parent);
+	job->parent = parent ? parent->job : NULL;
+	job->data = xcalloc(ncolumns, sizeof(char *));
+
+	for (i = 0; i < ncolumns; i++) {
+		int id = get_column_id(i);
+
+		if (is_main_column(id))
+			job->data[i] = get_column_data(cxt, id);
+	}
+
+	/* the sysfs handler is opened by the thread */
+	job->devno = cxt->sysfs.devno;
+	job->pdevno = cxt->sysfs.parent ? cxt->sysfs.parent->devno : 0;
+
+	*x = *cxt;
+	x->parent = NULL;
+	x->tt_line = NULL;
+	x->job = NULL;
+	x->name = xstrdup(cxt->name);
+	x->dm_name = xstrdup(cxt->dm_name);
+	x->filename = xstrdup(cxt->filename);
+	x->fstype = xstrdup(cxt->fstype);
+	x->uuid = xstrdup(cxt->uuid);
+	x->label = xstrdup(cxt->label);
+	x->partuuid = xstrdup(cxt->partuuid);
+	x->partlabel = xstrdup(cxt->partlabel);
+	x->wwn = xstrdup(cxt->wwn);
+	memset(&x->sysfs, 0, sizeof(x->sysfs));
+	x->sysfs.dir_fd = -1;
+
+	if (njobs % 64 == 0)
+		jobs = xrealloc(jobs, (njobs + 64) * sizeof(struct blkdev_job *));
+	jobs[njobs++] = job;
+	cxt->job = job;
+}
+
+static void collect_job_data(struct blkdev_job *job)
+{
+	struct blkdev_cxt *cxt = &job->cxt;
+	struct sysfs_cxt parent;
+	int i, has_parent;
+
+	has_parent = job->pdevno && sysfs_init(&parent, job->pdevno, NULL) == 0;
+
+	if (sysfs_init(&cxt->sysfs, job->devno, has_parent ? &parent : NULL) == 0) {
+		for (i = 0; i < ncolumns; i++) {
+			int id = get_column_id(i);
+
+			if (!is_main_column(id))
+				job->data[i] = get_column_data(cxt, id);
+		}
+		sysfs_deinit(&cxt->sysfs);
+	}
+	if (has_parent)
+		sysfs_deinit(&parent);
+}
+
+static void *job_thread(void *arg)
+{
+	struct job_thread_data *td = (struct job_thread_data *) arg;
+
+	for (;;) {
+		struct blkdev_job *job;
+		size_t i;
+
+		pthread_mutex_lock(&td->lock);
+		i = td->next++;
+		pthread_mutex_unlock(&td->lock);
+
+		if (i >= njobs)
+			break;
+
+		job = jobs[i];
+		collect_job_data(job);
+
+		pthread_mutex_lock(&td->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&td->cond);
+		pthread_mutex_unlock(&td->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Collects the data for all the jobs by lsblk->nthreads threads and adds the
+ * lines to the table as soon as the data are available.
+ */
+static void process_jobs(void)
+{
+	struct job_thread_data td;
+	pthread_t *threads;
+	size_t i, n, nthreads = lsblk->nthreads;
+
+	if (!njobs)
+		return;
+	if (nthreads > njobs)
+		nthreads = njobs;
+
+	memset(&td, 0, sizeof(td));
+	pthread_mutex_init(&td.lock, NULL);
+	pthread_cond_init(&td.cond, NULL);
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, job_thread, &td))
+			break;
+	}
+	if (n == 0)
+		job_thread(&td);	/* no thread created, do it yourself */
+
+	for (i = 0; i < njobs; i++) {
+		struct blkdev_job *job = jobs[i];
+		int col;
+
+		pthread_mutex_lock(&td.lock);
+		while (!job->done)
+			pthread_cond_wait(&td.cond, &td.lock);
+		pthread_mutex_unlock(&td.lock);
+
+		job->tt_line = tt_add_line(lsblk->tt,
+				job->parent ? job->parent->tt_line : NULL);
+		for (col = 0; col < ncolumns; col++)
+			set_tt_data(job->tt_line, col, job->data[col]);
+		free(job->data);
+		reset_blkdev_cxt(&job->cxt);
+	}
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_cond_destroy(&td.cond);
+	pthread_mutex_destroy(&td.lock);
+	free(threads);
+
+	for (i = 0; i < njobs; i++)
+		free(jobs[i]);
+	free(jobs);
+	jobs = NULL;
+	njobs = 0;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+static void print_device(struct blkdev_cxt *cxt, struct blkdev_cxt *parent)
+{
+	int i;
+
+#ifdef HAVE_LIBPTHREAD
+	if (lsblk->nthreads > 1) {
+		add_job(cxt, parent);
+		return;
+	}
+#endif
+	cxt->tt_line = tt_add_line(lsblk->tt, parent ? parent->tt_line : NULL);
 
 	for (i = 0; i < ncolumns; i++)
-		set_tt_data(cxt, i, get_column_id(i), cxt->tt_line);
+		set_tt_data(cxt->tt_line, i, get_column_data(cxt, get_column_id(i)));
 }
 
 static int set_cxt(struct blkdev_cxt *cxt,
@@ -1048,7 +1218,7 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 				goto next;
 
 			wholedisk_cxt->parent = &part_cxt;
-			print_device(&part_cxt, parent_cxt ? parent_cxt->tt_line : NULL);
+			print_device(&part_cxt, parent_cxt);
 			if (!lsblk->nodeps)
 				process_blkdev(wholedisk_cxt, &part_cxt, 0, NULL);
 		} else {
@@ -1062,7 +1232,7 @@ static int list_partitions(struct blkdev_cxt *wholedisk_cxt, struct blkdev_cxt *
 
 			/* Print whole disk only once */
 			if (r)
-				print_device(wholedisk_cxt, parent_cxt ? parent_cxt->tt_line : NULL);
+				print_device(wholedisk_cxt, parent_cxt);
 			if (ps == 0 && !lsblk->nodeps)
 				process_blkdev(&part_cxt, wholedisk_cxt, 0, NULL);
 		}
@@ -1151,7 +1321,7 @@ static int process_blkdev(struct blkdev_cxt *cxt, struct blkdev_cxt *parent,
 	if (do_partitions && cxt->npartitions)
 		return list_partitions(cxt, parent, part_name);
 
-	print_device(cxt, parent ? parent->tt_line : NULL);
+	print_device(cxt, parent);
 	return list_deps(cxt);
 }
 
@@ -1339,6 +1509,7 @@ static void __attribute__((__noreturn__)) help(FILE *out)
 	fputs(_(" -f, --fs             output info about filesystems\n"), out);
 	fputs(_(" -h, --help           usage information (this)\n"), out);
 	fputs(_(" -i, --ascii          use ascii characters only\n"), out);
+	fputs(_(" -j, --threads <num>  collect device data by <num> parallel threads\n"), out);
 	fputs(_(" -m, --perms          output info about permissions\n"), out);
 	fputs(_(" -l, --list           use list format output\n"), out);
 	fputs(_(" -n, --noheadings     don't print headings\n"), out);
@@ -1387,6 +1558,7 @@ int main(int argc, char *argv[])
 		{ "noheadings",	0, 0, 'n' },
 		{ "list",       0, 0, 'l' },
 		{ "ascii",	0, 0, 'i' },
+		{ "threads",	1, 0, 'j' },
 		{ "raw",        0, 0, 'r' },
 		{ "inverse",	0, 0, 's' },
 		{ "fs",         0, 0, 'f' },
@@ -1415,7 +1587,7 @@ int main(int argc, char *argv[])
 	memset(lsblk, 0, sizeof(*lsblk));
 
 	while((c = getopt_long(argc, argv,
-			       "abdDe:fhlnmo:PiI:rstVS", longopts, NULL)) != -1) {
+			       "abdDe:fhj:lnmo:PiI:rstVS", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -1442,6 +1614,14 @@ int main(int argc, char *argv[])
 		case 'h':
 			help(stdout);
 			break;
+		case 'j':
+			lsblk->nthreads = strtou32_or_err(optarg,
+					_("invalid number of threads argument"));
+			if (!lsblk->nthreads) {
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				lsblk->nthreads = n > 0 ? n : 1;
+			}
+			break;
 		case 'l':
 			tt_flags &= ~TT_FL_TREE; /* disable the default */
 			break;
@@ -1534,6 +1714,11 @@ int main(int argc, char *argv[])
 		excludes[nexcludes++] = 1;	/* default: ignore RAM disks */
 
 	mnt_init_debug(0);
+	blkid_init_debug(0);	/* before the -j threads */
+
+	/* raw and pairs output does not need column widths, print it continuously */
+	if (tt_flags & (TT_FL_RAW | TT_FL_EXPORT))
+		tt_flags |= TT_FL_STREAM;
 
 	/*
 	 * initialize output columns
@@ -1559,6 +1744,9 @@ int main(int argc, char *argv[])
 	else while (optind < argc)
 		status = process_one_device(argv[optind++]);
 
+#ifdef HAVE_LIBPTHREAD
+	process_jobs();
+#endif
 	tt_print_table(lsblk->tt);
 
 leave:
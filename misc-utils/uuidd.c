@@ -20,9 +20,12 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #else
@@ -36,6 +39,8 @@ extern int optind;
 #include "all-io.h"
 #include "c.h"
 #include "closestream.h"
+#include "list.h"
+#include "xalloc.h"
 
 #ifdef USE_SOCKET_ACTIVATION
 #include "sd-daemon.h"
@@ -64,6 +69,63 @@ struct uuidd_cxt_t {
 			no_sock: 1;
 };
 
+#define UUIDD_MAX_EVENTS	64
+#define UUIDD_MAX_CLIENTS	256	/* the least recently used idle client is
+					   disconnected if the limit is reached */
+#define UUIDD_OUTBUF_MAX	(64 * 1024)	/* don't read the next request
+						   if more output is pending */
+#define UUIDD_STREAM_CHUNK	1024	/* UUIDs generated per one stream step */
+
+#define UUIDD_RING_SIZE		8192	/* pre-generated random UUIDs */
+#define UUIDD_RING_CHUNK	256	/* UUIDs generated per one refill step */
+
+#define UUIDD_TIME_RESERVE	1000	/* time UUIDs reserved per one clock update */
+
+/* client connection */
+struct uuidd_client {
+	int		fd;
+	struct list_head clients;	/* LRU, the most recently used first */
+
+	char		in[64];		/* incomplete requests */
+	size_t		in_len;
+
+	char		*out;		/* pending replies */
+	size_t		out_pos;	/* already written bytes */
+	size_t		out_len;
+	size_t		out_size;
+
+	int32_t		stream;		/* remaining UUIDs of the stream */
+	uint32_t	events;		/* registered epoll events */
+	unsigned int	eof : 1;
+};
+
+/* pre-generated random UUIDs */
+struct uuidd_ring {
+	unsigned char	*data;
+	size_t		head;		/* the first unused UUID */
+	size_t		count;		/* number of unused UUIDs */
+};
+
+/* reserved time UUIDs, see also uuid_generate_time() in libuuid */
+struct uuidd_time {
+	uuid_t		next;
+	int		num;		/* number of remaining reserved UUIDs */
+	time_t		last;
+};
+
+struct uuidd_server {
+	const struct uuidd_cxt_t *cxt;
+	int		efd;		/* epoll */
+	int		sfd;		/* listening socket */
+
+	struct list_head clients;
+	size_t		nclients;
+
+	struct uuidd_ring ring;
+	struct uuidd_time time;
+	struct uuidd_shm *shm;		/* shared memory channel or NULL */
+};
+
 static void __attribute__ ((__noreturn__)) usage(FILE * out)
 {
 	fputs(_("\nUsage:\n"), out);
@@ -101,7 +163,7 @@ static void create_daemon(void)
 		err(EXIT_FAILURE, "setreuid");
 }
 
-static const char *cleanup_pidfile, *cleanup_socket;
+static const char *cleanup_pidfile, *cleanup_socket, *cleanup_shm;
 
 static void terminate_intr(int signo CODE_ATTR((unused)))
 {
@@ -109,26 +171,15 @@ static void terminate_intr(int signo CODE_ATTR((unused)))
 		unlink(cleanup_pidfile);
 	if (cleanup_socket)
 		unlink(cleanup_socket);
+	if (cleanup_shm)
+		unlink(cleanup_shm);
 	exit(EXIT_SUCCESS);
 }
 
-static int call_daemon(const char *socket_path, int op, char *buf,
-		       size_t buflen, int *num, const char **err_context)
+static int connect_daemon(const char *socket_path, const char **err_context)
 {
-	char op_buf[8];
-	int op_len;
-	int s;
-	ssize_t ret;
-	int32_t reply_len = 0;
 	struct sockaddr_un srv_addr;
-
-	if (((op == UUIDD_OP_BULK_TIME_UUID) ||
-	     (op == UUIDD_OP_BULK_RANDOM_UUID)) && !num) {
-		if (err_context)
-			*err_context = _("bad arguments");
-		errno = EINVAL;
-		return -1;
-	}
+	int s;
 
 	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
 		if (err_context)
@@ -147,6 +198,29 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 		close(s);
 		return -1;
 	}
+	return s;
+}
+
+static int call_daemon(const char *socket_path, int op, char *buf,
+		       size_t buflen, int *num, const char **err_context)
+{
+	char op_buf[8];
+	int op_len;
+	int s;
+	ssize_t ret;
+	int32_t reply_len = 0;
+
+	if (((op == UUIDD_OP_BULK_TIME_UUID) ||
+	     (op == UUIDD_OP_BULK_RANDOM_UUID)) && !num) {
+		if (err_context)
+			*err_context = _("bad arguments");
+		errno = EINVAL;
+		return -1;
+	}
+
+	s = connect_daemon(socket_path, err_context);
+	if (s < 0)
+		return -1;
 
 	if (op == UUIDD_OP_BULK_RANDOM_UUID) {
 		if ((*num) * UUID_LEN > buflen - 4)
@@ -201,6 +275,63 @@ static int call_daemon(const char *socket_path, int op, char *buf,
 	return ret;
 }
 
+/*
+ * Requests @num random UUIDs by UUIDD_OP_STREAM_RANDOM_UUID and prints them,
+ * the number of UUIDs is not limited by the size of the reply buffer.
+ */
+static int stream_daemon(const char *socket_path, int num,
+			 const char **err_context)
+{
+	unsigned char buf[256 * UUID_LEN];
+	char op_buf[1 + sizeof(int32_t)], str[UUID_STR_LEN];
+	int32_t reply_num = 0;
+	int i, s, rc = -1;
+
+	s = connect_daemon(socket_path, err_context);
+	if (s < 0)
+		return -1;
+
+	op_buf[0] = UUIDD_OP_STREAM_RANDOM_UUID;
+	memcpy(op_buf + 1, &num, sizeof(int32_t));
+
+	if (write_all(s, op_buf, sizeof(op_buf)) < 0) {
+		if (err_context)
+			*err_context = _("write");
+		goto done;
+	}
+	if (read_all(s, (char *) &reply_num, sizeof(reply_num))
+	    != sizeof(reply_num)) {
+		if (err_context)
+			*err_context = _("read count");
+		goto done;
+	}
+	if (reply_num != num) {
+		if (err_context)
+			*err_context = _("bad response length");
+		goto done;
+	}
+
+	printf(_("List of UUIDs:\n"));
+	while (num > 0) {
+		int n = min(num, 256);
+
+		if (read_all(s, (char *) buf, n * UUID_LEN) != (ssize_t) (n * UUID_LEN)) {
+			if (err_context)
+				*err_context = _("read");
+			goto done;
+		}
+		for (i = 0; i < n; i++) {
+			uuid_unparse(buf + i * UUID_LEN, str);
+			printf("\t%s\n", str);
+		}
+		num -= n;
+	}
+	rc = 0;
+done:
+	close(s);
+	return rc;
+}
+
 /*
  * Exclusively create and open a pid file with path @pidfile_path
  *
@@ -291,16 +422,493 @@ static int create_socket(const char *socket_path, int will_fork, int quiet)
 	return s;
 }
 
+/*
+ * Create the shared memory channel file (see uuidd.h). The file is accessible
+ * for the same group as the libuuid clock file, the clients without access
+ * use the socket only.
+ *
+ * Returns the mapped file or NULL on error.
+ */
+static struct uuidd_shm *create_shm(const char *shm_path, int quiet)
+{
+	struct uuidd_shm *shm;
+	mode_t save_umask;
+	int fd;
+
+	unlink(shm_path);
+	save_umask = umask(0);
+	fd = open(shm_path, O_RDWR | O_CREAT | O_EXCL, 0660);
+	umask(save_umask);
+	if (fd < 0)
+		goto err;
+
+	cleanup_shm = shm_path;
+	if (ftruncate(fd, sizeof(struct uuidd_shm)) != 0) {
+		close(fd);
+		goto err;
+	}
+	shm = mmap(NULL, sizeof(struct uuidd_shm), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		goto err;
+
+	shm->size = sizeof(struct uuidd_shm);
+	shm->head = 0;			/* blocks[0].gen = 0, invalid */
+	__sync_synchronize();
+	shm->magic = UUIDD_SHM_MAGIC;
+	return shm;
+err:
+	if (!quiet)
+		warn(_("cannot create shared memory %s"), shm_path);
+	return NULL;
+}
+
+/*
+ * Reserves a new block of time UUIDs and makes it the current block.
+ */
+static void shm_publish(struct uuidd_server *srv)
+{
+	struct uuidd_shm *shm = srv->shm;
+	struct uuidd_shm_block *blk;
+	uint64_t gen = shm->head + 1;
+	int num = UUIDD_SHM_BLOCKSZ;
+
+	blk = &shm->blocks[gen % UUIDD_SHM_NBLOCKS];
+
+	/* the clients ignore the block until the new generation is set */
+	blk->gen = 0;
+	__sync_synchronize();
+
+	__uuid_generate_time(blk->first, &num);
+	blk->count = num;
+	blk->claimed = 0;
+	blk->expires = time(NULL) + 1;
+
+	__sync_synchronize();
+	blk->gen = gen;
+	__sync_synchronize();
+	shm->head = gen;
+
+	if (srv->cxt->debug)
+		fprintf(stderr, _("published shared block %ju\n"), (uintmax_t) gen);
+}
+
+/*
+ * Publishes a new block if the current block is exhausted or it's going
+ * to expire. Called for time UUID requests, the clients use the socket if
+ * there is no usable block.
+ */
+static void shm_update(struct uuidd_server *srv)
+{
+	struct uuidd_shm_block *blk;
+
+	if (!srv->shm)
+		return;
+
+	blk = &srv->shm->blocks[srv->shm->head % UUIDD_SHM_NBLOCKS];
+	if (blk->gen != srv->shm->head ||
+	    blk->claimed >= blk->count ||
+	    blk->expires <= time(NULL))
+		shm_publish(srv);
+}
+
+static void ring_init(struct uuidd_ring *ring)
+{
+	ring->data = xmalloc(UUIDD_RING_SIZE * UUID_LEN);
+	ring->head = ring->count = 0;
+}
+
+/*
+ * Generates the next chunk of the random UUIDs to the ring. Returns 1 if the
+ * ring is not full yet.
+ */
+static int ring_refill(struct uuidd_ring *ring)
+{
+	size_t tail = (ring->head + ring->count) % UUIDD_RING_SIZE;
+	int num = min(UUIDD_RING_SIZE - ring->count, UUIDD_RING_SIZE - tail);
+
+	if (!num)
+		return 0;
+	if (num > UUIDD_RING_CHUNK)
+		num = UUIDD_RING_CHUNK;
+
+	__uuid_generate_random(ring->data + tail * UUID_LEN, &num);
+	ring->count += num;
+
+	return ring->count < UUIDD_RING_SIZE;
+}
+
+/*
+ * Copies @num random UUIDs to @out, the pre-generated UUIDs are used first.
+ */
+static void get_random_uuids(struct uuidd_ring *ring, unsigned char *out, int num)
+{
+	while (num > 0 && ring->count) {
+		int n = min(ring->count, UUIDD_RING_SIZE - ring->head);
+
+		if (n > num)
+			n = num;
+		memcpy(out, ring->data + ring->head * UUID_LEN, n * UUID_LEN);
+
+		ring->head = (ring->head + n) % UUIDD_RING_SIZE;
+		ring->count -= n;
+		out += n * UUID_LEN;
+		num -= n;
+	}
+	if (num > 0)
+		__uuid_generate_random(out, &num);
+}
+
+/* increments the timestamp, see uuid_time_next() in libuuid */
+static void uuid_time_next(uuid_t uu)
+{
+	int i;
+
+	for (i = 3; i >= 0; i--)		/* time_low */
+		if (++uu[i])
+			return;
+	for (i = 5; i >= 4; i--)		/* time_mid */
+		if (++uu[i])
+			return;
+	if (++uu[7] == 0)			/* time_hi_and_version */
+		uu[6] = (uu[6] & 0xF0) | ((uu[6] + 1) & 0x0F);
+}
+
+/*
+ * Returns the next time UUID from the reserved block. The block is not used
+ * for longer than one second to keep the timestamps reasonable.
+ */
+static void get_time_uuid(struct uuidd_time *tm, uuid_t out)
+{
+	time_t now = time(NULL);
+
+	if (tm->num <= 0 || now > tm->last + 1) {
+		tm->num = UUIDD_TIME_RESERVE;
+		__uuid_generate_time(tm->next, &tm->num);
+		tm->last = now;
+	}
+	uuid_copy(out, tm->next);
+	uuid_time_next(tm->next);
+	tm->num--;
+}
+
+static void *client_reserve(struct uuidd_client *cl, size_t len)
+{
+	char *p;
+
+	if (cl->out_pos && cl->out_pos == cl->out_len)
+		cl->out_pos = cl->out_len = 0;
+
+	if (cl->out_len + len > cl->out_size) {
+		if (cl->out_pos) {
+			memmove(cl->out, cl->out + cl->out_pos,
+				cl->out_len - cl->out_pos);
+			cl->out_len -= cl->out_pos;
+			cl->out_pos = 0;
+		}
+		if (cl->out_len + len > cl->out_size) {
+			cl->out_size = cl->out_len + len;
+			cl->out = xrealloc(cl->out, cl->out_size);
+		}
+	}
+	p = cl->out + cl->out_len;
+	cl->out_len += len;
+	return p;
+}
+
+static void client_reply(struct uuidd_client *cl, const char *data, int32_t len)
+{
+	char *p = client_reserve(cl, sizeof(len) + len);
+
+	memcpy(p, &len, sizeof(len));
+	memcpy(p + sizeof(len), data, len);
+}
+
+static size_t client_pending(struct uuidd_client *cl)
+{
+	return cl->out_len - cl->out_pos;
+}
+
+/*
+ * Generates the next part of the UUIDD_OP_STREAM_RANDOM_UUID reply.
+ */
+static void client_stream(struct uuidd_server *srv, struct uuidd_client *cl)
+{
+	int num = min(cl->stream, UUIDD_STREAM_CHUNK);
+
+	get_random_uuids(&srv->ring, client_reserve(cl, num * UUID_LEN), num);
+	cl->stream -= num;
+}
+
+/*
+ * Parses and serves one request from the client input buffer. Returns 1 if
+ * the request has been served, 0 if the request is incomplete and -1 on
+ * invalid request.
+ */
+static int client_request(struct uuidd_server *srv, struct uuidd_client *cl)
+{
+	const struct uuidd_cxt_t *uuidd_cxt = srv->cxt;
+	char	reply_buf[1024], *cp;
+	char	op, str[UUID_STR_LEN];
+	int32_t	reply_len = 0;
+	size_t	len = 1;
+	uuid_t	uu;
+	int	i, num = 0;
+
+	if (!cl->in_len)
+		return 0;
+
+	op = cl->in[0];
+	if ((op == UUIDD_OP_BULK_TIME_UUID) ||
+	    (op == UUIDD_OP_BULK_RANDOM_UUID) ||
+	    (op == UUIDD_OP_STREAM_RANDOM_UUID)) {
+		len += sizeof(num);
+		if (cl->in_len < len)
+			return 0;
+		memcpy(&num, cl->in + 1, sizeof(num));
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("operation %d, incoming num = %d\n"),
+			       op, num);
+	} else if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), op);
+
+	cl->in_len -= len;
+	memmove(cl->in, cl->in + len, cl->in_len);
+
+	switch (op) {
+	case UUIDD_OP_GETPID:
+		sprintf(reply_buf, "%d", getpid());
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_MAXOP:
+		sprintf(reply_buf, "%d", UUIDD_MAX_OP);
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_TIME_UUID:
+		shm_update(srv);
+		get_time_uuid(&srv->time, uu);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_RANDOM_UUID:
+		get_random_uuids(&srv->ring, uu, 1);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_UUID:
+		shm_update(srv);
+		__uuid_generate_time(uu, &num);
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, P_("Generated time UUID %s "
+					   "and %d following\n",
+					   "Generated time UUID %s "
+					   "and %d following\n", num - 1),
+			       str, num - 1);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		reply_len = sizeof(uu);
+		memcpy(reply_buf + reply_len, &num, sizeof(num));
+		reply_len += sizeof(num);
+		break;
+	case UUIDD_OP_BULK_RANDOM_UUID:
+		if (num < 0)
+			num = 1;
+		if (num > 1000)
+			num = 1000;
+		if (num * UUID_LEN > (int) (sizeof(reply_buf) - sizeof(num)))
+			num = (sizeof(reply_buf) - sizeof(num)) / UUID_LEN;
+		get_random_uuids(&srv->ring, (unsigned char *) reply_buf +
+				 sizeof(num), num);
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d UUID:\n",
+					   "Generated %d UUIDs:\n", num), num);
+			for (i = 0, cp = reply_buf + sizeof(num);
+			     i < num;
+			     i++, cp += UUID_LEN) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+			}
+		}
+		reply_len = (num * UUID_LEN) + sizeof(num);
+		memcpy(reply_buf, &num, sizeof(num));
+		break;
+	case UUIDD_OP_STREAM_RANDOM_UUID:
+		if (num < 0)
+			num = 0;
+		if (uuidd_cxt->debug)
+			fprintf(stderr, P_("Streaming %d UUID\n",
+					   "Streaming %d UUIDs\n", num), num);
+		/* the UUIDs are generated by client_stream() */
+		memcpy(client_reserve(cl, sizeof(num)), &num, sizeof(num));
+		cl->stream = num;
+		return 1;
+	default:
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), op);
+		return -1;
+	}
+
+	client_reply(cl, reply_buf, reply_len);
+	return 1;
+}
+
+static void client_update_events(struct uuidd_server *srv, struct uuidd_client *cl)
+{
+	struct epoll_event ev = { .data.ptr = cl };
+
+	if (!cl->eof && cl->in_len < sizeof(cl->in))
+		ev.events |= EPOLLIN;
+	if (client_pending(cl) || cl->stream)
+		ev.events |= EPOLLOUT;
+
+	if (ev.events != cl->events) {
+		epoll_ctl(srv->efd, EPOLL_CTL_MOD, cl->fd, &ev);
+		cl->events = ev.events;
+	}
+}
+
+static void client_close(struct uuidd_server *srv, struct uuidd_client *cl)
+{
+	if (srv->cxt->debug)
+		fprintf(stderr, _("closing connection %d\n"), cl->fd);
+
+	epoll_ctl(srv->efd, EPOLL_CTL_DEL, cl->fd, NULL);
+	close(cl->fd);
+	list_del(&cl->clients);
+	srv->nclients--;
+	free(cl->out);
+	free(cl);
+}
+
+/*
+ * Reads the requests, serves them and writes the replies as long as it's
+ * possible without blocking. Returns -1 if the connection should be closed.
+ */
+static int client_process(struct uuidd_server *srv, struct uuidd_client *cl,
+			  uint32_t events)
+{
+	if (events & EPOLLERR)
+		return -1;
+
+	/* move to the begin of the LRU list */
+	list_del(&cl->clients);
+	list_add(&cl->clients, &srv->clients);
+
+	if ((events & EPOLLIN) && !cl->eof && cl->in_len < sizeof(cl->in)) {
+		ssize_t ret = read(cl->fd, cl->in + cl->in_len,
+				   sizeof(cl->in) - cl->in_len);
+		if (ret > 0)
+			cl->in_len += ret;
+		else if (ret == 0)
+			cl->eof = 1;
+		else if (errno != EAGAIN && errno != EINTR)
+			return -1;
+	} else if (events & EPOLLHUP)
+		return -1;
+
+	while (1) {
+		ssize_t ret;
+
+		/* generate replies */
+		while (client_pending(cl) < UUIDD_OUTBUF_MAX) {
+			if (cl->stream)
+				client_stream(srv, cl);
+			else {
+				int rc = client_request(srv, cl);
+				if (rc < 0)
+					return -1;
+				if (rc == 0)
+					break;
+			}
+		}
+
+		if (!client_pending(cl))
+			break;
+
+		/* write replies */
+		ret = write(cl->fd, cl->out + cl->out_pos, client_pending(cl));
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+			return -1;
+		}
+		cl->out_pos += ret;
+	}
+
+	if (cl->eof && !client_pending(cl) && !cl->stream)
+		return -1;	/* all done */
+
+	client_update_events(srv, cl);
+	return 0;
+}
+
+static void server_accept(struct uuidd_server *srv)
+{
+	struct epoll_event ev;
+	struct uuidd_client *cl;
+	int ns;
+
+	ns = accept(srv->sfd, NULL, NULL);
+	if (ns < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR) ||
+		    (errno == ECONNABORTED))
+			return;
+		err(EXIT_FAILURE, "accept");
+	}
+	fcntl(ns, F_SETFL, O_NONBLOCK);
+	fcntl(ns, F_SETFD, FD_CLOEXEC);
+
+	if (srv->nclients >= UUIDD_MAX_CLIENTS) {
+		/* disconnect the least recently used idle client, libuuid
+		 * reconnects on the next request */
+		struct list_head *p;
+
+		list_for_each_backwardly(p, &srv->clients) {
+			cl = list_entry(p, struct uuidd_client, clients);
+			if (!client_pending(cl) && !cl->stream && !cl->in_len) {
+				client_close(srv, cl);
+				break;
+			}
+		}
+	}
+
+	cl = xcalloc(1, sizeof(*cl));
+	cl->fd = ns;
+	cl->events = EPOLLIN;
+	INIT_LIST_HEAD(&cl->clients);
+
+	ev.events = cl->events;
+	ev.data.ptr = cl;
+	if (epoll_ctl(srv->efd, EPOLL_CTL_ADD, ns, &ev) < 0) {
+		warn(_("epoll_ctl failed"));
+		close(ns);
+		free(cl);
+		return;
+	}
+	list_add(&cl->clients, &srv->clients);
+	srv->nclients++;
+
+	if (srv->cxt->debug)
+		fprintf(stderr, _("new connection %d\n"), ns);
+}
+
 static void server_loop(const char *socket_path, const char *pidfile_path,
 			const struct uuidd_cxt_t *uuidd_cxt)
 {
-	struct sockaddr_un	from_addr;
-	socklen_t		fromlen;
-	int32_t			reply_len = 0;
-	uuid_t			uu;
-	char			reply_buf[1024], *cp;
-	char			op, str[UUID_STR_LEN];
-	int			i, ns, len, num;
+	struct uuidd_server	srv = { .cxt = uuidd_cxt };
+	struct epoll_event	events[UUIDD_MAX_EVENTS], ev;
+	char			reply_buf[1024];
+	int			i, n, pending_accept;
 	int			s = 0;
 	int			fd_pidfile = -1;
 	int			ret;
@@ -366,112 +974,60 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	}
 #endif
 
+	fcntl(s, F_SETFL, O_NONBLOCK);
+
+	srv.sfd = s;
+	srv.efd = epoll_create1(EPOLL_CLOEXEC);
+	if (srv.efd < 0)
+		err(EXIT_FAILURE, "epoll_create");
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;		/* listening socket */
+	if (epoll_ctl(srv.efd, EPOLL_CTL_ADD, s, &ev) < 0)
+		err(EXIT_FAILURE, "epoll_ctl");
+
+	INIT_LIST_HEAD(&srv.clients);
+	ring_init(&srv.ring);
+
+	/* libuuid uses the default paths only */
+	if (strcmp(socket_path, UUIDD_SOCKET_PATH) == 0)
+		srv.shm = create_shm(UUIDD_SHM_PATH, uuidd_cxt->quiet);
+	if (srv.shm)
+		shm_publish(&srv);
+
 	while (1) {
-		fromlen = sizeof(from_addr);
-		if (uuidd_cxt->timeout > 0)
+		/* refill the ring of random UUIDs if there is nothing else
+		 * to do, otherwise wait for the clients */
+		int idle = srv.ring.count < UUIDD_RING_SIZE;
+
+		if (!idle && uuidd_cxt->timeout > 0)
 			alarm(uuidd_cxt->timeout);
-		ns = accept(s, (struct sockaddr *) &from_addr, &fromlen);
+		n = epoll_wait(srv.efd, events, UUIDD_MAX_EVENTS, idle ? 0 : -1);
 		alarm(0);
-		if (ns < 0) {
-			if ((errno == EAGAIN) || (errno == EINTR))
+		if (n < 0) {
+			if (errno == EINTR)
 				continue;
-			else
-				err(EXIT_FAILURE, "accept");
+			err(EXIT_FAILURE, "epoll_wait");
 		}
-		len = read(ns, &op, 1);
-		if (len != 1) {
-			if (len < 0)
-				perror("read");
-			else
-				fprintf(stderr, _("Error reading from client, "
-					 "len = %d\n"), len);
-			goto shutdown_socket;
+		if (n == 0) {
+			ring_refill(&srv.ring);
+			continue;
 		}
-		if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-		    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
-			if (read_all(ns, (char *) &num, sizeof(num)) != 4)
-				goto shutdown_socket;
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("operation %d, incoming num = %d\n"),
-				       op, num);
-		} else if (uuidd_cxt->debug)
-			fprintf(stderr, _("operation %d\n"), op);
-
-		switch (op) {
-		case UUIDD_OP_GETPID:
-			sprintf(reply_buf, "%d", getpid());
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_GET_MAXOP:
-			sprintf(reply_buf, "%d", UUIDD_MAX_OP);
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_TIME_UUID:
-			num = 1;
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated time UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_RANDOM_UUID:
-			num = 1;
-			__uuid_generate_random(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated random UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_BULK_TIME_UUID:
-			__uuid_generate_time(uu, &num);
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, P_("Generated time UUID %s "
-						   "and %d following\n",
-						   "Generated time UUID %s "
-						   "and %d following\n", num - 1),
-				       str, num - 1);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			memcpy(reply_buf + reply_len, &num, sizeof(num));
-			reply_len += sizeof(num);
-			break;
-		case UUIDD_OP_BULK_RANDOM_UUID:
-			if (num < 0)
-				num = 1;
-			if (num > 1000)
-				num = 1000;
-			if (num * UUID_LEN > (int) (sizeof(reply_buf) - sizeof(num)))
-				num = (sizeof(reply_buf) - sizeof(num)) / UUID_LEN;
-			__uuid_generate_random((unsigned char *) reply_buf +
-					      sizeof(num), &num);
-			if (uuidd_cxt->debug) {
-				fprintf(stderr, P_("Generated %d UUID:\n",
-						   "Generated %d UUIDs:\n", num), num);
-				for (i = 0, cp = reply_buf + sizeof(num);
-				     i < num;
-				     i++, cp += UUID_LEN) {
-					uuid_unparse((unsigned char *)cp, str);
-					fprintf(stderr, "\t%s\n", str);
-				}
-			}
-			reply_len = (num * UUID_LEN) + sizeof(num);
-			memcpy(reply_buf, &num, sizeof(num));
-			break;
-		default:
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("Invalid operation %d\n"), op);
-			goto shutdown_socket;
+
+		/* accept new connections after all the client events of the
+		 * batch, server_accept() may close an idle client that still
+		 * has an entry in events[] */
+		pending_accept = 0;
+		for (i = 0; i < n; i++) {
+			struct uuidd_client *cl = events[i].data.ptr;
+
+			if (!cl)
+				pending_accept = 1;
+			else if (client_process(&srv, cl, events[i].events) < 0)
+				client_close(&srv, cl);
 		}
-		write_all(ns, (char *) &reply_len, sizeof(reply_len));
-		write_all(ns, reply_buf, reply_len);
-	shutdown_socket:
-		close(ns);
+		if (pending_accept)
+			server_accept(&srv);
 	}
 }
 
@@ -486,10 +1042,10 @@ int main(int argc, char **argv)
 	const char	*pidfile_path = NULL;
 	const char	*pidfile_path_param = NULL;
 	const char	*err_context;
-	char		buf[1024], *cp;
+	char		buf[1024];
 	char		str[UUID_STR_LEN], *tmp;
 	uuid_t		uu;
-	int		i, c, ret;
+	int		c, ret;
 	int		do_type = 0, do_kill = 0, num = 0;
 	int		no_pid = 0;
 	int		s_flag = 0;
@@ -600,6 +1156,13 @@ int main(int argc, char **argv)
 		fprintf(stderr, _("Both --socket-activation and --socket specified. "
 				  "Ignoring --socket\n"));
 
+	if (num && do_type == UUIDD_OP_RANDOM_UUID) {
+		if (stream_daemon(socket_path, num, &err_context) < 0) {
+			printf(_("Error calling uuidd daemon (%s): %m\n"), err_context);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 	if (num && do_type) {
 		ret = call_daemon(socket_path, do_type + 2, buf,
 				  sizeof(buf), &num, &err_context);
@@ -607,25 +1170,14 @@ int main(int argc, char **argv)
 			printf(_("Error calling uuidd daemon (%s): %m\n"), err_context);
 			return EXIT_FAILURE;
 		}
-		if (do_type == UUIDD_OP_TIME_UUID) {
-			if (ret != sizeof(uu) + sizeof(num))
-				unexpected_size(ret);
+		if (ret != sizeof(uu) + sizeof(num))
+			unexpected_size(ret);
 
-			uuid_unparse((unsigned char *) buf, str);
+		uuid_unparse((unsigned char *) buf, str);
 
-			printf(P_("%s and %d subsequent UUID\n",
-				  "%s and %d subsequent UUIDs\n", num - 1),
-			       str, num - 1);
-		} else {
-			printf(_("List of UUIDs:\n"));
-			cp = buf + 4;
-			if (ret != (int) (sizeof(num) + num * sizeof(uu)))
-				unexpected_size(ret);
-			for (i = 0; i < num; i++, cp += UUID_LEN) {
-				uuid_unparse((unsigned char *) cp, str);
-				printf("\t%s\n", str);
-			}
-		}
+		printf(P_("%s and %d subsequent UUID\n",
+			  "%s and %d subsequent UUIDs\n", num - 1),
+		       str, num - 1);
 		return EXIT_SUCCESS;
 	}
 	if (do_type) {
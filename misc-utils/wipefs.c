@@ -29,6 +29,9 @@
 #include <getopt.h>
 #include <string.h>
 #include <limits.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include <blkid.h>
 
@@ -53,10 +56,34 @@ struct wipe_desc {
 	char		*uuid;		/* FS uuid */
 
 	int		on_disk;
+	int		erased;		/* magic string has been erased */
+	int		error;		/* errno of the failed erase */
 
 	struct wipe_desc	*next;
 };
 
+/*
+ * Erase request for one device; the devices are processed by do_wipe() in
+ * parallel if --threads is specified, and reported by main thread in the
+ * original order.
+ */
+struct wipe_job {
+	const char	*devname;
+	struct wipe_desc *wp;		/* requested offsets and detected signatures */
+
+	struct wipe_desc **erased;	/* erased signatures in the erase order */
+	size_t		nerased;
+
+	loff_t		*notfound;	/* requested offsets not found */
+	size_t		nnotfound;
+
+	int		error;		/* errno if the device cannot be probed */
+	int		done;
+};
+
+/* max number of probe-and-erase rounds for one device */
+#define WIPE_MAX_ROUNDS		8
+
 enum {
 	WP_MODE_PRETTY,		/* default */
 	WP_MODE_PARSABLE
@@ -127,10 +154,14 @@ print_all(struct wipe_desc *wp, int mode)
 	}
 }
 
+/*
+ * Returns the entry for @offset, the new entry is added to the begin of the
+ * @wp0 list.
+ */
 static struct wipe_desc *
-add_offset(struct wipe_desc *wp0, loff_t offset, int zap)
+add_offset(struct wipe_desc **wp0, loff_t offset, int zap)
 {
-	struct wipe_desc *wp = wp0;
+	struct wipe_desc *wp = *wp0;
 
 	while (wp) {
 		if (wp->offset == offset)
@@ -140,8 +171,9 @@ add_offset(struct wipe_desc *wp0, loff_t offset, int zap)
 
 	wp = xcalloc(1, sizeof(struct wipe_desc));
 	wp->offset = offset;
-	wp->next = wp0;
+	wp->next = *wp0;
 	wp->zap = zap;
+	*wp0 = wp;
 	return wp;
 }
 
@@ -151,16 +183,21 @@ clone_offset(struct wipe_desc *wp0)
 	struct wipe_desc *wp = NULL;
 
 	while(wp0) {
-		wp = add_offset(wp, wp0->offset, wp0->zap);
+		add_offset(&wp, wp0->offset, wp0->zap);
 		wp0 = wp0->next;
 	}
 
 	return wp;
 }
 
+/*
+ * Returns the entry for the current probing result or NULL if the result is
+ * not relevant.
+ */
 static struct wipe_desc *
-get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
+get_desc_for_probe(struct wipe_desc **wp0, blkid_probe pr)
 {
+	struct wipe_desc *wp;
 	const char *off, *type, *mag, *p, *usage = NULL;
 	size_t len;
 	loff_t offset;
@@ -172,7 +209,7 @@ get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
 		if (!rc)
 			rc = blkid_probe_lookup_value(pr, "SBMAGIC", &mag, &len);
 		if (rc)
-			return wp;
+			return NULL;
 
 	/* partitions */
 	} else if (blkid_probe_lookup_value(pr, "PTTYPE", &type, NULL) == 0) {
@@ -180,19 +217,25 @@ get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
 		if (!rc)
 			rc = blkid_probe_lookup_value(pr, "PTMAGIC", &mag, &len);
 		if (rc)
-			return wp;
+			return NULL;
 		usage = "partition table";
 	} else
-		return wp;
+		return NULL;
 
 	if (type_pattern && !match_fstype(type, type_pattern))
-		return wp;
+		return NULL;
 
 	offset = strtoll(off, NULL, 10);
 
-	wp = add_offset(wp, offset, 0);
-	if (!wp)
-		return NULL;
+	wp = add_offset(wp0, offset, 0);
+
+	/* the same offset could be detected again in the next erase round */
+	free(wp->usage);
+	free(wp->type);
+	free(wp->magic);
+	free(wp->label);
+	free(wp->uuid);
+	wp->usage = wp->label = wp->uuid = NULL;
 
 	if (usage || blkid_probe_lookup_value(pr, "USAGE", &usage, NULL) == 0)
 		wp->usage = xstrdup(usage);
@@ -213,16 +256,20 @@ get_desc_for_probe(struct wipe_desc *wp, blkid_probe pr)
 	return wp;
 }
 
+/*
+ * Returns the new probe or NULL (and errno) in case of error.
+ */
 static blkid_probe
 new_probe(const char *devname, int mode)
 {
-	blkid_probe pr;
+	blkid_probe pr = NULL;
+	int fd = -1;
 
 	if (!devname)
 		return NULL;
 
 	if (mode) {
-		int fd = open(devname, mode);
+		fd = open(devname, mode);
 		if (fd < 0)
 			goto error;
 
@@ -245,7 +292,14 @@ new_probe(const char *devname, int mode)
 
 	return pr;
 error:
-	err(EXIT_FAILURE, _("error: %s: probing initialization failed"), devname);
+	{
+		int errsv = errno;
+
+		blkid_free_probe(pr);
+		if (fd >= 0)
+			close(fd);
+		errno = errsv;
+	}
 	return NULL;
 }
 
@@ -255,13 +309,10 @@ read_offsets(struct wipe_desc *wp, const char *devname)
 	blkid_probe pr = new_probe(devname, 0);
 
 	if (!pr)
-		return NULL;
+		err(EXIT_FAILURE, _("error: %s: probing initialization failed"), devname);
 
-	while (blkid_do_probe(pr) == 0) {
-		wp = get_desc_for_probe(wp, pr);
-		if (!wp)
-			break;
-	}
+	while (blkid_do_probe(pr) == 0)
+		get_desc_for_probe(&wp, pr);
 
 	blkid_free_probe(pr);
 	return wp;
@@ -284,91 +335,368 @@ free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(blkid_probe pr, const char *devname, struct wipe_desc *w, int noact, int quiet)
+static int cmp_desc_offsets(const void *a, const void *b)
 {
-	size_t i;
+	const struct wipe_desc *x = *((const struct wipe_desc **) a);
+	const struct wipe_desc *y = *((const struct wipe_desc **) b);
 
-	if (blkid_do_wipe(pr, noact))
-		warn(_("%s: failed to erase %s magic string at offset 0x%08jx"),
-		     devname, w->type, w->offset);
-
-	if (quiet)
-		return;
+	return x->offset < y->offset ? -1 : x->offset > y->offset ? 1 : 0;
+}
 
-	printf(_("%s: %zd bytes were erased at offset 0x%08jx (%s): "),
-		devname, w->len, w->offset, w->type);
+/*
+ * Zeroes the magic strings of all @ws descriptions. The areas are sorted and
+ * the overlapping or adjacent areas are erased by one write. Returns number
+ * of successfully erased magic strings.
+ */
+static size_t do_wipe_real(int fd, struct wipe_desc **descs, size_t nws, int noact)
+{
+	unsigned char *zeros = NULL;
+	size_t zerosz = 0, i = 0, ok = 0;
+	struct wipe_desc **ws;
+
+	/* keep @descs in the probing order */
+	ws = xmalloc(nws * sizeof(struct wipe_desc *));
+	memcpy(ws, descs, nws * sizeof(struct wipe_desc *));
+	qsort(ws, nws, sizeof(struct wipe_desc *), cmp_desc_offsets);
+
+	while (i < nws) {
+		loff_t start = ws[i]->offset, end = start + ws[i]->len;
+		size_t n, len;
+		int rc = 0;
+
+		for (n = i + 1; n < nws && ws[n]->offset <= end; n++)
+			end = max(end, (loff_t) (ws[n]->offset + ws[n]->len));
+
+		len = end - start;
+		if (!noact) {
+			if (len > zerosz) {
+				zeros = xrealloc(zeros, len);
+				memset(zeros, 0, len);
+				zerosz = len;
+			}
+			errno = 0;
+			if (lseek(fd, start, SEEK_SET) == (off_t) -1 ||
+			    write_all(fd, zeros, len))
+				rc = errno ? errno : EIO;
+		}
 
-	for (i = 0; i < w->len; i++) {
-		printf("%02x", w->magic[i]);
-		if (i + 1 < w->len)
-			fputc(' ', stdout);
+		for ( ; i < n; i++) {
+			ws[i]->error = rc;
+			if (!rc) {
+				ws[i]->erased++;
+				ok++;
+			}
+		}
 	}
-	putchar('\n');
+
+	free(ws);
+	free(zeros);
+	return ok;
 }
 
-static struct wipe_desc *
-do_wipe(struct wipe_desc *wp, const char *devname, int noact, int all, int quiet, int force)
+/*
+ * Erases signatures from the job device. All signatures are detected first
+ * and then erased by do_wipe_real() with one fsync(). The device is probed
+ * again after that, because an erased signature could hide another one (the
+ * same what blkid_do_wipe() does by blkid_probe_step_back()).
+ */
+static void
+do_wipe(struct wipe_job *job, int noact, int all, int force)
 {
-	int flags;
+	int flags, fd, round;
 	blkid_probe pr;
-	struct wipe_desc *w, *wp0 = clone_offset(wp);
+	struct wipe_desc *w, *wp = job->wp, *wp0 = clone_offset(job->wp);
+	struct wipe_desc **ws = NULL;
+	size_t nws = 0, wssz = 0;
 	int zap = all ? 1 : wp->zap;
 
 	flags = O_RDWR;
 	if (!force)
 		flags |= O_EXCL;
-	pr = new_probe(devname, flags);
-	if (!pr)
-		return NULL;
+	pr = new_probe(job->devname, flags);
+	if (!pr) {
+		job->error = errno;
+		free_wipe(wp0);
+		return;
+	}
+	fd = blkid_probe_get_fd(pr);
 
-	while (blkid_do_probe(pr) == 0) {
-		wp = get_desc_for_probe(wp, pr);
-		if (!wp)
+	for (round = 0; zap && round < WIPE_MAX_ROUNDS; round++) {
+		size_t i, again = 0;
+
+		/* reset the probe and the buffers with the old data */
+		if (round && blkid_probe_set_device(pr, fd, 0, 0))
 			break;
 
-		/* Check if offset is in provided list */
-		w = wp0;
-		while(w && w->offset != wp->offset)
-			w = w->next;
-		if (wp0 && !w)
+		nws = 0;
+		while (blkid_do_probe(pr) == 0) {
+			struct wipe_desc *d = get_desc_for_probe(&wp, pr);
+
+			if (!d)
+				continue;
+
+			/* Check if offset is in provided list */
+			w = wp0;
+			while(w && w->offset != d->offset)
+				w = w->next;
+			if (wp0 && !w)
+				continue;
+
+			/* Mark done if found in provided list */
+			if (w)
+				w->on_disk = d->on_disk;
+
+			if (!d->on_disk || d->error)
+				continue;
+
+			for (i = 0; i < nws; i++)
+				if (ws[i] == d)
+					break;
+			if (i < nws)
+				continue;
+			if (d->erased)
+				again++;	/* the erase is not visible */
+			if (nws == wssz) {
+				wssz += 16;
+				ws = xrealloc(ws, wssz * sizeof(struct wipe_desc *));
+			}
+			ws[nws++] = d;
+		}
+
+		if (!nws || again == nws)
+			break;
+
+		if (do_wipe_real(fd, ws, nws, noact) && !noact)
+			fsync(fd);
+
+		/* report the first erase (or the failure) of the signature */
+		for (i = 0; i < nws; i++) {
+			if (ws[i]->error ? ws[i]->erased : ws[i]->erased != 1)
+				continue;
+			job->erased = xrealloc(job->erased,
+				(job->nerased + 1) * sizeof(struct wipe_desc *));
+			job->erased[job->nerased++] = ws[i];
+		}
+		if (noact)
+			break;
+	}
+
+	close(fd);
+	blkid_free_probe(pr);
+	free(ws);
+
+	for (w = wp0; w; w = w->next) {
+		if (w->on_disk)
 			continue;
+		job->notfound = xrealloc(job->notfound,
+				(job->nnotfound + 1) * sizeof(loff_t));
+		job->notfound[job->nnotfound++] = w->offset;
+	}
+	free_wipe(wp0);
+
+	job->wp = wp;
+}
+
+/*
+ * Prints the result of the job, the failures are reported also if @quiet.
+ */
+static void
+print_erased(struct wipe_job *job, int mode, int quiet)
+{
+	struct wipe_desc *w;
+	size_t i, n;
+	char enc[256];
+
+	if (mode == WP_MODE_PARSABLE) {
+		size_t sz = strlen(job->devname) * 4 + 1;
+		char *dev = xmalloc(sz);
+
+		blkid_encode_string(job->devname, dev, sz);
+
+		if (job->error) {
+			printf("%s,,,,error\n", dev);
+			free(dev);
+			return;
+		}
+		for (i = 0; i < job->nerased; i++) {
+			w = job->erased[i];
+			if (quiet && !w->error)
+				continue;
+			blkid_encode_string(w->type, enc, sizeof(enc));
+			printf("%s,0x%jx,%zu,%s,%s\n", dev, w->offset,
+				w->len, enc, w->error ? "failed" : "erased");
+		}
+		if (!quiet) {
+			for (n = 0; n < job->nnotfound; n++)
+				printf("%s,0x%jx,,,not-found\n",
+					dev, job->notfound[n]);
+			if (!job->nerased && !job->nnotfound)
+				printf("%s,,,,none\n", dev);
+		}
+		free(dev);
+		return;
+	}
 
-		/* Mark done if found in provided list */
-		if (w)
-			w->on_disk = wp->on_disk;
+	for (i = 0; i < job->nerased; i++) {
+		w = job->erased[i];
 
-		if (!wp->on_disk)
+		if (w->error) {
+			errno = w->error;
+			warn(_("%s: failed to erase %s magic string at offset 0x%08jx"),
+			     job->devname, w->type, w->offset);
+			continue;
+		}
+		if (quiet)
 			continue;
 
-		if (zap)
-			do_wipe_real(pr, devname, wp, noact, quiet);
+		printf(_("%s: %zd bytes were erased at offset 0x%08jx (%s): "),
+			job->devname, w->len, w->offset, w->type);
+
+		for (n = 0; n < w->len; n++) {
+			printf("%02x", w->magic[n]);
+			if (n + 1 < w->len)
+				fputc(' ', stdout);
+		}
+		putchar('\n');
 	}
 
-	for (w = wp0; w != NULL; w = w->next) {
-		if (!w->on_disk && !quiet)
-			warnx(_("%s: offset 0x%jx not found"), devname, w->offset);
+	for (n = 0; !quiet && n < job->nnotfound; n++)
+		warnx(_("%s: offset 0x%jx not found"),
+			job->devname, job->notfound[n]);
+}
+
+/*
+ * Reports the job result, returns non-zero if the device cannot be probed.
+ */
+static int
+report_job(struct wipe_job *job, int mode, int quiet, int nthreads)
+{
+	int rc = 0;
+
+	print_erased(job, mode, quiet);
+
+	if (job->error) {
+		errno = job->error;
+		if (nthreads <= 1)
+			err(EXIT_FAILURE, _("error: %s: probing initialization failed"),
+				job->devname);
+		warn(_("error: %s: probing initialization failed"), job->devname);
+		rc = -1;
 	}
 
-	fsync(blkid_probe_get_fd(pr));
-	close(blkid_probe_get_fd(pr));
-	blkid_free_probe(pr);
-	free_wipe(wp0);
+	free_wipe(job->wp);
+	free(job->erased);
+	free(job->notfound);
+	job->wp = NULL;
+	job->erased = NULL;
+	job->notfound = NULL;
+	return rc;
+}
 
-	return wp;
+#ifdef HAVE_LIBPTHREAD
+struct wipe_thread_data {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* a job is done */
+	size_t			next;		/* next unprocessed job */
+
+	struct wipe_job		*jobs;
+	size_t			njobs;
+	int			noact, all, force;
+};
+
+static void *wipe_thread(void *arg)
+{
+	struct wipe_thread_data *td = (struct wipe_thread_data *) arg;
+
+	for (;;) {
+		struct wipe_job *job;
+		size_t i;
+
+		pthread_mutex_lock(&td->lock);
+		i = td->next++;
+		pthread_mutex_unlock(&td->lock);
+
+		if (i >= td->njobs)
+			break;
+
+		job = &td->jobs[i];
+		do_wipe(job, td->noact, td->all, td->force);
+
+		pthread_mutex_lock(&td->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&td->cond);
+		pthread_mutex_unlock(&td->lock);
+	}
+	return NULL;
 }
 
+/*
+ * Wipes the devices by @nthreads threads, the results are reported in the
+ * original order as soon as they are available.
+ */
+static int
+wipe_parallel(struct wipe_job *jobs, size_t njobs, unsigned int nthreads,
+	      int noact, int all, int force, int mode, int quiet)
+{
+	struct wipe_thread_data td;
+	pthread_t *threads;
+	size_t i, n;
+	int rc = 0;
+
+	if (nthreads > njobs)
+		nthreads = njobs;
+
+	memset(&td, 0, sizeof(td));
+	pthread_mutex_init(&td.lock, NULL);
+	pthread_cond_init(&td.cond, NULL);
+	td.jobs = jobs;
+	td.njobs = njobs;
+	td.noact = noact;
+	td.all = all;
+	td.force = force;
+
+	blkid_init_debug(0);	/* not thread safe */
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, wipe_thread, &td))
+			break;
+	}
+	if (n == 0)
+		wipe_thread(&td);	/* no thread created, do it yourself */
+
+	for (i = 0; i < njobs; i++) {
+		pthread_mutex_lock(&td.lock);
+		while (!jobs[i].done)
+			pthread_cond_wait(&td.cond, &td.lock);
+		pthread_mutex_unlock(&td.lock);
+
+		if (report_job(&jobs[i], mode, quiet, nthreads))
+			rc = -1;
+	}
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_cond_destroy(&td.cond);
+	pthread_mutex_destroy(&td.lock);
+	free(threads);
+
+	return rc;
+}
+#endif /* HAVE_LIBPTHREAD */
 
 static void __attribute__((__noreturn__))
 usage(FILE *out)
 {
 	fputs(_("\nUsage:\n"), out);
 	fprintf(out,
-	      _(" %s [options] <device>\n"), program_invocation_short_name);
+	      _(" %s [options] <device>...\n"), program_invocation_short_name);
 
 	fputs(_("\nOptions:\n"), out);
 	fputs(_(" -a, --all           wipe all magic strings (BE CAREFUL!)\n"
 		" -f, --force         force erasure\n"
 		" -h, --help          show this help text\n"
+		" -j, --threads <num> number of devices erased in parallel\n"
 		" -n, --no-act        do everything except the actual write() call\n"
 		" -o, --offset <num>  offset to erase, in bytes\n"
 		" -p, --parsable      print out in parsable instead of printable format\n"
@@ -385,14 +713,18 @@ usage(FILE *out)
 int
 main(int argc, char **argv)
 {
-	struct wipe_desc *wp0 = NULL, *wp;
+	struct wipe_desc *wp0 = NULL;
+	struct wipe_job *jobs;
+	size_t i, njobs;
 	int c, all = 0, force = 0, has_offset = 0, noact = 0, quiet = 0;
-	int mode = WP_MODE_PRETTY;
+	int mode = WP_MODE_PRETTY, rc = EXIT_SUCCESS;
+	unsigned int nthreads = 0;
 
 	static const struct option longopts[] = {
 	    { "all",       0, 0, 'a' },
 	    { "force",     0, 0, 'f' },
 	    { "help",      0, 0, 'h' },
+	    { "threads",   1, 0, 'j' },
 	    { "no-act",    0, 0, 'n' },
 	    { "offset",    1, 0, 'o' },
 	    { "parsable",  0, 0, 'p' },
@@ -413,7 +745,7 @@ main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "ahno:pqt:V", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "afhj:no:pqt:V", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -427,11 +759,19 @@ main(int argc, char **argv)
 		case 'h':
 			usage(stdout);
 			break;
+		case 'j':
+			nthreads = strtou32_or_err(optarg,
+					_("invalid number of threads argument"));
+			if (!nthreads) {
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				nthreads = n > 0 ? n : 1;
+			}
+			break;
 		case 'n':
 			noact++;
 			break;
 		case 'o':
-			wp0 = add_offset(wp0, strtosize_or_err(optarg,
+			add_offset(&wp0, strtosize_or_err(optarg,
 					 _("invalid offset argument")), 1);
 			has_offset++;
 			break;
@@ -466,17 +806,36 @@ main(int argc, char **argv)
 				print_all(wp0, mode);
 			free_wipe(wp0);
 		}
-	} else {
-		/*
-		 * Erase
-		 */
-		while (optind < argc) {
-			wp = clone_offset(wp0);
-			wp = do_wipe(wp, argv[optind++], noact, all, quiet,
-				     force);
-			free_wipe(wp);
-		}
+		return EXIT_SUCCESS;
 	}
 
-	return EXIT_SUCCESS;
+	/*
+	 * Erase
+	 */
+	njobs = argc - optind;
+	jobs = xcalloc(njobs, sizeof(struct wipe_job));
+
+	for (i = 0; i < njobs; i++) {
+		jobs[i].devname = argv[optind + i];
+		jobs[i].wp = clone_offset(wp0);
+	}
+
+	if (mode == WP_MODE_PARSABLE && !quiet)
+		printf("# device,offset,length,type,status\n");
+
+#ifdef HAVE_LIBPTHREAD
+	if (nthreads > 1 && njobs > 1) {
+		if (wipe_parallel(jobs, njobs, nthreads, noact, all, force,
+				  mode, quiet))
+			rc = EXIT_FAILURE;
+	} else
+#endif
+	for (i = 0; i < njobs; i++) {
+		do_wipe(&jobs[i], noact, all, force);
+		report_job(&jobs[i], mode, quiet, 0);
+	}
+
+	free(jobs);
+	free_wipe(wp0);
+	return rc;
 }
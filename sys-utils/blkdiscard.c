@@ -20,6 +20,11 @@
  * This program uses BLKDISCARD ioctl to discard part or the whole block
  * device if the device supports it. You can specify range (start and
  * length) to be discarded, or simply discard the whole device.
+ *
+ * The range may be split into chunks aligned to the discard granularity of
+ * the device. The chunks are discarded by more threads, with a bandwidth
+ * limit and progress reporting. The discard may be interrupted and resumed
+ * later by --offset.
  */
 
 
@@ -31,14 +36,24 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <linux/fs.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include "nls.h"
 #include "strutils.h"
 #include "c.h"
+#include "xalloc.h"
+#include "sysfs.h"
 #include "closestream.h"
 
 #ifndef BLKDISCARD
@@ -49,6 +64,309 @@
 #define BLKSECDISCARD	_IO(0x12,125)
 #endif
 
+#define DISCARD_DEFAULT_CHUNK	(1ULL << 30)	/* if discard_max_bytes unknown */
+
+struct discard_control {
+	const char	*path;
+	int		fd;
+	unsigned long	request;	/* BLKDISCARD or BLKSECDISCARD */
+
+	uint64_t	start;		/* aligned range */
+	uint64_t	end;
+	uint64_t	chunk;		/* chunk size, 0 = one call */
+	uint64_t	align;		/* chunks boundaries offset */
+	uint64_t	rate;		/* bytes per second or 0 */
+
+	uint64_t	next;		/* begin of the next chunk */
+	uint64_t	discarded;	/* bytes */
+	uint64_t	next_time;	/* rate limit, usec */
+	uint64_t	begin_time;	/* usec */
+	uint64_t	progress_time;	/* last progress line, usec */
+
+	uint64_t	*inflight;	/* chunks in progress, per worker */
+	size_t		nworkers;
+
+	int		error;		/* errno of the failed chunk */
+	uint64_t	error_offset;
+
+	unsigned int	progress : 1,
+			verbose : 1;
+};
+
+static volatile sig_atomic_t interrupted;
+
+static void sig_handler(int sig __attribute__((__unused__)))
+{
+	interrupted = 1;
+}
+
+static uint64_t get_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Reads discard topology of the device and sets the chunk size. The chunks
+ * are multiple of the discard granularity and not larger than the maximal
+ * discard request, so the kernel does not have to split them.
+ */
+static void init_chunks(struct discard_control *ctl, dev_t devno,
+			uint64_t secsize)
+{
+	struct sysfs_cxt cxt;
+	uint64_t gran = 0, maxbytes = 0, align = 0;
+	dev_t disk = 0;
+
+	if (sysfs_init(&cxt, devno, NULL) == 0) {
+		sysfs_read_u64(&cxt, "discard_alignment", &align);
+		sysfs_deinit(&cxt);
+	}
+	if (sysfs_devno_to_wholedisk(devno, NULL, 0, &disk) || !disk)
+		disk = devno;
+	if (sysfs_init(&cxt, disk, NULL) == 0) {
+		sysfs_read_u64(&cxt, "queue/discard_granularity", &gran);
+		sysfs_read_u64(&cxt, "queue/discard_max_bytes", &maxbytes);
+		sysfs_deinit(&cxt);
+	}
+
+	if (gran < secsize)
+		gran = secsize;
+	maxbytes -= maxbytes % gran;
+
+	if (!ctl->chunk)
+		ctl->chunk = maxbytes ? maxbytes : DISCARD_DEFAULT_CHUNK;
+
+	/* round up to the granularity, but not above discard_max_bytes */
+	ctl->chunk = (ctl->chunk + gran - 1) / gran * gran;
+	if (maxbytes && ctl->chunk > maxbytes)
+		ctl->chunk = maxbytes;
+
+	ctl->align = align % ctl->chunk;
+
+	if (ctl->verbose)
+		printf(_("%s: discard granularity %" PRIu64 ", chunk size %" PRIu64 "\n"),
+			ctl->path, gran, ctl->chunk);
+}
+
+/*
+ * Returns the first offset where the range is not discarded yet. All the
+ * chunks before the offset are done, so it's possible to resume by
+ * --offset from the offset.
+ */
+static uint64_t get_resume_offset(struct discard_control *ctl)
+{
+	uint64_t off = ctl->next;
+	size_t i;
+
+	for (i = 0; i < ctl->nworkers; i++) {
+		if (ctl->inflight[i] < off)
+			off = ctl->inflight[i];
+	}
+	if (ctl->error && ctl->error_offset < off)
+		off = ctl->error_offset;
+	return off;
+}
+
+static void print_progress(struct discard_control *ctl, int last)
+{
+	uint64_t now = get_usec(), total, msec;
+	char *done, *bw;
+
+	if (!last && now - ctl->progress_time < 1000000)
+		return;
+	ctl->progress_time = now;
+
+	total = ctl->end - ctl->start;
+	msec = (now - ctl->begin_time) / 1000;
+
+	done = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
+				    ctl->discarded);
+	bw = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
+				    msec ? ctl->discarded / msec * 1000 : ctl->discarded);
+
+	printf(_("%s%s: %s (%3d%%) discarded, %s/s, offset %" PRIu64 "%s"),
+		isatty(STDOUT_FILENO) ? "\r" : "",
+		ctl->path, done,
+		total ? (int) (ctl->discarded * 100 / total) : 100,
+		bw, get_resume_offset(ctl),
+		isatty(STDOUT_FILENO) && !last ? "" : "\n");
+	fflush(stdout);
+
+	free(done);
+	free(bw);
+}
+
+/*
+ * Returns 1 and the next chunk, 0 if the bandwidth limit does not allow to
+ * continue before @wakeup, or -1 when all is done (or on error/interrupt).
+ */
+static int get_chunk(struct discard_control *ctl, size_t worker,
+		     uint64_t range[2], uint64_t *wakeup)
+{
+	uint64_t len;
+
+	*wakeup = 0;
+
+	if (interrupted || ctl->error || ctl->next >= ctl->end)
+		return -1;
+
+	if (ctl->next_time) {
+		uint64_t now = get_usec();
+
+		if (ctl->next_time > now) {
+			*wakeup = ctl->next_time;
+			return 0;
+		}
+	}
+
+	/* up to the next chunk boundary */
+	len = ctl->chunk - (ctl->next + ctl->chunk - ctl->align) % ctl->chunk;
+	if (len > ctl->end - ctl->next)
+		len = ctl->end - ctl->next;
+
+	range[0] = ctl->next;
+	range[1] = len;
+	ctl->inflight[worker] = ctl->next;
+	ctl->next += len;
+
+	if (ctl->rate) {
+		uint64_t now = get_usec();
+
+		if (ctl->next_time < now)
+			ctl->next_time = now;
+		ctl->next_time += len / ctl->rate * 1000000
+				+ len % ctl->rate * 1000000 / ctl->rate;
+	}
+	return 1;
+}
+
+static void put_chunk(struct discard_control *ctl, size_t worker,
+		      uint64_t range[2], int error)
+{
+	ctl->inflight[worker] = UINT64_MAX;
+
+	if (error) {
+		if (!ctl->error || range[0] < ctl->error_offset) {
+			ctl->error = error;
+			ctl->error_offset = range[0];
+		}
+		return;
+	}
+
+	ctl->discarded += range[1];
+	if (ctl->progress && ctl->discarded < ctl->end - ctl->start)
+		print_progress(ctl, 0);
+}
+
+static int do_discard(struct discard_control *ctl, uint64_t range[2])
+{
+	if (ioctl(ctl->fd, ctl->request, range))
+		return errno ? errno : EIO;
+	return 0;
+}
+
+static void sleep_until(uint64_t wakeup)
+{
+	uint64_t now = get_usec();
+
+	if (wakeup > now) {
+		struct timespec ts;
+
+		ts.tv_sec = (wakeup - now) / 1000000;
+		ts.tv_nsec = (wakeup - now) % 1000000 * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void discard_serial(struct discard_control *ctl)
+{
+	uint64_t range[2], wakeup;
+	int rc;
+
+	while ((rc = get_chunk(ctl, 0, range, &wakeup)) >= 0) {
+		if (rc == 0) {
+			sleep_until(wakeup);
+			continue;
+		}
+		put_chunk(ctl, 0, range, do_discard(ctl, range));
+	}
+}
+
+#ifdef HAVE_LIBPTHREAD
+struct discard_thread_data {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* throttled threads */
+	struct discard_control	*ctl;
+	size_t			nworkers;	/* assigned worker slots */
+};
+
+static void *discard_thread(void *arg)
+{
+	struct discard_thread_data *td = (struct discard_thread_data *) arg;
+	uint64_t range[2], wakeup;
+	size_t worker;
+	int rc;
+
+	pthread_mutex_lock(&td->lock);
+	worker = td->nworkers++;
+
+	while ((rc = get_chunk(td->ctl, worker, range, &wakeup)) >= 0) {
+		if (rc == 0) {
+			struct timespec ts;
+
+			ts.tv_sec = wakeup / 1000000;
+			ts.tv_nsec = wakeup % 1000000 * 1000;
+			pthread_cond_timedwait(&td->cond, &td->lock, &ts);
+			continue;
+		}
+
+		pthread_mutex_unlock(&td->lock);
+		rc = do_discard(td->ctl, range);
+		pthread_mutex_lock(&td->lock);
+
+		put_chunk(td->ctl, worker, range, rc);
+	}
+
+	pthread_cond_broadcast(&td->cond);
+	pthread_mutex_unlock(&td->lock);
+	return NULL;
+}
+
+/*
+ * Discards the chunks by @nthreads threads, so there are up to @nthreads
+ * discard requests in progress.
+ */
+static void discard_parallel(struct discard_control *ctl, unsigned int nthreads)
+{
+	struct discard_thread_data td;
+	pthread_t *threads;
+	size_t n;
+
+	memset(&td, 0, sizeof(td));
+	pthread_mutex_init(&td.lock, NULL);
+	pthread_cond_init(&td.cond, NULL);
+	td.ctl = ctl;
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, discard_thread, &td))
+			break;
+	}
+	if (n == 0)
+		discard_thread(&td);	/* no thread created, do it yourself */
+
+	while (n > 0)
+		pthread_join(threads[--n], NULL);
+
+	pthread_cond_destroy(&td.cond);
+	pthread_mutex_destroy(&td.lock);
+	free(threads);
+}
+#endif /* HAVE_LIBPTHREAD */
+
 static void __attribute__((__noreturn__)) usage(FILE *out)
 {
 	fputs(USAGE_HEADER, out);
@@ -57,6 +375,10 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"
 		" -l, --length <num>  length of bytes to discard from the offset\n"
+		" -p, --step <num>    discard by chunks of <num> bytes\n"
+		" -j, --threads <num> number of discard requests in progress\n"
+		" -r, --rate <num>    maximal number of discarded bytes per second\n"
+		" -P, --progress      print progress\n"
 		" -s, --secure        perform secure discard\n"
 		" -v, --verbose       print aligned length and offset\n"),
 		out);
@@ -69,9 +391,13 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 
 int main(int argc, char **argv)
 {
+	struct discard_control ctl;
 	char *path;
-	int c, fd, verbose = 0, secure = 0;
-	uint64_t end, blksize, secsize, range[2];
+	int c, fd, verbose = 0, secure = 0, chunked = 0;
+	unsigned int nthreads = 1;
+	long ncpus;
+	uint64_t end, blksize, range[2];
+	unsigned int secsize;
 	struct stat sb;
 
 	static const struct option longopts[] = {
@@ -79,6 +405,10 @@ int main(int argc, char **argv)
 	    { "version",   0, 0, 'V' },
 	    { "offset",    1, 0, 'o' },
 	    { "length",    1, 0, 'l' },
+	    { "step",      1, 0, 'p' },
+	    { "threads",   1, 0, 'j' },
+	    { "rate",      1, 0, 'r' },
+	    { "progress",  0, 0, 'P' },
 	    { "secure",    0, 0, 's' },
 	    { "verbose",   0, 0, 'v' },
 	    { NULL,        0, 0, 0 }
@@ -89,10 +419,11 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
+	memset(&ctl, 0, sizeof(ctl));
 	range[0] = 0;
 	range[1] = ULLONG_MAX;
 
-	while ((c = getopt_long(argc, argv, "hVsvo:l:", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVsvo:l:p:j:r:P", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'h':
 			usage(stdout);
@@ -108,6 +439,33 @@ int main(int argc, char **argv)
 			range[0] = strtosize_or_err(optarg,
 					_("failed to parse offset"));
 			break;
+		case 'p':
+			ctl.chunk = strtosize_or_err(optarg,
+					_("failed to parse step"));
+			chunked = 1;
+			break;
+		case 'j':
+			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if (ncpus < 1)
+				ncpus = 1;
+			nthreads = strtou32_or_err(optarg,
+					_("invalid number of threads argument"));
+			if (!nthreads)
+				errx(EXIT_FAILURE, _("invalid number of threads argument"));
+			/* more requests in progress don't make the device faster */
+			if (nthreads > 4 * ncpus)
+				nthreads = 4 * ncpus;
+			chunked = 1;
+			break;
+		case 'r':
+			ctl.rate = strtosize_or_err(optarg,
+					_("failed to parse rate"));
+			chunked = 1;
+			break;
+		case 'P':
+			ctl.progress = 1;
+			chunked = 1;
+			break;
 		case 's':
 			secure = 1;
 			break;
@@ -146,20 +504,77 @@ int main(int argc, char **argv)
 		err(EXIT_FAILURE, _("%s: BLKSSZGET ioctl failed"), path);
 
 	/* align range to the sector size */
-	range[0] = (range[0] + secsize - 1) & ~(secsize - 1);
-	range[1] &= ~(secsize - 1);
+	range[0] = (range[0] + secsize - 1) & ~((uint64_t) secsize - 1);
+	range[1] &= ~((uint64_t) secsize - 1);
 
 	/* is the range end behind the end of the device ?*/
 	end = range[0] + range[1];
 	if (end < range[0] || end > blksize)
 		range[1] = blksize - range[0];
 
-	if (secure) {
-		if (ioctl(fd, BLKSECDISCARD, &range))
-			err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
+	if (!chunked) {
+		if (secure) {
+			if (ioctl(fd, BLKSECDISCARD, &range))
+				err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
+		} else {
+			if (ioctl(fd, BLKDISCARD, &range))
+				err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
+		}
 	} else {
-		if (ioctl(fd, BLKDISCARD, &range))
-			err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
+		struct sigaction sa;
+		uint64_t off;
+
+		ctl.path = path;
+		ctl.fd = fd;
+		ctl.request = secure ? BLKSECDISCARD : BLKDISCARD;
+		ctl.verbose = verbose;
+		ctl.start = ctl.next = range[0];
+		ctl.end = range[0] + range[1];
+		ctl.begin_time = ctl.progress_time = get_usec();
+
+		init_chunks(&ctl, sb.st_rdev, secsize);
+
+		if (nthreads > 1 && range[1] / ctl.chunk + 1 < nthreads)
+			nthreads = range[1] / ctl.chunk + 1;
+
+		ctl.nworkers = nthreads;
+		ctl.inflight = xmalloc(nthreads * sizeof(uint64_t));
+		memset(ctl.inflight, 0xff, nthreads * sizeof(uint64_t));
+
+		/* finish the requests in progress and print the resume offset */
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = sig_handler;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+
+#ifdef HAVE_LIBPTHREAD
+		if (nthreads > 1)
+			discard_parallel(&ctl, nthreads);
+		else
+#endif
+			discard_serial(&ctl);
+
+		if (ctl.progress)
+			print_progress(&ctl, 1);
+
+		if (ctl.error) {
+			errno = ctl.error;
+			warn(secure ? _("%s: BLKSECDISCARD ioctl failed") :
+				      _("%s: BLKDISCARD ioctl failed"), path);
+		}
+		off = get_resume_offset(&ctl);
+		free(ctl.inflight);
+
+		if (ctl.error || off < ctl.end) {
+			if (interrupted)
+				warnx(_("%s: interrupted"), path);
+			/* TRANSLATORS: The standard value here is a very large number. */
+			warnx(_("%s: discarded from the offset %" PRIu64
+				" to %" PRIu64 ", use --offset %" PRIu64
+				" to continue"), path, ctl.start, off, off);
+			return EXIT_FAILURE;
+		}
 	}
 
 	if (verbose)
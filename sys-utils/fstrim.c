@@ -22,6 +22,10 @@
  * This program uses FITRIM ioctl to discard parts or the whole filesystem
  * online (mounted). You can specify range (start and length) to be
  * discarded, or simply discard whole filesystem.
+ *
+ * The range may be split into chunks. The chunks are trimmed one by one (or
+ * by more threads) with a per-device concurrency limit, a rate limit and
+ * a latency budget, so the trim does not block the device for a long time.
  */
 
 #include <string.h>
@@ -32,14 +36,28 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <getopt.h>
+#include <errno.h>
+#include <time.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/time.h>
 #include <linux/fs.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include <libmount.h>
+#include <blkid.h>
+
 #include "nls.h"
 #include "strutils.h"
 #include "c.h"
+#include "xalloc.h"
+#include "sysfs.h"
+#include "pathnames.h"
 #include "closestream.h"
 
 #ifndef FITRIM
@@ -51,15 +69,659 @@ struct fstrim_range {
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)
 #endif
 
+#define FSTRIM_DEFAULT_CHUNK	(1ULL << 30)	/* for -L, -r and -d */
+#define FSTRIM_MIN_CHUNK	(1ULL << 20)	/* -L does not go below */
+
+enum {
+	FSTRIM_OK = 0,
+	FSTRIM_UNSUPPORTED,
+	FSTRIM_ERROR
+};
+
+/* physical (whole-disk) device, the -d and -r limits are per device */
+struct fstrim_dev {
+	dev_t			devno;
+	unsigned int		running;	/* FITRIM calls in progress */
+	uint64_t		next_time;	/* rate limit, usec */
+	struct fstrim_dev	*next;
+};
+
+struct fstrim_fs {
+	char			*path;		/* mountpoint */
+	char			*source;	/* mount source or NULL */
+	int			fd;
+	struct fstrim_dev	*dev;
+
+	uint64_t		start;		/* begin of the next chunk */
+	uint64_t		end;		/* end of the range */
+	uint64_t		chunk;		/* current chunk size, 0 = one call */
+	uint64_t		maxchunk;	/* -L does not go above */
+	uint64_t		bsize;		/* filesystem block size */
+
+	uint64_t		trimmed;	/* sum of the FITRIM results */
+	unsigned int		running;	/* FITRIM calls in progress */
+	int			status;		/* FSTRIM_* */
+	int			error;		/* errno for FSTRIM_ERROR */
+
+	unsigned int		open_end : 1,	/* last chunk extends to the end of fs */
+				queued : 1;	/* all chunks dispatched */
+};
+
+struct fstrim_control {
+	struct fstrim_range	range;		/* -o, -l and -m */
+	uint64_t		chunk;		/* -c */
+	uint64_t		rate;		/* -r, bytes per second */
+	unsigned int		latency;	/* -L, milliseconds */
+	unsigned int		per_device;	/* -d */
+
+	struct fstrim_fs	*fss;
+	size_t			nfss;
+	size_t			rr;		/* round-robin position */
+	size_t			nreported;
+
+	struct fstrim_dev	*devs;
+
+	unsigned int		all : 1,
+				verbose : 1,
+				parsable : 1;
+};
+
+struct fstrim_chunk {
+	struct fstrim_fs	*fs;
+	struct fstrim_range	range;
+	int			rc;
+	int			error;
+	uint64_t		elapsed;	/* usec */
+};
+
+static uint64_t get_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static struct fstrim_dev *get_dev(struct fstrim_control *ctl, dev_t devno)
+{
+	struct fstrim_dev *dev;
+	dev_t disk = 0;
+
+	if (sysfs_devno_to_wholedisk(devno, NULL, 0, &disk) || !disk)
+		disk = devno;
+
+	for (dev = ctl->devs; dev; dev = dev->next) {
+		if (dev->devno == disk)
+			return dev;
+	}
+
+	dev = xcalloc(1, sizeof(*dev));
+	dev->devno = disk;
+	dev->next = ctl->devs;
+	ctl->devs = dev;
+	return dev;
+}
+
+/*
+ * Returns 1 if the device does not support discard at all.
+ */
+static int dev_is_nodiscard(struct fstrim_dev *dev)
+{
+	struct sysfs_cxt cxt;
+	uint64_t max = 0;
+	int rc = 0;
+
+	if (sysfs_init(&cxt, dev->devno, NULL))
+		return 0;
+	if (sysfs_read_u64(&cxt, "queue/discard_max_bytes", &max) == 0 && !max)
+		rc = 1;
+	sysfs_deinit(&cxt);
+	return rc;
+}
+
+/*
+ * Returns the block device with the filesystem, for filesystems on
+ * anonymous devices (btrfs, ...) the mount source is used.
+ */
+static dev_t get_fs_devno(const char *path, const char *source)
+{
+	struct stat st;
+
+	if (source && stat(source, &st) == 0 && S_ISBLK(st.st_mode))
+		return st.st_rdev;
+	if (stat(path, &st) == 0 && major(st.st_dev))
+		return st.st_dev;
+	return 0;
+}
+
+/*
+ * Sets the range and the chunk size for the filesystem. Without chunks the
+ * range from the command line is used as is.
+ */
+static void init_fs_range(struct fstrim_control *ctl, struct fstrim_fs *fs)
+{
+	struct statfs sfs;
+	uint64_t size, end;
+
+	fs->start = ctl->range.start;
+	fs->chunk = ctl->chunk;
+	if (!fs->chunk && (ctl->latency || ctl->rate || ctl->per_device > 1))
+		fs->chunk = FSTRIM_DEFAULT_CHUNK;
+	if (!fs->chunk)
+		return;
+
+	if (fstatfs(fs->fd, &sfs) != 0 || !sfs.f_bsize || !sfs.f_blocks)
+		goto nochunks;
+
+	fs->bsize = sfs.f_bsize;
+	size = (uint64_t) sfs.f_blocks * sfs.f_bsize;
+
+	if (ctl->range.start >= size)
+		goto nochunks;
+
+	end = ctl->range.len > ULLONG_MAX - ctl->range.start ?
+			ULLONG_MAX : ctl->range.start + ctl->range.len;
+
+	/* f_blocks does not include the filesystem overhead, so let
+	 * the last chunk extend to the end of the filesystem */
+	if (end >= size) {
+		fs->open_end = ctl->range.len == ULLONG_MAX;
+		end = size;
+	}
+	fs->end = end;
+
+	if (fs->chunk < fs->bsize)
+		fs->chunk = fs->bsize;
+	fs->chunk -= fs->chunk % fs->bsize;
+	fs->maxchunk = ctl->chunk ? fs->chunk : size;
+	return;
+nochunks:
+	fs->chunk = 0;
+}
+
+/*
+ * Adds mountpoint @path to the list of filesystems to trim. The function
+ * returns -1 if the mountpoint cannot be opened.
+ */
+static int add_fs(struct fstrim_control *ctl, const char *path,
+		  const char *source)
+{
+	struct fstrim_fs *fs;
+	dev_t devno;
+
+	ctl->fss = xrealloc(ctl->fss, (ctl->nfss + 1) * sizeof(*fs));
+	fs = &ctl->fss[ctl->nfss++];
+	memset(fs, 0, sizeof(*fs));
+
+	fs->path = xstrdup(path);
+	fs->source = source ? xstrdup(source) : NULL;
+
+	devno = get_fs_devno(path, source);
+	fs->dev = get_dev(ctl, devno);
+
+	fs->fd = open(path, O_RDONLY);
+	if (fs->fd < 0) {
+		fs->status = FSTRIM_ERROR;
+		fs->error = errno;
+		fs->queued = 1;
+		return -1;
+	}
+
+	if (ctl->all && devno && dev_is_nodiscard(fs->dev)) {
+		fs->status = FSTRIM_UNSUPPORTED;
+		fs->queued = 1;
+		return 0;
+	}
+
+	init_fs_range(ctl, fs);
+	return 0;
+}
+
+static int is_trimmable(struct libmnt_fs *fs)
+{
+	const char *src = mnt_fs_get_srcpath(fs);
+	struct stat st;
+
+	if (mnt_fs_is_pseudofs(fs) || mnt_fs_is_netfs(fs) ||
+	    mnt_fs_is_swaparea(fs) || !mnt_fs_get_target(fs))
+		return 0;
+	if (mnt_fs_match_options(fs, "ro"))
+		return 0;
+	if (major(mnt_fs_get_devno(fs)))
+		return 1;
+
+	/* anonymous device, check for a block device in the source */
+	return src && stat(src, &st) == 0 && S_ISBLK(st.st_mode);
+}
+
+/*
+ * Adds all mounted read-write filesystems with a block device, every
+ * filesystem is added only once (bind mounts, btrfs subvolumes, ...).
+ */
+static void add_all_fs(struct fstrim_control *ctl)
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	dev_t *devnos = NULL;
+	size_t ndevnos = 0;
+
+	tb = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+	if (!tb)
+		err(EXIT_FAILURE, _("failed to parse %s"), _PATH_PROC_MOUNTINFO);
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		err(EXIT_FAILURE, _("failed to initialize libmount iterator"));
+
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		dev_t devno = mnt_fs_get_devno(fs);
+		size_t i;
+
+		if (!is_trimmable(fs))
+			continue;
+		for (i = 0; i < ndevnos; i++) {
+			if (devnos[i] == devno)
+				break;
+		}
+		if (i < ndevnos)
+			continue;
+
+		devnos = xrealloc(devnos, (ndevnos + 1) * sizeof(dev_t));
+		devnos[ndevnos++] = devno;
+
+		if (add_fs(ctl, mnt_fs_get_target(fs), mnt_fs_get_source(fs)))
+			warn(_("cannot open %s"), mnt_fs_get_target(fs));
+	}
+
+	free(devnos);
+	mnt_free_iter(itr);
+	mnt_free_table(tb);
+}
+
+/*
+ * Returns the mount source for the mountpoint @path or NULL.
+ */
+static char *get_fs_source(const char *path)
+{
+	struct libmnt_table *tb;
+	struct libmnt_fs *fs;
+	char *res = NULL;
+
+	tb = mnt_new_table_from_file(_PATH_PROC_MOUNTINFO);
+	if (!tb)
+		return NULL;
+
+	fs = mnt_table_find_target(tb, path, MNT_ITER_BACKWARD);
+	if (fs && mnt_fs_get_source(fs))
+		res = xstrdup(mnt_fs_get_source(fs));
+
+	mnt_free_table(tb);
+	return res;
+}
+
+static void free_fss(struct fstrim_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->nfss; i++) {
+		struct fstrim_fs *fs = &ctl->fss[i];
+
+		if (fs->fd >= 0)
+			close(fs->fd);
+		free(fs->path);
+		free(fs->source);
+	}
+	free(ctl->fss);
+
+	while (ctl->devs) {
+		struct fstrim_dev *dev = ctl->devs;
+
+		ctl->devs = dev->next;
+		free(dev);
+	}
+}
+
+static inline int fs_is_done(struct fstrim_fs *fs)
+{
+	return fs->queued && !fs->running;
+}
+
+static void next_range(struct fstrim_control *ctl, struct fstrim_fs *fs,
+		       struct fstrim_chunk *ch)
+{
+	memset(ch, 0, sizeof(*ch));
+	ch->fs = fs;
+
+	if (!fs->chunk) {
+		ch->range = ctl->range;
+		fs->queued = 1;
+		return;
+	}
+
+	ch->range.start = fs->start;
+	ch->range.minlen = ctl->range.minlen;
+
+	if (fs->end - fs->start > fs->chunk) {
+		ch->range.len = fs->chunk;
+		fs->start += fs->chunk;
+	} else {
+		ch->range.len = fs->open_end ? ULLONG_MAX : fs->end - fs->start;
+		fs->start = fs->end;
+		fs->queued = 1;
+	}
+}
+
+/*
+ * Returns 1 and the next chunk to trim, 0 if nothing is ready now (the
+ * @wakeup is the time when a throttled device is ready again or 0), or -1
+ * when all the chunks have been dispatched.
+ */
+static int get_chunk(struct fstrim_control *ctl, struct fstrim_chunk *ch,
+		     uint64_t *wakeup)
+{
+	uint64_t now = 0;
+	int pending = 0;
+	size_t i;
+
+	*wakeup = 0;
+
+	for (i = 0; i < ctl->nfss; i++) {
+		size_t idx = (ctl->rr + i) % ctl->nfss;
+		struct fstrim_fs *fs = &ctl->fss[idx];
+		struct fstrim_dev *dev = fs->dev;
+
+		if (fs->queued)
+			continue;
+		pending = 1;
+
+		if (dev->running >= ctl->per_device)
+			continue;
+		if (dev->next_time) {
+			if (!now)
+				now = get_usec();
+			if (dev->next_time > now) {
+				if (!*wakeup || dev->next_time < *wakeup)
+					*wakeup = dev->next_time;
+				continue;
+			}
+		}
+
+		next_range(ctl, fs, ch);
+		fs->running++;
+		dev->running++;
+		ctl->rr = idx + 1;
+		return 1;
+	}
+
+	return pending ? 0 : -1;
+}
+
+static void do_trim(struct fstrim_chunk *ch)
+{
+	uint64_t start = get_usec();
+
+	ch->rc = ioctl(ch->fs->fd, FITRIM, &ch->range);
+	ch->error = ch->rc ? errno : 0;
+	ch->elapsed = get_usec() - start;
+}
+
+/*
+ * Accounts the finished chunk, updates the rate limit of the device and the
+ * chunk size according to the latency budget.
+ */
+static void put_chunk(struct fstrim_control *ctl, struct fstrim_chunk *ch)
+{
+	struct fstrim_fs *fs = ch->fs;
+	struct fstrim_dev *dev = fs->dev;
+
+	fs->running--;
+	dev->running--;
+
+	if (ch->rc) {
+		if (fs->status == FSTRIM_OK) {
+			fs->status = ctl->all && (ch->error == EOPNOTSUPP ||
+						  ch->error == ENOTTY) ?
+					FSTRIM_UNSUPPORTED : FSTRIM_ERROR;
+			fs->error = ch->error;
+		}
+		fs->queued = 1;		/* don't continue with this fs */
+		return;
+	}
+
+	fs->trimmed += ch->range.len;
+
+	if (ctl->rate) {
+		uint64_t now = get_usec(), len = ch->range.len;
+
+		if (dev->next_time < now)
+			dev->next_time = now;
+		dev->next_time += len / ctl->rate * 1000000
+				+ len % ctl->rate * 1000000 / ctl->rate;
+	}
+
+	if (ctl->latency && fs->chunk) {
+		uint64_t budget = (uint64_t) ctl->latency * 1000;
+		uint64_t min = max(fs->bsize, (uint64_t) FSTRIM_MIN_CHUNK);
+
+		if (ch->elapsed > budget && fs->chunk / 2 >= min)
+			fs->chunk /= 2;
+		else if (ch->elapsed < budget / 2 && fs->chunk < fs->maxchunk)
+			fs->chunk = min(fs->chunk * 2, fs->maxchunk);
+		fs->chunk -= fs->chunk % fs->bsize;
+	}
+}
+
+/*
+ * Returns -1 if the filesystem has not been trimmed.
+ */
+static int report_fs(struct fstrim_control *ctl, struct fstrim_fs *fs)
+{
+	if (ctl->parsable) {
+		static const char *status[] = {
+			[FSTRIM_OK]		= "ok",
+			[FSTRIM_UNSUPPORTED]	= "unsupported",
+			[FSTRIM_ERROR]		= "error"
+		};
+		const char *src = fs->source ? fs->source : "";
+		size_t pathsz = strlen(fs->path) * 4 + 1,
+		       srcsz = strlen(src) * 4 + 1;
+		char *path = xmalloc(pathsz), *source = xmalloc(srcsz);
+
+		/* the mountpoint and source may contain commas */
+		blkid_encode_string(fs->path, path, pathsz);
+		blkid_encode_string(src, source, srcsz);
+
+		printf("%s,%s,%" PRIu64 ",%s\n",
+				path, source, fs->trimmed, status[fs->status]);
+		free(path);
+		free(source);
+	}
+
+	switch (fs->status) {
+	case FSTRIM_UNSUPPORTED:
+		if (ctl->verbose && !ctl->parsable)
+			printf(_("%s: the discard operation is not supported\n"),
+					fs->path);
+		return 0;
+	case FSTRIM_ERROR:
+		errno = fs->error;
+		if (fs->fd < 0)
+			return -1;	/* already reported by add_all_fs() */
+		warn(_("%s: FITRIM ioctl failed"), fs->path);
+		return -1;
+	}
+
+	if (ctl->verbose && !ctl->parsable) {
+		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER |
+						 SIZE_SUFFIX_SPACE,
+						 fs->trimmed);
+		/* TRANSLATORS: The standard value here is a very large number. */
+		printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
+						fs->path, str,
+						fs->trimmed);
+		free(str);
+	}
+	return 0;
+}
+
+/*
+ * Reports the finished filesystems in the original order.
+ */
+static int report_done(struct fstrim_control *ctl)
+{
+	int rc = 0;
+
+	while (ctl->nreported < ctl->nfss &&
+	       fs_is_done(&ctl->fss[ctl->nreported])) {
+		if (report_fs(ctl, &ctl->fss[ctl->nreported]))
+			rc = -1;
+		ctl->nreported++;
+	}
+	return rc;
+}
+
+static void sleep_until(uint64_t wakeup)
+{
+	uint64_t now = get_usec();
+
+	if (wakeup > now) {
+		struct timespec ts;
+
+		ts.tv_sec = (wakeup - now) / 1000000;
+		ts.tv_nsec = (wakeup - now) % 1000000 * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static int trim_serial(struct fstrim_control *ctl)
+{
+	struct fstrim_chunk ch;
+	uint64_t wakeup;
+	int rc = 0, x;
+
+	if (report_done(ctl))
+		rc = -1;
+
+	while ((x = get_chunk(ctl, &ch, &wakeup)) >= 0) {
+		if (x == 0) {
+			sleep_until(wakeup);
+			continue;
+		}
+		do_trim(&ch);
+		put_chunk(ctl, &ch);
+		if (report_done(ctl))
+			rc = -1;
+	}
+	return rc;
+}
+
+#ifdef HAVE_LIBPTHREAD
+struct fstrim_thread_data {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;		/* a chunk is done */
+	struct fstrim_control	*ctl;
+};
+
+static void *trim_thread(void *arg)
+{
+	struct fstrim_thread_data *td = (struct fstrim_thread_data *) arg;
+	struct fstrim_chunk ch;
+	uint64_t wakeup;
+	int x;
+
+	pthread_mutex_lock(&td->lock);
+
+	while ((x = get_chunk(td->ctl, &ch, &wakeup)) >= 0) {
+		if (x == 0) {
+			if (wakeup) {
+				struct timespec ts;
+
+				ts.tv_sec = wakeup / 1000000;
+				ts.tv_nsec = wakeup % 1000000 * 1000;
+				pthread_cond_timedwait(&td->cond, &td->lock, &ts);
+			} else
+				pthread_cond_wait(&td->cond, &td->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&td->lock);
+		do_trim(&ch);
+		pthread_mutex_lock(&td->lock);
+
+		put_chunk(td->ctl, &ch);
+		pthread_cond_broadcast(&td->cond);
+	}
+
+	pthread_mutex_unlock(&td->lock);
+	return NULL;
+}
+
+/*
+ * Trims the filesystems by @nthreads threads, the results are reported in
+ * the original order as soon as they are available.
+ */
+static int trim_parallel(struct fstrim_control *ctl, unsigned int nthreads)
+{
+	struct fstrim_thread_data td;
+	pthread_t *threads;
+	size_t i, n;
+	int rc = 0;
+
+	if (nthreads > ctl->nfss * ctl->per_device)
+		nthreads = ctl->nfss * ctl->per_device;
+
+	memset(&td, 0, sizeof(td));
+	pthread_mutex_init(&td.lock, NULL);
+	pthread_cond_init(&td.cond, NULL);
+	td.ctl = ctl;
+
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, trim_thread, &td))
+			break;
+	}
+	if (n == 0)
+		trim_thread(&td);	/* no thread created, do it yourself */
+
+	for (i = 0; i < ctl->nfss; i++) {
+		pthread_mutex_lock(&td.lock);
+		while (!fs_is_done(&ctl->fss[i]))
+			pthread_cond_wait(&td.cond, &td.lock);
+		pthread_mutex_unlock(&td.lock);
+
+		if (report_fs(ctl, &ctl->fss[i]))
+			rc = -1;
+	}
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_cond_destroy(&td.cond);
+	pthread_mutex_destroy(&td.lock);
+	free(threads);
+
+	return rc;
+}
+#endif /* HAVE_LIBPTHREAD */
+
 static void __attribute__((__noreturn__)) usage(FILE *out)
 {
 	fputs(USAGE_HEADER, out);
 	fprintf(out,
 	      _(" %s [options] <mount point>\n"), program_invocation_short_name);
+	fprintf(out,
+	      _(" %s [options] --all\n"), program_invocation_short_name);
 	fputs(USAGE_OPTIONS, out);
-	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"
+	fputs(_(" -a, --all           trim all mounted filesystems that support it\n"
+		" -o, --offset <num>  offset in bytes to discard from\n"
 		" -l, --length <num>  length of bytes to discard from the offset\n"
 		" -m, --minimum <num> minimum extent length to discard\n"
+		" -c, --chunk <num>   discard by chunks of <num> bytes\n"
+		" -d, --per-device <num>  maximal number of chunks in progress per device\n"
+		" -j, --threads <num> number of threads to use\n"
+		" -r, --rate <num>    maximal number of trimmed bytes per second per device\n"
+		" -L, --latency <ms>  adjust the chunk size to this time per call\n"
+		" -p, --parsable      print out in parsable format\n"
 		" -v, --verbose       print number of discarded bytes\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(USAGE_HELP, out);
@@ -70,17 +732,25 @@ static void __attribute__((__noreturn__)) usage(FILE *out)
 
 int main(int argc, char **argv)
 {
-	char *path;
-	int c, fd, verbose = 0;
-	struct fstrim_range range;
+	struct fstrim_control ctl;
+	char *path = NULL;
+	int c, rc;
+	unsigned int nthreads = 1;
 	struct stat sb;
 
 	static const struct option longopts[] = {
+	    { "all",       0, 0, 'a' },
 	    { "help",      0, 0, 'h' },
 	    { "version",   0, 0, 'V' },
 	    { "offset",    1, 0, 'o' },
 	    { "length",    1, 0, 'l' },
 	    { "minimum",   1, 0, 'm' },
+	    { "chunk",     1, 0, 'c' },
+	    { "per-device", 1, 0, 'd' },
+	    { "threads",   1, 0, 'j' },
+	    { "rate",      1, 0, 'r' },
+	    { "latency",   1, 0, 'L' },
+	    { "parsable",  0, 0, 'p' },
 	    { "verbose",   0, 0, 'v' },
 	    { NULL,        0, 0, 0 }
 	};
@@ -90,11 +760,16 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	memset(&range, 0, sizeof(range));
-	range.len = ULLONG_MAX;
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.range.len = ULLONG_MAX;
+	ctl.per_device = 1;
 
-	while ((c = getopt_long(argc, argv, "hVo:l:m:v", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "ahVo:l:m:c:d:j:r:L:pv",
+				longopts, NULL)) != -1) {
 		switch(c) {
+		case 'a':
+			ctl.all = 1;
+			break;
 		case 'h':
 			usage(stdout);
 			break;
@@ -102,19 +777,48 @@ int main(int argc, char **argv)
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
 		case 'l':
-			range.len = strtosize_or_err(optarg,
+			ctl.range.len = strtosize_or_err(optarg,
 					_("failed to parse length"));
 			break;
 		case 'o':
-			range.start = strtosize_or_err(optarg,
+			ctl.range.start = strtosize_or_err(optarg,
 					_("failed to parse offset"));
 			break;
 		case 'm':
-			range.minlen = strtosize_or_err(optarg,
+			ctl.range.minlen = strtosize_or_err(optarg,
 					_("failed to parse minimum extent length"));
 			break;
+		case 'c':
+			ctl.chunk = strtosize_or_err(optarg,
+					_("failed to parse chunk size"));
+			break;
+		case 'd':
+			ctl.per_device = strtou32_or_err(optarg,
+					_("invalid per-device limit argument"));
+			if (!ctl.per_device)
+				errx(EXIT_FAILURE, _("invalid per-device limit argument"));
+			break;
+		case 'j':
+			nthreads = strtou32_or_err(optarg,
+					_("invalid number of threads argument"));
+			if (!nthreads) {
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				nthreads = n > 0 ? n : 1;
+			}
+			break;
+		case 'r':
+			ctl.rate = strtosize_or_err(optarg,
+					_("failed to parse rate"));
+			break;
+		case 'L':
+			ctl.latency = strtou32_or_err(optarg,
+					_("invalid latency argument"));
+			break;
+		case 'p':
+			ctl.parsable = 1;
+			break;
 		case 'v':
-			verbose = 1;
+			ctl.verbose = 1;
 			break;
 		default:
 			usage(stderr);
@@ -122,38 +826,42 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (optind == argc)
-		errx(EXIT_FAILURE, _("no mountpoint specified"));
-
-	path = argv[optind++];
+	if (!ctl.all) {
+		if (optind == argc)
+			errx(EXIT_FAILURE, _("no mountpoint specified"));
+		path = argv[optind++];
+	}
 
 	if (optind != argc) {
 		warnx(_("unexpected number of arguments"));
 		usage(stderr);
 	}
 
-	if (stat(path, &sb) == -1)
-		err(EXIT_FAILURE, _("stat failed %s"), path);
-	if (!S_ISDIR(sb.st_mode))
-		errx(EXIT_FAILURE, _("%s: not a directory"), path);
+	if (path) {
+		char *source;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
-		err(EXIT_FAILURE, _("cannot open %s"), path);
+		if (stat(path, &sb) == -1)
+			err(EXIT_FAILURE, _("stat failed %s"), path);
+		if (!S_ISDIR(sb.st_mode))
+			errx(EXIT_FAILURE, _("%s: not a directory"), path);
 
-	if (ioctl(fd, FITRIM, &range))
-		err(EXIT_FAILURE, _("%s: FITRIM ioctl failed"), path);
+		source = get_fs_source(path);
+		if (add_fs(&ctl, path, source))
+			err(EXIT_FAILURE, _("cannot open %s"), path);
+		free(source);
+	} else
+		add_all_fs(&ctl);
 
-	if (verbose) {
-		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER |
-						 SIZE_SUFFIX_SPACE,
-						 (uint64_t) range.len);
-		/* TRANSLATORS: The standard value here is a very large number. */
-		printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
-						path, str,
-						(uint64_t) range.len);
-		free(str);
-	}
-	close(fd);
-	return EXIT_SUCCESS;
+	if (ctl.parsable)
+		printf("# mountpoint,source,trimmed,status\n");
+
+#ifdef HAVE_LIBPTHREAD
+	if (nthreads > 1 && ctl.nfss && (ctl.nfss > 1 || ctl.per_device > 1))
+		rc = trim_parallel(&ctl, nthreads);
+	else
+#endif
+		rc = trim_serial(&ctl);
+
+	free_fss(&ctl);
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -2,6 +2,7 @@
 TS_TESTUSER=${TS_TESTUSER:-"test"}
 
 # helpers
+TS_HELPER_BLKID_NEGCACHE="$top_builddir/test_blkid_negcache"
 TS_HELPER_BYTESWAP="$top_builddir/test_byteswap"
 TS_HELPER_CPUSET="$top_builddir/test_cpuset"
 TS_HELPER_ISLOCAL="$top_builddir/test_islocal"
@@ -20,6 +21,7 @@ TS_HELPER_PARTITIONS="$top_builddir/sample-partitions"
 TS_HELPER_PATHS="$top_builddir/test_pathnames"
 TS_HELPER_STRUTILS="$top_builddir/test_strutils"
 TS_HELPER_SYSINFO="$top_builddir/test_sysinfo"
+TS_HELPER_TT="$top_builddir/test_tt"
 
 # paths to commands
 TS_CMD_BLKID=${TS_CMD_BLKID-"$top_builddir/blkid"}
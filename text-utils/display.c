@@ -39,10 +39,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_LIBPTHREAD
+# include <pthread.h>
+#endif
 #include "hexdump.h"
 #include "xalloc.h"
 #include "c.h"
 #include "nls.h"
+#include "blkdev.h"
 
 static void doskip(const char *, int);
 static u_char *get(void);
@@ -52,6 +56,48 @@ enum _vflag vflag = FIRST;
 static off_t address;			/* address/offset in stream */
 static off_t eaddress;			/* end address */
 
+/*
+ * Input. Regular files are read by HEXDUMP_FILESZ chunks, everything else by
+ * HEXDUMP_READSZ chunks. The blocks are returned by get() directly from the
+ * buffer if possible, only a block which crosses the end of the buffer (or of
+ * the file) is copied to blkbuf[].
+ *
+ * The files are not mmap()ed, a file truncated while we read it would kill
+ * us by SIGBUS.
+ */
+#define HEXDUMP_FILESZ	(16 * 1024 * 1024)
+#define HEXDUMP_READSZ	(1024 * 1024)
+
+static struct hexdump_input {
+	u_char	*buf;			/* input buffer */
+	size_t	bufsz;			/* size of the allocated buffer */
+	size_t	readsz;			/* bytes to read at once */
+	size_t	len;			/* number of bytes in buf */
+	size_t	pos;			/* current position in buf */
+	int	fd;
+	unsigned int copyonly : 1;	/* don't return pointers to buf */
+} in = { .fd = -1 };
+
+static u_char *blkbuf[2];		/* blocks assembled from more reads */
+static u_char *curp;			/* the block assembled now */
+static u_char *savp;			/* the last returned block */
+
+/*
+ * Output for the specialized formatters, see fast_display().
+ */
+#define HEXDUMP_OUTSZ	(64 * 1024)
+#define HEXDUMP_LINESZ	128		/* max. size of one formatted line */
+
+static char outbuf[HEXDUMP_OUTSZ];
+static size_t outlen;
+
+static void out_flush(void)
+{
+	if (outlen)
+		fwrite(outbuf, 1, outlen, stdout);
+	outlen = 0;
+}
+
 static inline void
 print(PR *pr, unsigned char *bp) {
 
@@ -166,6 +212,116 @@ static void bpad(PR *pr)
 	while ((*p2++ = *p1++) != 0) ;
 }
 
+static const char hexdigits[] = "0123456789abcdef";
+
+static char hex2[256][2];		/* "%02x" */
+static char oct3[256][3];		/* "%03o" */
+static char pchar[256];			/* "%_p" */
+
+static void fast_init(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		hex2[i][0] = hexdigits[i >> 4];
+		hex2[i][1] = hexdigits[i & 0xf];
+		oct3[i][0] = '0' + (i >> 6);
+		oct3[i][1] = '0' + ((i >> 3) & 7);
+		oct3[i][2] = '0' + (i & 7);
+		pchar[i] = isprint(i) ? i : '.';
+	}
+}
+
+/* "%0<width>.<width>_ax" */
+static char *fast_address(char *p, uint64_t addr, int width)
+{
+	char tmp[16];
+	int n = 0;
+
+	do {
+		tmp[n++] = hexdigits[addr & 0xf];
+		addr >>= 4;
+	} while (addr);
+	while (n < width)
+		tmp[n++] = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/* two bytes in the native byte order as "%04x" */
+static inline char *fast_hex4(char *p, const u_char *bp)
+{
+	uint16_t val;
+
+	memcpy(&val, bp, sizeof(val));
+	memcpy(p, hex2[val >> 8], 2);
+	memcpy(p + 2, hex2[val & 0xff], 2);
+	return p + 4;
+}
+
+/*
+ * Formats one complete 16-byte block in the built-in layout to @p. It's the
+ * same as print() does for the format strings added by newsyntax(), including
+ * the trailing whitespace removal for the last iteration of the format unit.
+ */
+static char *fast_format(char *p, const u_char *bp, off_t addr)
+{
+	int i;
+
+	switch (fastfmt) {
+	case FMT_CANONICAL:
+		p = fast_address(p, addr, 8);
+		*p++ = ' ';
+		*p++ = ' ';
+		for (i = 0; i < 16; i++) {
+			memcpy(p, hex2[bp[i]], 2);
+			p += 2;
+			*p++ = ' ';
+			if (i == 7 || i == 15)
+				*p++ = ' ';
+		}
+		*p++ = '|';
+		for (i = 0; i < 16; i++)
+			*p++ = pchar[bp[i]];
+		*p++ = '|';
+		break;
+	case FMT_OCTAL1:
+		p = fast_address(p, addr, 7);
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			memcpy(p, oct3[bp[i]], 3);
+			p += 3;
+		}
+		break;
+	case FMT_HEX2:
+		p = fast_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			memcpy(p, "    ", 4);
+			p = fast_hex4(p + 4, bp + i);
+		}
+		break;
+	case FMT_DEFAULT:
+		p = fast_address(p, addr, 7);
+		for (i = 0; i < 16; i += 2) {
+			*p++ = ' ';
+			p = fast_hex4(p, bp + i);
+		}
+		break;
+	case FMT_NONE:
+		break;
+	}
+	*p++ = '\n';
+	return p;
+}
+
+static void fast_display(const u_char *bp)
+{
+	if (outlen + HEXDUMP_LINESZ > sizeof(outbuf))
+		out_flush();
+	outlen = fast_format(outbuf + outlen, bp, address) - outbuf;
+}
+
 void display(void)
 {
 	register FS *fs;
@@ -176,7 +332,25 @@ void display(void)
 	off_t saveaddress;
 	unsigned char savech = 0, *savebp;
 
-	while ((bp = get()) != NULL)
+	/* %s reads the data up to '\0', possibly behind the end of buf */
+	for (fs = fshead; fs; fs = fs->nextfs)
+		for (fu = fs->nextfu; fu; fu = fu->nextfu)
+			for (pr = fu->nextpr; pr; pr = pr->nextpr)
+				if (pr->flags & F_STR)
+					in.copyonly = 1;
+
+	if (blocksize != 16)
+		fastfmt = FMT_NONE;
+	if (fastfmt != FMT_NONE)
+		fast_init();
+
+	while ((bp = get()) != NULL) {
+	    /* the last incomplete block is blank-padded by print() */
+	    if (fastfmt != FMT_NONE && !eaddress) {
+		fast_display(bp);
+		continue;
+	    }
+	    out_flush();
 	    for (fs = fshead, savebp = bp, saveaddress = address; fs;
 		fs = fs->nextfs, bp = savebp, address = saveaddress)
 		    for (fu = fs->nextfu; fu; fu = fu->nextfu) {
@@ -197,6 +371,9 @@ void display(void)
 					*pr->nospace = savech;
 			    }
 		    }
+	}
+	out_flush();
+
 	if (endfu) {
 		/*
 		 * if eaddress not set, error or file size was multiple of
@@ -221,23 +398,325 @@ void display(void)
 
 static char **_argv;
 
+/*
+ * The block returned by get() is compared with the next one (duplicates
+ * suppression), keep it when the input buffer is going to be reused.
+ */
+static void input_save_block(void)
+{
+	if (savp && in.buf && savp >= in.buf && savp < in.buf + in.len) {
+		u_char *p = curp == blkbuf[0] ? blkbuf[1] : blkbuf[0];
+
+		memcpy(p, savp, blocksize);
+		savp = p;
+	}
+}
+
+/*
+ * Starts to read the current stdin, all skip has been already applied.
+ */
+static void input_open(int fd)
+{
+	struct stat st;
+
+	input_save_block();
+	in.len = in.pos = 0;
+	in.fd = fd;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		in.readsz = HEXDUMP_FILESZ;
+	else
+		in.readsz = HEXDUMP_READSZ;
+}
+
+/*
+ * Returns number of the available bytes (@bp points to the bytes), 0 on EOF
+ * and -1 on error.
+ */
+static ssize_t input_avail(u_char **bp)
+{
+	ssize_t n;
+
+	if (in.pos < in.len)
+		goto done;
+
+	input_save_block();
+	if (in.bufsz < in.readsz) {
+		free(in.buf);
+		in.buf = xmalloc(in.readsz);
+		in.bufsz = in.readsz;
+	}
+	in.len = in.pos = 0;
+
+	do {
+		n = read(in.fd, in.buf, in.readsz);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0)
+		return n;
+	in.len = n;
+done:
+	*bp = in.buf + in.pos;
+	return in.len - in.pos;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Parallel formatting (-j). The full 16-byte blocks of a seekable input are
+ * split to HEXDUMP_CHUNKSZ chunks, the chunks are formatted by the threads to
+ * per-chunk buffers and the buffers are written in the original order by the
+ * main thread. Only the built-in layouts are supported, print() is not thread
+ * safe.
+ *
+ * The duplicate lines suppression of a block depends on the two previous
+ * blocks only (the block is a duplicate if it's the same as the previous one,
+ * and "*" is printed if the previous block has not been a duplicate), so the
+ * threads read two blocks before the chunk. The first chunk continues the
+ * state from get().
+ */
+#define HEXDUMP_CHUNKSZ	(256 * 1024)
+
+enum { CHUNK_FREE, CHUNK_BUSY, CHUNK_DONE };
+
+struct hexdump_chunk {
+	char		*out;		/* formatted lines */
+	size_t		outlen;
+	int		state;		/* CHUNK_* */
+	int		error;		/* read error */
+	int		dup;		/* the last block is a duplicate */
+	u_char		last[16];	/* the last block */
+};
+
+struct hexdump_parallel {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;		/* chunk state changed */
+
+	int		fd;
+	off_t		offset;		/* the first block in the input */
+	off_t		address;	/* address of the first block */
+	off_t		size;		/* size of the full blocks */
+	const u_char	*savp;		/* block before the first block or NULL */
+	enum _vflag	vflag;		/* vflag for the first block */
+
+	size_t		nchunks;
+	size_t		next;		/* next chunk to format */
+	size_t		written;	/* number of written chunks */
+	size_t		nslots;		/* number of chunks in memory */
+	struct hexdump_chunk *slots;
+	int		stop;
+};
+
+static int read_all_at(int fd, u_char *buf, size_t count, off_t off)
+{
+	while (count) {
+		ssize_t n = pread(fd, buf, count, off);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		off += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int parallel_format_chunk(struct hexdump_parallel *hp, size_t idx,
+				 u_char *buf, struct hexdump_chunk *ch)
+{
+	off_t off = (off_t) idx * HEXDUMP_CHUNKSZ;
+	size_t len = min((off_t) HEXDUMP_CHUNKSZ, hp->size - off);
+	size_t pre = idx ? 32 : 0;
+	const u_char *bp, *prev, *end;
+	int first = 0, dup;
+	char *p = ch->out;
+
+	if (read_all_at(hp->fd, buf, pre + len, hp->offset + off - pre))
+		return -1;
+
+	bp = buf + pre;
+	end = bp + len;
+
+	if (idx) {
+		prev = bp - 16;
+		dup = !memcmp(prev, prev - 16, 16);
+	} else {
+		prev = hp->savp;
+		first = hp->vflag == FIRST;
+		dup = hp->vflag == DUP;
+	}
+
+	for (; bp < end; prev = bp, bp += 16, off += 16) {
+		if (hp->vflag == ALL || first || memcmp(bp, prev, 16)) {
+			p = fast_format(p, bp, hp->address + off);
+			first = dup = 0;
+		} else {
+			if (!dup) {
+				*p++ = '*';
+				*p++ = '\n';
+			}
+			dup = 1;
+		}
+	}
+
+	ch->outlen = p - ch->out;
+	ch->dup = dup;
+	memcpy(ch->last, end - 16, 16);
+	return 0;
+}
+
+static void *parallel_thread(void *arg)
+{
+	struct hexdump_parallel *hp = (struct hexdump_parallel *) arg;
+	u_char *buf = xmalloc(HEXDUMP_CHUNKSZ + 32);
+
+	for (;;) {
+		struct hexdump_chunk *ch;
+		size_t idx;
+		int rc;
+
+		pthread_mutex_lock(&hp->lock);
+		while (!hp->stop && hp->next < hp->nchunks &&
+		       hp->next >= hp->written + hp->nslots)
+			pthread_cond_wait(&hp->cond, &hp->lock);
+		if (hp->stop || hp->next >= hp->nchunks) {
+			pthread_mutex_unlock(&hp->lock);
+			break;
+		}
+		idx = hp->next++;
+		ch = &hp->slots[idx % hp->nslots];
+		ch->state = CHUNK_BUSY;
+		pthread_mutex_unlock(&hp->lock);
+
+		rc = parallel_format_chunk(hp, idx, buf, ch);
+
+		pthread_mutex_lock(&hp->lock);
+		ch->error = rc;
+		ch->state = CHUNK_DONE;
+		pthread_cond_broadcast(&hp->cond);
+		pthread_mutex_unlock(&hp->lock);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Formats the full blocks from the current position of @fd, returns number of
+ * the formatted bytes. The remaining data (incomplete block, or everything
+ * after a read error) is up to get().
+ */
+static off_t parallel_display(int fd)
+{
+	struct hexdump_parallel hp;
+	unsigned long long size;
+	pthread_t *threads;
+	struct stat st;
+	off_t done = 0;
+	size_t i, n;
+
+	if (fstat(fd, &st) != 0)
+		return 0;
+	if (S_ISREG(st.st_mode))
+		size = st.st_size;
+	else if (!S_ISBLK(st.st_mode) || blkdev_get_size(fd, &size) != 0)
+		return 0;
+
+	memset(&hp, 0, sizeof(hp));
+	hp.fd = fd;
+	hp.offset = lseek(fd, 0, SEEK_CUR);
+	if (hp.offset < 0 || (unsigned long long) hp.offset >= size)
+		return 0;
+
+	hp.size = size - hp.offset;
+	if (length != -1 && length < hp.size)
+		hp.size = length;
+	hp.size -= hp.size % 16;
+	hp.nchunks = (hp.size + HEXDUMP_CHUNKSZ - 1) / HEXDUMP_CHUNKSZ;
+	if (hp.nchunks < 2)
+		return 0;
+
+	hp.address = address;
+	hp.savp = savp;
+	hp.vflag = vflag;
+	hp.nslots = 2 * nthreads;
+	hp.slots = xcalloc(hp.nslots, sizeof(struct hexdump_chunk));
+	for (i = 0; i < hp.nslots; i++)
+		hp.slots[i].out = xmalloc(HEXDUMP_CHUNKSZ / 16 * HEXDUMP_LINESZ);
+	threads = xcalloc(nthreads, sizeof(pthread_t));
+
+	pthread_mutex_init(&hp.lock, NULL);
+	pthread_cond_init(&hp.cond, NULL);
+	for (n = 0; n < nthreads; n++) {
+		if (pthread_create(&threads[n], NULL, parallel_thread, &hp))
+			break;
+	}
+	if (n == 0)
+		goto done;
+
+	out_flush();
+
+	for (i = 0; i < hp.nchunks; i++) {
+		struct hexdump_chunk *ch = &hp.slots[i % hp.nslots];
+
+		pthread_mutex_lock(&hp.lock);
+		while (ch->state != CHUNK_DONE)
+			pthread_cond_wait(&hp.cond, &hp.lock);
+		pthread_mutex_unlock(&hp.lock);
+
+		if (ch->error)
+			break;
+
+		fwrite(ch->out, 1, ch->outlen, stdout);
+
+		/* the state for get() */
+		savp = curp == blkbuf[0] ? blkbuf[1] : blkbuf[0];
+		memcpy(savp, ch->last, 16);
+		if (vflag != ALL)
+			vflag = ch->dup ? DUP : WAIT;
+		done += min((off_t) HEXDUMP_CHUNKSZ, hp.size - done);
+
+		pthread_mutex_lock(&hp.lock);
+		ch->state = CHUNK_FREE;
+		hp.written++;
+		pthread_cond_broadcast(&hp.cond);
+		pthread_mutex_unlock(&hp.lock);
+	}
+
+	pthread_mutex_lock(&hp.lock);
+	hp.stop = 1;
+	pthread_cond_broadcast(&hp.cond);
+	pthread_mutex_unlock(&hp.lock);
+done:
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+	pthread_cond_destroy(&hp.cond);
+	pthread_mutex_destroy(&hp.lock);
+
+	for (i = 0; i < hp.nslots; i++)
+		free(hp.slots[i].out);
+	free(hp.slots);
+	free(threads);
+	return done;
+}
+#endif /* HAVE_LIBPTHREAD */
+
 static u_char *
 get(void)
 {
 	static int ateof = 1;
-	static u_char *curp, *savp;
 	ssize_t n, need, nread;
-	u_char *tmpp;
+	u_char *bp;
 
-	if (!curp) {
-		curp = xcalloc(1, blocksize);
-		savp = xcalloc(1, blocksize);
-	} else {
-		tmpp = curp;
-		curp = savp;
-		savp = tmpp;
+	if (!blkbuf[0]) {
+		blkbuf[0] = xcalloc(1, blocksize);
+		blkbuf[1] = xcalloc(1, blocksize);
+	} else
 		address += blocksize;
-	}
+
+	curp = savp == blkbuf[0] ? blkbuf[1] : blkbuf[0];
+
 	for (need = blocksize, nread = 0;;) {
 		/*
 		 * if read the right number of bytes, or at EOF for one file,
@@ -247,10 +726,12 @@ get(void)
 		if (!length || (ateof && !next(NULL))) {
 			if (need == blocksize)
 				return(NULL);
-			if (!need && vflag != ALL &&
+			if (!need && vflag != ALL && savp &&
 			    !memcmp(curp, savp, nread)) {
-				if (vflag != DUP)
+				if (vflag != DUP) {
+					out_flush();
 					(void)printf("*\n");
+				}
 				return(NULL);
 			}
 			if (need > 0)
@@ -262,26 +743,58 @@ get(void)
 			warnx(_("all input file arguments failed"));
 			return(NULL);
 		}
-		n = fread((char *)curp + nread, sizeof(unsigned char),
-		    length == -1 ? need : min(length, need), stdin);
-		if (!n) {
-			if (ferror(stdin))
+		if (ateof) {
+#ifdef HAVE_LIBPTHREAD
+			if (nthreads > 1 && fastfmt != FMT_NONE &&
+			    need == blocksize && length) {
+				off_t done = parallel_display(fileno(stdin));
+
+				if (done) {
+					lseek(fileno(stdin), done, SEEK_CUR);
+					address += done;
+					if (length != -1)
+						length -= done;
+				}
+			}
+#endif
+			input_open(fileno(stdin));
+		}
+
+		n = input_avail(&bp);
+		if (n <= 0) {
+			if (n < 0)
 				warn("%s", _argv[-1]);
 			ateof = 1;
 			continue;
 		}
 		ateof = 0;
+		if (length != -1)
+			n = min(length, n);
+
+		if (need == blocksize && n >= blocksize && !in.copyonly) {
+			/* whole block in the buffer, don't copy */
+			n = blocksize;
+		} else {
+			n = min(n, need);
+			memcpy(curp + nread, bp, n);
+			bp = curp;
+		}
+		in.pos += n;
+
 		if (length != -1)
 			length -= n;
 		if (!(need -= n)) {
 			if (vflag == ALL || vflag == FIRST ||
-			    memcmp(curp, savp, blocksize)) {
+			    memcmp(bp, savp, blocksize)) {
 				if (vflag == DUP || vflag == FIRST)
 					vflag = WAIT;
-				return(curp);
+				savp = bp;
+				return(bp);
 			}
-			if (vflag == WAIT)
+			if (vflag == WAIT) {
+				out_flush();
 				(void)printf("*\n");
+			}
 			vflag = DUP;
 			address += blocksize;
 			need = blocksize;
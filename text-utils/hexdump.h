@@ -77,10 +77,15 @@ extern int deprecated;			/* od compatibility */
 extern int exitval;			/* final exit value */
 extern ssize_t length;			/* max bytes to read */
 extern off_t skip;                      /* bytes to skip */
+extern unsigned int nthreads;		/* formatting threads */
 
 enum _vflag { ALL, DUP, FIRST, WAIT };	/* -v values */
 extern enum _vflag vflag;
 
+/* built-in layouts with a specialized formatter, see display.c */
+enum _fastfmt { FMT_NONE, FMT_DEFAULT, FMT_CANONICAL, FMT_OCTAL1, FMT_HEX2 };
+extern enum _fastfmt fastfmt;
+
 int block_size(FS *);
 void add(const char *);
 void rewrite(FS *);
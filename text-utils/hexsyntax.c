@@ -48,39 +48,64 @@
 #include "c.h"
 
 off_t skip;				/* bytes to skip */
+enum _fastfmt fastfmt = FMT_NONE;	/* specialized formatter */
+unsigned int nthreads = 1;		/* formatting threads */
 
 
 void
 newsyntax(int argc, char ***argvp)
 {
-	int ch;
+	int ch, nfmts = 0;
+	long ncpus;
 	char **argv;
+	enum _fastfmt fmt = FMT_NONE;
 
 	argv = *argvp;
-	while ((ch = getopt(argc, argv, "bcCde:f:n:os:vxV")) != -1) {
+	while ((ch = getopt(argc, argv, "bcCde:f:j:n:os:vxV")) != -1) {
 		switch (ch) {
 		case 'b':
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"");
+			fmt = FMT_OCTAL1;
+			nfmts++;
 			break;
 		case 'c':
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"");
+			nfmts++;
 			break;
 		case 'C':
 			add("\"%08.8_Ax\n\"");
 			add("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ");
 			add("\"  |\" 16/1 \"%_p\" \"|\\n\"");
+			fmt = FMT_CANONICAL;
+			nfmts++;
 			break;
 		case 'd':
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"");
+			nfmts++;
 			break;
 		case 'e':
 			add(optarg);
+			nfmts++;
 			break;
 		case 'f':
 			addfile(optarg);
+			nfmts++;
+			break;
+		case 'j':
+			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if (ncpus < 1)
+				ncpus = 1;
+			nthreads = strtou32_or_err(optarg,
+					_("invalid number of threads argument"));
+			/* every thread needs two chunk buffers, don't allow
+			 * more threads than the machine can really use */
+			if (!nthreads)
+				nthreads = ncpus;
+			else if (nthreads > 4 * ncpus)
+				nthreads = 4 * ncpus;
 			break;
 		case 'n':
 			length = strtosize_or_err(optarg, _("failed to parse length"));
@@ -88,6 +113,7 @@ newsyntax(int argc, char ***argvp)
 		case 'o':
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"");
+			nfmts++;
 			break;
 		case 's':
 			skip = strtosize_or_err(optarg, _("failed to parse offset"));
@@ -98,6 +124,8 @@ newsyntax(int argc, char ***argvp)
 		case 'x':
 			add("\"%07.7_Ax\n\"");
 			add("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"");
+			fmt = FMT_HEX2;
+			nfmts++;
 			break;
 		case 'V':
 			printf(_("%s from %s\n"),
@@ -113,7 +141,9 @@ newsyntax(int argc, char ***argvp)
 	if (!fshead) {
 		add("\"%07.7_Ax\n\"");
 		add("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"");
-	}
+		fastfmt = FMT_DEFAULT;
+	} else if (nfmts == 1)
+		fastfmt = fmt;
 
 	*argvp += optind;
 }
@@ -133,6 +163,7 @@ void __attribute__((__noreturn__)) usage(FILE *out)
 		       " -x              two-byte hexadecimal display\n"
 		       " -e format       format string to be used for displaying data\n"
 		       " -f format_file  file that contains format strings\n"
+		       " -j num          format by num parallel threads\n"
 		       " -n length       interpret only length bytes of input\n"
 		       " -s offset       skip offset bytes from the beginning\n"
 		       " -v              display without squeezing similar lines\n"